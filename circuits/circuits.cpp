@@ -2,6 +2,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 // pico
 #include "pico/stdio.h"
 #include "pico/stdio_usb.h"
@@ -13,52 +14,249 @@
 #include "dcc_api.h"
 using Status = DccApi::Status;
 // railroad
-#include "afunc.h"
 #include "config.h"
 #include "desktop_layout.h"
 #include "locos.h"
 #include "sensor.h"
 #include "sensor2.h"
 #include "turnout.h"
+// track
+#include "blocks.h"
+#include "func_sched.h"
+#include "layout.h"
+#include "length_learn.h"
+#include "motion.h"
+#include "param_store.h"
+#include "profile.h"
+#include "recouple_monitor.h"
+#include "roster_alias.h"
+#include "roster_index.h"
+#include "speed_table.h"
+#include "supervisor.h"
+#include "trace.h"
+#include "tuner.h"
+#include "turnout_sched.h"
+#include "uncouple_learn.h"
+#include "yard_planner.h"
 
 static constexpr bool snd_engine = true;
 static constexpr bool snd_horn = true;
 static constexpr bool snd_bell = true;
 
-static AFunc afunc;
+// Stream a session trace ("@" lines, see trace.h) for replaying on the host
+// with sim_circuits --replay; off, it's only the app's own printfs.
+static constexpr bool trace_on = false;
+
+static void func_send(int id, int f_num, bool on, intptr_t);
+
+// Horn toots and the like, sent from loop() as they come due.
+static FuncSched funcs(func_send);
+
+// Everything sent to the loco and seen by the sensors, streamed out with
+// the printfs so a session can be replayed on the host (host/sim).
+static Trace trace;
+
+// Time spent in each phase, speed segment and dwell; 'p' prints it.
+static Profile prof;
 
 static constexpr int loco_id = 3;
 
 static const Loco *loco = nullptr;
 
-static const int zippy_mms = 300;
-static const int fast_mms = 150;
-static const int medium_mms = 100;
-static const int slow_mms = 75;
-static const int creep_mms = 25;
-static const int stop = 0;
-
-// How many microseconds to go dist_mm at speed_mms
-static uint32_t mm_to_us(int dist_mm, int speed_mms)
-{
-    const uint32_t t_us = (dist_mm * 1'000'000 + speed_mms / 2) / speed_mms;
-    return t_us;
-}
+// Lookups in the railroad library's roster, built from it at startup; a
+// decoder that isn't in it is looked up in RosterAlias.
+static constexpr int roster_cap = 32;
+static const RosterIndex<Loco, roster_cap> roster_index(Loco::roster,
+                                                       Loco::roster_max);
+
+// loco's speed curve, for Motion's conversions (it does one every loop)
+static SpeedTable speed_table;
+
+// These can be tuned (see tune_param); the values are the defaults.
+static int zippy_mms = 300;
+static int fast_mms = 150;
+static int medium_mms = 100;
+static int slow_mms = 75;
+static int creep_mms = 25;
+
+// Speed changes are ramped here rather than by the decoder (cv3/cv4 are 0)
+static int accel_mms2 = 150;
+static int decel_mms2 = 600;
+static constexpr int jerk_mms3 = 2000;
+
+static int settle_ms = 2000;     // between uncouple and spot
+static int fetch_creep_mm = 100; // creep this far to the car
+static int spot_creep_mm = 100;  // creep this far to where the car is left
+
+// clang-format off
+static Tuner::Param tune_param[] = {
+    // name            val              min   max   step  step_min
+    {"zippy_mms",      &zippy_mms,      150,  420,   50,   10},
+    {"fast_mms",       &fast_mms,        75,  300,   25,    5},
+    {"medium_mms",     &medium_mms,      50,  200,   25,    5},
+    {"slow_mms",       &slow_mms,        40,  150,   10,    5},
+    {"creep_mms",      &creep_mms,       15,   50,    5,    1},
+    {"accel_mms2",     &accel_mms2,      50,  600,   50,   10},
+    {"decel_mms2",     &decel_mms2,     100, 1200,  100,   20},
+    {"settle_ms",      &settle_ms,      250, 3000, -500,  100},
+    {"fetch_creep_mm", &fetch_creep_mm,  30,  200,  -20,    5},
+    {"spot_creep_mm",  &spot_creep_mm,   30,  200,  -20,    5},
+};
+// clang-format on
+static constexpr int tune_param_cnt =
+    sizeof(tune_param) / sizeof(tune_param[0]);
+
+// Bump when tune_param changes, so sets saved for the old list are ignored
+static constexpr uint32_t tune_version = 2;
+
+static bool tune_ok(intptr_t arg);
+
+// A trial is three cycles, one for each way the cars can be arranged.
+// 't' starts and stops tuning.
+static Tuner tuner(tune_param, tune_param_cnt, 3, tune_ok);
+
+// Sensor readings out of range this cycle; the tuner won't keep a setting
+// that causes any. Uncouple and spot retries happen at any setting, and
+// the time they take is already in the cycle time.
+static int failures = 0;
+
+// where the car on each spur was left (or found), for fetch to notice
+// when it bumps the car before it should
+static int car_at_mm[4] = {};
 
 // value >= 0 means set the cv to that value; negative values are special
 static constexpr int cv_none = -1; // don't change, don't read
 static constexpr int cv_show = -2; // don't change, but read and show
 static constexpr int cv_bits = -3; // don't change, but read and show bits
 
-static int car_len_mm = 150; // boxcar and tanker
+static int car_len_mm = 150; // boxcar and tanker, until they're measured
+
+// Car lengths (by planner car number) are measured in fetch, the loco's
+// in uncouple, with Motion's odometer; once they're settled, fetch and
+// spot use them, and creep only as far as they might be off.
+static LengthLearn car_len(YardPlanner::car_max);
+static LengthLearn loco_len(1);
+
+// How far uncouple pulls clear of the magnet and how long it waits over
+// it, learned for each loco and car.
+static UncoupleLearn unc_learn;
+
+// Watches the spur's sensor as the loco pulls away from the car: in fetch
+// the car should come along, in spot it shouldn't.
+static RecoupleMonitor recouple;
+
+// How far to pull to see if the car comes along, and how many times fetch
+// bumps the car to couple it, or uncouple and spot leave it, before
+// waiting for someone to do it and type 'c'.
+static constexpr int follow_mm = 30;
+static constexpr int couple_tries = 3;
+static constexpr int spot_tries = 4;
+
+// set by loop() when 'c' is typed
+static bool go_on = false;
+
+// Spurs 1..3 are the planner's 0..2. Each holds one car the way fetch and
+// spot work, and the loco moves one car at a time. yard_cost() depends on
+// medium_mms and the spurs' lengths, so the planner is told when the tuner
+// or a layout changes them.
+static constexpr int spur_cnt = 3;
+static constexpr int spur_cap[spur_cnt] = {1, 1, 1};
+
+static uint32_t yard_cost(int from, int to, int cars, intptr_t arg);
+
+static YardPlanner yard_planner(spur_cnt, spur_cap, 1, yard_cost);
+
+// Blocks: the house, the main (at the uncoupler), and the spurs. The loco
+// is the only train, but it still reserves each move's route, and the
+// turnouts can only be thrown while it holds them.
+static constexpr int block_house = 0;
+static constexpr int block_main = 1;
+static constexpr int block_cnt = 2 + spur_cnt;
+static const char *const block_name[block_cnt] = {
+    "house", "main", "spur1", "spur2", "spur3",
+};
+
+static int block_spur(int spur_num)
+{
+    return block_main + spur_num;
+}
+
+static bool block_sense(int block, intptr_t arg);
+
+static Blocks blocks(block_cnt, block_name, block_sense);
+
+// The layout as uploaded ('L'), if there is one with an "unc" node and a
+// node for each spur's end; desktop_layout.h's numbers otherwise.
+static Layout layout;
+static int layout_unc = -1; // -1 if not using it
+static int layout_spur[spur_cnt + 1];
+static void layout_init();
+static void layout_upload();
+static int spur_mm(int spur_num);
+
+// Set by loop() when 'L' is typed. The upload is taken at home between
+// cycles, not in loop(): that's called while the loco runs, and receiving
+// blocks, and saving it runs with interrupts off. Until then the upload
+// waits in the console, so loop() doesn't read it.
+static bool upload_waiting = false;
+
+// The turnouts share a CDU, which needs this long to recharge after each
+// throw. Routes are asked for when it's safe to throw them, and waited for
+// just before the train gets to the points.
+static constexpr uint32_t cdu_recharge_us = 1'000'000;
+
+static void turnout_throw(int t, bool straight, intptr_t)
+{
+    turnout[t].set(straight);
+}
+
+static TurnoutSched turnouts(turnout_max, cdu_recharge_us, turnout_throw);
 
 static void ops_cv_val_set(int num, int val);
 static void ops_cv_bit_set(int cv_num, int b_num, int b_val);
 
 static void init();
 static void loop(int32_t for_us = 0);
+static void params_load();
+static void params_save();
+static const Loco *loco_alias(uint32_t sn);
+static void trace_loop();
 static void func_set(int f_num, bool on, bool verbose = false);
 
+// Motion waits in loop(), and ramps speeds with a step at a time sent here
+static void motion_loop(int32_t for_us, intptr_t)
+{
+    loop(for_us);
+}
+
+static void motion_speed(int speed_mms, intptr_t)
+{
+    prof.segment(speed_mms);
+}
+
+static void motion_send(int speed_dcc, intptr_t)
+{
+    DccApi::loco_speed_set(loco_id, speed_dcc);
+    trace.speed(loco_id, speed_dcc);
+}
+
+static Motion motion(motion_loop);
+
+// Sensor waits have a window (how far the loco should go before the
+// sensor changes); a loco that doesn't get there is stopped instead of
+// waited for forever.
+static void supervisor_event(Supervisor::Event e, intptr_t);
+static Supervisor supervisor(motion, supervisor_event);
+static void supervisor_loop();
+static bool move_until(const Sensor &s, bool level, int speed_mms,
+                       int expect_mm);
+static int approach(const Sensor2 &s, int target_mm, int speed_mms,
+                    int expect_mm, bool stop = false);
+
+// How far home() stops past the uncoupler sensor (from where its nose got
+// there), until it's been measured.
+static int home_unc_mm = 1000;
+
 static void toots(uint32_t on1_us, uint32_t off1_us = 0, uint32_t on2_us = 0,
                   uint32_t off2_us = 0, uint32_t on3_us = 0);
 
@@ -80,11 +278,17 @@ static void toots_proceeding()
     }
 }
 
-static bool check_setup(int &spur_a, int &spur_b);
-static void fetch(int spur_num);
-static void uncouple();
-static bool spot(int spur_num);
-static void home();
+static bool check_setup(YardPlanner::State &yard);
+static YardPlanner::State yard_next(YardPlanner::State yard);
+static void reserve_move(int from_spur, int to_spur);
+static void line_route(int spur_num);
+static void wait_route(int spur_num);
+static void fetch(int spur_num, int car);
+static void uncouple(int car);
+static bool spot(int spur_num, int car);
+static bool car_follows(int pull_mm);
+static void wait_go_on();
+static void home(int spur_num, int car);
 
 
 int main()
@@ -112,9 +316,9 @@ int main()
 
     uint32_t track_on_us = time_us_32();
 
-    // spurs a and b initially have the cars on them
-    int spur_a, spur_b;
-    while (!check_setup(spur_a, spur_b)) {
+    // where the cars are
+    YardPlanner::State yard;
+    while (!check_setup(yard)) {
         // flash led
         SysLed::on();
         loop(500'000);
@@ -122,9 +326,6 @@ int main()
         loop(500'000);
     }
 
-    // spur_e is initially empty
-    int spur_e = 6 - spur_a - spur_b; // 1+2+3=6
-
     // let the supercap charge some before trying to move
     const uint32_t charge_us = 5'000'000;
     const uint32_t delay_us = charge_us - (time_us_32() - track_on_us);
@@ -132,21 +333,61 @@ int main()
 
     while (true) {
 
-        fetch(spur_a);
-
-        do {
-            loop(2'000'000);
-            uncouple();
-            loop(2'000'000);
-            // if spot() returns false, the car recoupled, so try again
-        } while (!spot(spur_e));
+        if (upload_waiting)
+            layout_upload();
+
+        prof.cycle();
+        const uint32_t cycle_us = time_us_32();
+        failures = 0;
+        motion.ramp(accel_mms2, decel_mms2, jerk_mms3); // may be tuned
+
+        const YardPlanner::State goal = yard_next(yard);
+        const YardPlanner::Move *move;
+        const int move_cnt = yard_planner.plan(yard, goal, move);
+        assert(move_cnt >= 0);
+
+        for (int m = 0; m < move_cnt; m++) {
+            reserve_move(move[m].from + 1, move[m].to + 1);
+
+            // the one nearest the throat
+            const int from_cars = yard_planner.count(yard, move[m].from);
+            const int car = yard_planner.car(yard, move[m].from, from_cars - 1);
+
+            fetch(move[m].from + 1, car);
+
+            int spot_retries = -1;
+            bool left;
+            do {
+                spot_retries++;
+                loop(settle_ms * 1000);
+                uncouple(car);
+                loop(settle_ms * 1000);
+                // if spot() returns false, the car recoupled, so try again
+                left = spot(move[m].to + 1, car);
+            } while (!left && spot_retries < spot_tries - 1);
+            prof.retries("spot", spot_retries);
+            if (!left) {
+                failures++;
+                printf("spot %d: car won't stay; uncouple it and type 'c'\n",
+                       move[m].to + 1);
+                wait_go_on();
+            }
+            yard = yard_planner.apply(yard, move[m]);
 
-        loop(2'000'000);
-        spur_a = spur_b;
-        spur_b = spur_e;
-        spur_e = 6 - spur_a - spur_b; // 1+2+3=6
-        home();
+            loop(settle_ms * 1000);
+            home(move[m].to + 1, car);
+            blocks.release(loco_id);
+        }
         loop(3'000'000);
+
+        if (tuner.tuning()) {
+            const bool better = tuner.cycle(time_us_32() - cycle_us, failures);
+            yard_planner.costs_changed();
+            if (better || tuner.done())
+                params_save();
+            if (tuner.done())
+                tuner.print();
+        }
     }
 
     sleep_ms(100);
@@ -156,17 +397,124 @@ int main()
 } // main()
 
 
+// Callers poll sensors with loop(0), which may not get through the while
+// at all, so the trace looks at them first.
 static void loop(int32_t for_us)
 {
-    int32_t end_us = int32_t(time_us_32()) + for_us;
-    while (end_us - int32_t(time_us_32()) >= 0) {
+    const int c = upload_waiting ? -1 : stdio_getchar_timeout_us(0);
+    if (c == 'p') {
+        prof.print();
+        tuner.print();
+        yard_planner.print_stats();
+        blocks.print();
+        layout.print();
+        turnouts.print();
+        funcs.print();
+        loco_len.print("loco");
+        car_len.print("car");
+        unc_learn.print();
+        recouple.print();
+        supervisor.print();
+    } else if (c == 'L') {
+        upload_waiting = true;
+        printf("layout: taking upload at home\n");
+    } else if (c == 't') {
+        if (tuner.tuning()) {
+            tuner.stop();
+            printf("tuner: stopped\n");
+        } else {
+            tuner.start();
+            printf("tuner: started\n");
+        }
+        yard_planner.costs_changed();
+    } else if (c == 'c') {
+        go_on = true;
+    }
+    motion.loop();
+    supervisor_loop();
+    turnouts.loop();
+    blocks.loop();
+    trace_loop();
+    const uint32_t start_us = time_us_32();
+    const uint32_t end_us = start_us + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0) {
         SysLed::loop();
-        afunc.loop();
+        funcs.loop();
         BufLog::loop();
+        motion.loop();
+        supervisor_loop();
+        turnouts.loop();
+        blocks.loop();
+        trace_loop();
+    }
+    if (for_us > 0) {
+        trace.wake();
+        prof.dwell(for_us, time_us_32() - start_us);
     }
 } // loop
 
 
+// Carry on (everything but the run) until someone types 'c'. An upload
+// waiting for home would be read before the 'c', so it's dropped.
+static void wait_go_on()
+{
+    if (upload_waiting) {
+        int c;
+        while ((c = stdio_getchar_timeout_us(2'000'000)) >= 0 && c != '.')
+            ;
+        upload_waiting = false;
+        printf("layout: upload dropped; send it again\n");
+    }
+    go_on = false;
+    while (!go_on)
+        loop(10'000);
+}
+
+
+// The supervisor's events come from its loop(), inside ours: the loco is
+// stopped where it is, and supervisor_loop() waits there (the rest of
+// loop() carrying on) until someone has sorted it out and types 'c'; then
+// it goes on at the speed it had.
+static int supervisor_mms = 0;
+
+static void supervisor_event(Supervisor::Event e, intptr_t)
+{
+    supervisor_mms = motion.speed_now();
+    motion.stop();
+    failures++;
+    printf("supervisor: %s %d mm into a %d mm window; stopped, 'c' to go on\n",
+           Supervisor::name(e), supervisor.used_mm(), supervisor.expect_mm());
+}
+
+
+// The wait calls loop(), which calls this again; only the outer one waits.
+static void supervisor_loop()
+{
+    static bool waiting = false;
+    supervisor.loop();
+    if (!supervisor.tripped() || waiting)
+        return;
+    waiting = true;
+    wait_go_on();
+    printf("supervisor: going on\n");
+    motion.speed(supervisor_mms);
+    supervisor.resume();
+    waiting = false;
+}
+
+
+static void trace_loop()
+{
+    if (!trace.on())
+        return;
+    for (int i = 0; i < sensor_max; i++)
+        trace.sensor(i, sensor[i]);
+    for (int i = 0; i < sensor2_max; i++)
+        trace.sensor2(i, sensor2[i].dist_mm());
+    trace.loop();
+} // trace_loop
+
+
 static void func_set(int f_num, bool on, bool verbose)
 {
     if (f_num < 0)
@@ -176,6 +524,7 @@ static void func_set(int f_num, bool on, bool verbose)
         printf("f%d %s ... ", f_num, on ? "on" : "off");
 
     DccApi::loco_func_set(loco_id, f_num, on);
+    trace.func(loco_id, f_num, on);
 
     if (verbose)
         printf("ok\n");
@@ -183,43 +532,52 @@ static void func_set(int f_num, bool on, bool verbose)
 } // func_set
 
 
+static void func_send(int id, int f_num, bool on, intptr_t)
+{
+    DccApi::loco_func_set(id, f_num, on);
+    trace.func(id, f_num, on);
+}
+
+
 static void toots(uint32_t on1_us,                   //
                   uint32_t off1_us, uint32_t on2_us, //
                   uint32_t off2_us, uint32_t on3_us)
 {
     uint32_t now_us = time_us_32();
     if (on1_us > 0) {
-        afunc.put(now_us, loco_id, 2, true);
+        funcs.put(now_us, loco_id, loco->f_horn, true);
         now_us += on1_us;
-        afunc.put(now_us, loco_id, 2, false);
+        funcs.put(now_us, loco_id, loco->f_horn, false);
         if (on2_us > 0) {
             now_us += off1_us;
-            afunc.put(now_us, loco_id, 2, true);
+            funcs.put(now_us, loco_id, loco->f_horn, true);
             now_us += on2_us;
-            afunc.put(now_us, loco_id, 2, false);
+            funcs.put(now_us, loco_id, loco->f_horn, false);
             if (on3_us > 0) {
                 now_us += off2_us;
-                afunc.put(now_us, loco_id, 2, true);
+                funcs.put(now_us, loco_id, loco->f_horn, true);
                 now_us += on3_us;
-                afunc.put(now_us, loco_id, 2, false);
+                funcs.put(now_us, loco_id, loco->f_horn, false);
             }
         }
     }
 } // toots
 
 
-// There should be cars on two and only two spurs
-static bool check_setup(int &spur_a, int &spur_b)
+// There should be a car on at least one spur, and at least one spur empty
+// to move one to; all the cars have to be in view of the sensors.
+static bool check_setup(YardPlanner::State &yard)
 {
     bool ok = true;
-    spur_a = 0;
-    spur_b = 0;
+    yard = YardPlanner::empty;
+    int cars = 0;
 
-    // If there is a car on spur1, it must be in detection range, but not too close.
+    // If there is a car on a spur, it must be in detection range, but not
+    // too close.
     constexpr int in_range_mm = 100; // 4"
     constexpr int too_close_mm = 25; // 1"
 
-    for (int spur = 1; spur <= 3; spur++) {
+    for (int spur = 1; spur <= spur_cnt; spur++) {
         int dist_mm = sensor2[spur].dist_mm();
         if (dist_mm < in_range_mm) {
 
@@ -229,26 +587,20 @@ static bool check_setup(int &spur_a, int &spur_b)
                 ok = false;
             } else {
                 printf("car detected on spur %d", spur);
+                car_at_mm[spur] = dist_mm;
             }
             printf(" (%d mm)\n", dist_mm);
 
-            if (spur_a == 0) {
-                spur_a = spur;
-            } else if (spur_b == 0) {
-                spur_b = spur;
-            } else {
-                assert(spur == 3);
-                printf("check_setup: ERROR: cars detected on all spurs\n");
-                ok = false;
-            }
+            yard_planner.push(yard, spur - 1, cars++);
         }
     }
 
-    if (spur_a == 0) {
+    // there has to be somewhere to move a car to
+    if (cars == 0) {
         printf("check_setup: ERROR: no cars on any spurs\n");
         ok = false;
-    } else if (spur_b == 0) {
-        printf("check_setup: ERROR: only one car detected (spur %d)\n", spur_a);
+    } else if (cars == spur_cnt) {
+        printf("check_setup: ERROR: cars detected on all spurs\n");
         ok = false;
     }
 
@@ -256,13 +608,188 @@ static bool check_setup(int &spur_a, int &spur_b)
 }
 
 
+// Every car goes on to the next spur (the last spur's to the first). With
+// two cars on three spurs that's two moves, and one has to go into the
+// empty spur first to make room for the other; the planner works out
+// which, and three cycles go through every arrangement.
+static YardPlanner::State yard_next(YardPlanner::State yard)
+{
+    YardPlanner::State goal = YardPlanner::empty;
+    for (int spur = 0; spur < spur_cnt; spur++) {
+        const int car = yard_planner.car(yard, spur, 0);
+        if (car >= 0)
+            yard_planner.push(goal, (spur + 1) % spur_cnt, car);
+    }
+    return goal;
+}
+
+
+// Out of the house, to one spur and then the other, and back.
+static void reserve_move(int from_spur, int to_spur)
+{
+    Blocks::Route route;
+    route.blocks = (1u << block_house) | (1u << block_main) |
+                   (1u << block_spur(from_spur)) | (1u << block_spur(to_spur));
+    route.turnouts = (1u << 0) | (1u << 1);
+    if (!blocks.reserve(loco_id, route)) {
+        printf("blocks: waiting for spurs %d and %d\n", from_spur, to_spur);
+        while (!blocks.reserve(loco_id, route))
+            loop();
+    }
+}
+
+
+// The turnouts for spur_num, from the layout if there is one, else as
+// desktop_layout.h's line_turnout_0/1 set them: t0 straight for spur 1,
+// else t1 straight for spur 2 and diverging for spur 3.
+static void spur_route(int spur_num, uint8_t &t_mask, uint8_t &straight)
+{
+    if (layout_unc >= 0) {
+        layout.route(layout_unc, layout_spur[spur_num], t_mask, straight);
+    } else if (spur_num == 1) {
+        t_mask = 0x1;
+        straight = 0x1;
+    } else {
+        t_mask = 0x3;
+        straight = (spur_num == 2) ? 0x2 : 0x0;
+    }
+}
+
+
+// Start throwing the turnouts for spur_num.
+static void line_route(int spur_num)
+{
+    uint8_t t_mask, straight;
+    spur_route(spur_num, t_mask, straight);
+    for (int t = 0; t < turnout_max; t++)
+        assert((t_mask & (1u << t)) == 0 || blocks.holds(loco_id, t));
+    turnouts.line(t_mask, straight);
+}
+
+
+// Wait for the turnouts for spur_num, if they're not thrown yet.
+static void wait_route(int spur_num)
+{
+    uint8_t t_mask, straight;
+    spur_route(spur_num, t_mask, straight);
+    if (turnouts.lined(t_mask, straight))
+        return;
+    const uint32_t start_us = time_us_32();
+    while (!turnouts.lined(t_mask, straight))
+        loop();
+    printf("turnouts: waited %lu ms for spur %d\n",
+           (time_us_32() - start_us + 500) / 1000, spur_num);
+}
+
+
+static void layout_init()
+{
+    yard_planner.costs_changed(); // spur lengths
+    layout_unc = -1;
+    if (!layout.load())
+        return;
+    const int unc = layout.node("unc");
+    bool ok = unc >= 0;
+    for (int spur = 1; spur <= spur_cnt && ok; spur++) {
+        char name[Layout::name_max + 1];
+        snprintf(name, sizeof(name), "spur%d", spur);
+        layout_spur[spur] = layout.node(name);
+        ok = layout_spur[spur] >= 0 &&
+             layout.dist_mm(unc, layout_spur[spur]) > 0;
+    }
+    if (!ok) {
+        printf("layout: no route from unc to each spur, not using it\n");
+        return;
+    }
+    layout_unc = unc;
+    printf("layout: %d nodes\n", layout.node_cnt());
+}
+
+
+// Loco at home and stopped.
+static void layout_upload()
+{
+    upload_waiting = false;
+    if (layout.receive())
+        layout_init();
+}
+
+
+// uncoupler to the sensor at the end of a spur
+static int spur_mm(int spur_num)
+{
+    if (layout_unc >= 0)
+        return layout.dist_mm(layout_unc, layout_spur[spur_num]);
+    return unc_to_spur_mm(spur_num);
+}
+
+
+// the farthest a spur goes from the uncoupler
+static int spur_far_mm()
+{
+    int far_mm = 0;
+    for (int spur = 1; spur <= spur_cnt; spur++)
+        if (spur_mm(spur) > far_mm)
+            far_mm = spur_mm(spur);
+    return far_mm;
+}
+
+
+static bool move_until(const Sensor &s, bool level, int speed_mms,
+                       int expect_mm)
+{
+    supervisor.expect(expect_mm);
+    const bool ok = motion.move_until(s, level, speed_mms);
+    supervisor.arrived();
+    return ok;
+}
+
+
+static int approach(const Sensor2 &s, int target_mm, int speed_mms,
+                    int expect_mm, bool stop)
+{
+    supervisor.expect(expect_mm);
+    const int dist_mm = motion.approach(s, target_mm, speed_mms, stop);
+    supervisor.arrived();
+    return dist_mm;
+}
+
+
+// Something within this of a spur's sensor is in that spur.
+static constexpr int spur_near_mm = 300;
+
+// The house sensor sees the far end of the house at ~200 mm.
+static constexpr int house_near_mm = 100;
+
+
+static bool block_sense(int block, intptr_t)
+{
+    if (block == block_house)
+        return sensor_home().dist_mm() < house_near_mm;
+    if (block == block_main)
+        return sensor_unc();
+    return sensor_spur(block - block_main).dist_mm() < spur_near_mm;
+}
+
+
+// Rough time for a move: out to the car and back, out to the spur and
+// back, and uncoupling; only how moves compare matters.
+static uint32_t yard_cost(int from, int to, int cars, intptr_t)
+{
+    const int mm = 2 * spur_mm(from + 1) + 2 * spur_mm(to + 1);
+    return uint32_t(mm * 1000 / medium_mms + 20'000 + cars * 5'000);
+}
+
+
 // Loco should be in house.
 // Car should be on spur, in view of the sensor but not too close to it.
-static void fetch(int spur_num)
+// On return the car is coupled to the loco (it follows as the loco pulls).
+static void fetch(int spur_num, int car)
 {
     printf("fetch %d\n", spur_num);
+    prof.phase("fetch");
 
-    line_turnout_0(spur_num);
+    line_route(spur_num);
 
     func_set(loco->f_cab_light, false);
 
@@ -271,41 +798,88 @@ static void fetch(int spur_num)
     toots_backing_up();
 
     // slow out of house
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(-slow_mms));
-    loop(mm_to_us(150, slow_mms));
-
-    line_turnout_1(spur_num);
-
-    // medium to uncoupler
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(-medium_mms));
-    while (!sensor_unc())
-        loop();
-
-    // Rear of loco has reached uncoupler now; go most of the way.
-    // If the car is 100 mm from the end, and is car_len_mm long, this should
-    // get us to 100 mm from the car.
-    int most_mm = unc_to_spur_mm(spur_num) - 100 - car_len_mm - 100;
-    loop(mm_to_us(most_mm, medium_mms));
+    motion.move(150, -slow_mms);
+
+    wait_route(spur_num);
+
+    // medium to uncoupler; the rear gets there a loco length before the
+    // nose would
+    move_until(sensor_unc(), true, -medium_mms,
+               home_unc_mm - loco_len.len_mm(0, loco->len_mm) - 150);
+    const int unc_odo_mm = motion.odometer_mm();
+
+    // Rear of loco has reached uncoupler now; go most of the way, to
+    // creep_mm from the car. The car's far end is where it was left (or
+    // 100 mm from the end if that's not known).
+    const int end_mm = (car_at_mm[spur_num] > 0) ? car_at_mm[spur_num] : 100;
+    int creep_mm = car_len.margin_mm(car, fetch_creep_mm);
+    if (creep_mm > fetch_creep_mm)
+        creep_mm = fetch_creep_mm;
+    int most_mm = spur_mm(spur_num) - end_mm - car_len.len_mm(car, car_len_mm) -
+                  creep_mm;
+    motion.move(most_mm, -medium_mms);
 
     // creep back until we get the car (until the car moves)
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(-creep_mms));
+    motion.speed(-creep_mms);
     const int dist_mm = sensor_spur(spur_num).dist_mm();
     printf("fetch 1: start at %d mm\n", dist_mm);
+    if (car_at_mm[spur_num] > 0 && dist_mm < car_at_mm[spur_num] - 5) {
+        printf("fetch 1: car already moved (was at %d mm)\n",
+               car_at_mm[spur_num]);
+        failures++;
+    }
     constexpr int move_mm = 15;
-    while (sensor_spur(spur_num).dist_mm() > (dist_mm - move_mm))
-        loop();
+    // the car's near end is the rest of the spur less the car from here
+    const int meet_mm = spur_mm(spur_num) - most_mm -
+                        car_len.len_mm(car, car_len_mm) - dist_mm;
+    approach(sensor_spur(spur_num), dist_mm - move_mm, -creep_mms,
+             meet_mm + move_mm);
+
+    // The loco met the car move_mm ago. From the uncoupler to there, then
+    // the car, then where the car's far end was, is the spur; the car's
+    // length that way includes the gap between it and the loco.
+    if (dist_mm < spur_near_mm && car_at_mm[spur_num] > 0 &&
+        dist_mm >= car_at_mm[spur_num] - 5) {
+        const int met_mm = abs(motion.odometer_mm() - unc_odo_mm) - move_mm;
+        car_len.add(car, spur_mm(spur_num) - met_mm - dist_mm);
+    }
 
-    DccApi::loco_speed_set(loco_id, stop);
+    motion.stop();
+    recouple.attach(sensor_spur(spur_num));
     loop(1'000'000);
 
     printf("fetch 1: moved to %d mm\n", sensor_spur(spur_num).dist_mm());
 
+    // Make sure it coupled: pull away a bit, and the car should come
+    // along. If it doesn't, back up and bump it again. A car left behind
+    // here would fool spot, whose sensor would end up on the loco.
+    int retries = 0;
+    while (!car_follows(follow_mm)) {
+        if (++retries == couple_tries) {
+            failures++;
+            printf("fetch %d: car won't couple; couple it and type 'c'\n",
+                   spur_num);
+            wait_go_on();
+            break;
+        }
+        printf("fetch %d: car didn't couple! retrying...\n", spur_num);
+        const int at_mm = sensor_spur(spur_num).dist_mm();
+        approach(sensor_spur(spur_num), at_mm - move_mm, -creep_mms,
+                 follow_mm + move_mm);
+        motion.stop();
+        recouple.attach(sensor_spur(spur_num));
+        loop(1'000'000);
+    }
+    prof.retries("couple", retries);
+
     if (loco->f_clank >= 0) {
         func_set(loco->f_clank, true);
         loop(1'000'000);
         func_set(loco->f_clank, false);
     }
     loop(1'000'000);
+
+    prof.phase_end();
 }
 
 
@@ -314,61 +888,79 @@ static void fetch(int spur_num)
 // On return:
 // * Loco left of uncoupler, coupler clear of magnet
 // * Car just right of uncoupler with coupler over magnet
-static void uncouple()
+static void uncouple(int car)
 {
     printf("uncouple\n");
+    prof.phase("uncouple");
 
-    if (sensor_unc())
+    const bool nose_seen = !sensor_unc();
+    if (!nose_seen)
         printf("unexpected: uncoupler sensor is active\n");
 
     toots_proceeding();
 
     // forward until nose of loco is at uncoupler (might already be there)
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
-    while (!sensor_unc())
-        loop();
+    move_until(sensor_unc(), true, slow_mms, spur_far_mm());
+    const int nose_mm = motion.odometer_mm();
 
     // creep forward until rear of loco (gap) is at uncoupler
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
-    while (sensor_unc())
-        loop();
-
-    // a bit more to get couplers clear of magnet (~50 mm)
-    int more_mm = 50 - loco->stop_mm(creep_mms);
-    if (more_mm > 0)
-        loop(mm_to_us(more_mm, creep_mms));
-    DccApi::loco_speed_set(loco_id, stop);
+    move_until(sensor_unc(), false, creep_mms,
+               loco_len.len_mm(0, loco->len_mm));
+    if (nose_seen)
+        loco_len.add(0, motion.odometer_mm() - nose_mm);
+
+    // a retry goes back to the way that's always worked
+    const int a = unc_learn.choose(loco->sn, car);
+    const UncoupleLearn::Arm *arm = &UncoupleLearn::arm(a);
+    const uint32_t start_us = time_us_32();
+
+    // a bit more to get couplers clear of magnet, and let the train settle
+    // (not part of the arm: it's the same whatever the dwell)
+    motion.move(arm->clear_mm, creep_mms, true);
     loop(1'000'000);
 
     // couplers should be clear of magnet now
 
+    int retries = -1;
+    bool failed;
     do {
+        retries++;
 
-        // creep back until couplers are over magnet
-        DccApi::loco_speed_set(loco_id, loco->speed_dcc(-creep_mms));
-        while (sensor_unc())
-            loop();
-        DccApi::loco_speed_set(loco_id, stop);
-        loop(500'000);
+        // creep back until couplers are over magnet (from clear of it, or
+        // from half a car on if it didn't uncouple)
+        move_until(sensor_unc(), false, -creep_mms,
+                   arm->clear_mm + car_len.len_mm(car, car_len_mm) / 2);
+        const int edge_mm = motion.odometer_mm();
+        motion.stop();
+        loop(arm->dwell_ms * 1'000);
+        const int offset_mm = edge_mm - motion.odometer_mm();
 
         // couplers should be over magnet now
 
         // pull forward to uncouple (should leave car behind)
-        DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
-        loop(mm_to_us(car_len_mm / 2, creep_mms));
-        DccApi::loco_speed_set(loco_id, stop);
+        motion.move(car_len.len_mm(car, car_len_mm) / 2, creep_mms);
+        motion.stop();
         loop(500'000);
 
         // retry if necessary
-        if (sensor_unc())
+        failed = sensor_unc();
+        unc_learn.attempt(loco->sn, car, offset_mm, !failed);
+        if (failed) {
             printf("uncouple failed! retrying...\n");
+            arm = &UncoupleLearn::arm(0);
+        }
+
+    } while (failed);
 
-    } while (sensor_unc());
+    unc_learn.done(loco->sn, car, a, time_us_32() - start_us, retries + 1);
 
     if (sensor_unc())
         printf("unexpected: uncoupler sensor is active\n");
 
     printf("uncouple done\n");
+
+    prof.retries("uncouple", retries);
+    prof.phase_end();
 }
 
 
@@ -380,28 +972,33 @@ static void uncouple()
 // * Loco creeping forward
 // Errors:
 // * Sometimes the cars recouple on the way back (esp. the tank car to
-//   spur 2). If that happens, the 110 mm sensor goes inactive)
+//   spur 2). If that happens, the car moves with the loco as it pulls
+//   away, and recouple sees it within a sample.
 // Return:
 // *  true if the car was left behind
 // *  false if the car is still coupled
-static bool spot(int spur_num)
+static bool spot(int spur_num, int car)
 {
     printf("spot %d\n", spur_num);
+    prof.phase("spot");
 
-    line_turnout_0(spur_num);
+    line_route(spur_num);
 
     if (snd_bell)
         func_set(loco->f_bell, true);
 
     loop(1'000'000);
 
-    // creep back until loco clears uncoupler
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(-creep_mms));
-    loop(mm_to_us(100, creep_mms));
-    while (sensor_unc())
-        loop();
+    wait_route(spur_num);
+
+    // the car's coupler is over the magnet, the loco up to half a car
+    // length away
+    const int start_odo_mm = motion.odometer_mm();
 
-    line_turnout_1(spur_num);
+    // creep back until loco clears uncoupler
+    motion.move(100, -creep_mms);
+    move_until(sensor_unc(), false, -creep_mms,
+               loco_len.len_mm(0, loco->len_mm));
 
     // Spur 2 has an s-turn that can cause a recoupling or even derail, both
     // observed with UP852 and the tank car, but never (yet) with any other
@@ -409,34 +1006,54 @@ static bool spot(int spur_num)
     if (spur_num != 2) {
         // spur 1 or 3, a bit faster most of the way
         // subtract loco and car len, plan to leave it 100 mm from the end,
-        // and we'll start creeping 100 mm before that
-        int slow_mm =
-            unc_to_spur_mm(spur_num) - loco->len_mm - car_len_mm - 100 - 100;
-        DccApi::loco_speed_set(loco_id, loco->speed_dcc(-slow_mms));
-        loop(mm_to_us(slow_mm, slow_mms));
+        // and we'll start creeping creep_mm before that
+        int creep_mm = car_len.margin_mm(car, spot_creep_mm) +
+                       loco_len.margin_mm(0, spot_creep_mm);
+        if (creep_mm > spot_creep_mm)
+            creep_mm = spot_creep_mm;
+        int slow_mm = spur_mm(spur_num) - loco_len.len_mm(0, loco->len_mm) -
+                      car_len.len_mm(car, car_len_mm) - 100 - creep_mm;
+        motion.move(slow_mm, -slow_mms);
     }
 
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(-creep_mms));
-
     // stop when close enough to the end
     constexpr int stop_mm = 75; // stop this far from the sensor
-    int detected_mm = 0;        // where sensor first detected car
-    int last_mm = 0;            // last reading before stopping
-    do {
-        last_mm = sensor_spur(spur_num).dist_mm();
-        if (detected_mm == 0 && last_mm <= 500)
-            detected_mm = last_mm;
-        loop();
-    } while (last_mm > stop_mm);
-
-    DccApi::loco_speed_set(loco_id, stop);
+    // where sensor first detected car
+    // (at most, the far end of the car is this far from the sensor)
+    const int far_mm = spur_mm(spur_num) -
+                       car_len.len_mm(car, car_len_mm) / 2 -
+                       abs(motion.odometer_mm() - start_odo_mm);
+    const int detected_mm =
+        approach(sensor_spur(spur_num), 500, -creep_mms, far_mm - 500);
+    // last reading before stopping
+    const int last_mm = approach(sensor_spur(spur_num), stop_mm, -creep_mms,
+                                 detected_mm - stop_mm, true);
+
+    // baseline for the recouple check while standing
+    recouple.attach(sensor_spur(spur_num));
     loop(1'000'000);
 
     if (snd_bell)
         func_set(loco->f_bell, false);
 
+    car_at_mm[spur_num] = sensor_spur(spur_num).dist_mm();
     printf("spot %d: detected at %d mm, stopped at %d mm, left at %d mm\n",
-           spur_num, detected_mm, last_mm, sensor_spur(spur_num).dist_mm());
+           spur_num, detected_mm, last_mm, car_at_mm[spur_num]);
+
+    // creeping should start well before the stop point
+    if (detected_mm < stop_mm + 25) {
+        printf("spot %d: car seen too late\n", spur_num);
+        failures++;
+    }
+
+    // Make sure the car is left behind: pull away a bit; if it comes
+    // along, stop there and say so.
+    if (car_follows(follow_mm)) {
+        printf("spot %d: car came along (%d mm)\n", spur_num,
+               recouple.car_mm());
+        prof.phase_end();
+        return false;
+    }
 
     if (loco->f_clank >= 0) {
         func_set(loco->f_clank, true);
@@ -447,13 +1064,25 @@ static bool spot(int spur_num)
 
     toots_proceeding();
 
-    // Make sure the car is left behind; creep ahead a bit and make sure
-    // the car does not move.
-    int dist_mm = sensor_spur(spur_num).dist_mm();
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
-    loop(mm_to_us(30, creep_mms));
-    // If the car did not move too much, it is not coupled; return true.
-    return (sensor_spur(spur_num).dist_mm() - dist_mm) < 15;
+    motion.speed(creep_mms);
+    prof.phase_end();
+    return true;
+}
+
+
+// Pull away from the car on the spur (recouple attached, loco stopped long
+// enough for a baseline) up to pull_mm, watching the car every sample, and
+// stop. Return whether the car came along.
+static bool car_follows(int pull_mm)
+{
+    recouple.watch();
+    const int from_mm = motion.odometer_mm();
+    motion.speed(creep_mms);
+    while (!recouple.fired() && motion.odometer_mm() - from_mm < pull_mm)
+        loop(0);
+    recouple.detach();
+    motion.stop();
+    return recouple.fired();
 }
 
 
@@ -461,33 +1090,40 @@ static bool spot(int spur_num)
 // Forward to uncoupler, delay, slow down, to the house, stop.
 // The house sensor usually sees the far end of the house at ~200 mm, so
 // ignore readings until we get close.
-static void home()
+static void home(int spur_num, int car)
 {
     printf("home\n");
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(zippy_mms));
-    while (!sensor_unc())
-        loop();
+    prof.phase("home");
+    // the car was left car_at_mm from the end, with the loco against it
+    const int nose_mm = spur_mm(spur_num) - car_at_mm[spur_num] -
+                        car_len.len_mm(car, car_len_mm) -
+                        loco_len.len_mm(0, loco->len_mm);
+    move_until(sensor_unc(), true, zippy_mms, nose_mm);
+    const int unc_odo_mm = motion.odometer_mm();
 
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(fast_mms));
-    loop(mm_to_us(75, fast_mms));
+    motion.move(75, fast_mms);
 
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(medium_mms));
-    loop(mm_to_us(100, medium_mms));
+    motion.move(100, medium_mms);
 
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
     constexpr int creep_at_mm = 150;
-    while (sensor_home().dist_mm() > creep_at_mm)
-        loop();
-
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
     constexpr int stop_at_mm = 35;
-    while (sensor_home().dist_mm() > stop_at_mm)
-        loop();
+    approach(sensor_home(), creep_at_mm, slow_mms,
+             home_unc_mm - 175 - (creep_at_mm - stop_at_mm));
+
+    motion.speed(creep_mms);
+    if (sensor_home().dist_mm() <= stop_at_mm) {
+        printf("home: overran the creep\n");
+        failures++;
+    }
+    approach(sensor_home(), stop_at_mm, creep_mms, creep_at_mm - stop_at_mm,
+             true);
 
-    DccApi::loco_speed_set(loco_id, stop);
     loop(1'000'000);
+    home_unc_mm = abs(motion.odometer_mm() - unc_odo_mm);
 
     func_set(loco->f_cab_light, true);
+
+    prof.phase_end();
 }
 
 
@@ -495,6 +1131,11 @@ static void init()
 {
     Status s;
 
+    if (trace_on)
+        trace.init();
+
+    layout_init();
+
     for (int i = 0; i < sensor_max; i++)
         sensor[i].init();
 
@@ -508,9 +1149,11 @@ static void init()
 
     printf("reset loco ... ");
     while ((s = DccApi::cv_val_set(8, 8)) != Status::Ok) {
+        trace.cv_set(8, 8, int(s));
         printf("%s.", DccApi::status(s));
         loop(500'000);
     }
+    trace.cv_set(8, 8, int(s));
     printf("ok\n");
 
     loop(1'000'000);
@@ -533,12 +1176,31 @@ static void init()
     }
     printf("%lu\n", sn);
 
-    loco = Loco::find_loco(sn);
+    // read_sn's reads are inside the library; record what they came to
+    for (int cv_num = 268; cv_num >= 265; cv_num--)
+        trace.cv_get(cv_num, (sn >> (8 * (cv_num - 265))) & 0xff,
+                     int(Status::Ok));
+
+    assert(roster_index.ok());
+    loco = roster_index.find(sn);
+    if (loco == nullptr)
+        loco = loco_alias(sn);
     assert(loco != nullptr);
     printf("loco: %s\n", loco->name);
 
-    ops_cv_val_set(3, 10);
+    params_load();
+
+    ops_cv_val_set(3, 0);
     ops_cv_val_set(4, 0);
+
+    speed_table = SpeedTable(loco);
+    speed_table.print(loco);
+
+    motion.init(loco_id, loco);
+    motion.speed_table(&speed_table);
+    motion.speed_callback(motion_speed, 0);
+    motion.send_callback(motion_send, 0);
+    motion.ramp(accel_mms2, decel_mms2, jerk_mms3);
     ops_cv_val_set(63, loco->v_master);
     ops_cv_val_set(29, cv_bits);
     ops_cv_bit_set(29, 2, 0); // disable DC
@@ -566,6 +1228,7 @@ static void ops_cv_val_set(int cv_num, int cv_val)
         printf("cv%d = %d ... ", cv_num, cv_val);
         while (true) {
             Status s = DccApi::loco_cv_val_set(loco_id, cv_num, cv_val);
+            trace.cv_set(cv_num, cv_val, int(s));
             if (s == Status::Ok)
                 break;
             printf("%s ... ", DccApi::status(s));
@@ -577,6 +1240,7 @@ static void ops_cv_val_set(int cv_num, int cv_val)
         int val;
         while (true) {
             Status s = DccApi::loco_cv_val_get(loco_id, cv_num, val);
+            trace.cv_get(cv_num, val, int(s));
             if (s == Status::Ok)
                 break;
             printf("%s ... ", DccApi::status(s));
@@ -599,6 +1263,7 @@ static void ops_cv_bit_set(int cv_num, int b_num, int b_val)
         printf("cv%d[%d] = %d ... ", cv_num, b_num, b_val);
         while (true) {
             Status s = DccApi::loco_cv_bit_set(loco_id, cv_num, b_num, b_val);
+            trace.cv_bit(cv_num, b_num, b_val, int(s));
             if (s == Status::Ok)
                 break;
             printf("%s ... ", DccApi::status(s));
@@ -610,6 +1275,7 @@ static void ops_cv_bit_set(int cv_num, int b_num, int b_val)
         while (true) {
             int cv_val;
             Status s = DccApi::loco_cv_val_get(loco_id, cv_num, cv_val);
+            trace.cv_get(cv_num, cv_val, int(s));
             if (s == Status::Ok) {
                 b_val = (cv_val >> b_num) & 1;
                 break;
@@ -620,3 +1286,85 @@ static void ops_cv_bit_set(int cv_num, int b_num, int b_val)
         printf("%d\n", b_val);
     }
 } // ops_cv_bit_set
+
+
+// Speeds have to stay in order, or the phases stop making sense.
+static bool tune_ok(intptr_t)
+{
+    return creep_mms < slow_mms && slow_mms < medium_mms &&
+           medium_mms < fast_mms && fast_mms < zippy_mms;
+}
+
+
+static void params_load()
+{
+    int16_t val[tune_param_cnt];
+    if (ParamStore::load(loco->sn, tune_version, val, tune_param_cnt)) {
+        int def[tune_param_cnt];
+        for (int i = 0; i < tune_param_cnt; i++) {
+            def[i] = *tune_param[i].val;
+            *tune_param[i].val = val[i];
+        }
+        if (tune_ok(0)) {
+            printf("params: loaded for %s\n", loco->name);
+        } else {
+            for (int i = 0; i < tune_param_cnt; i++)
+                *tune_param[i].val = def[i];
+            printf("params: saved set is bad, using defaults\n");
+        }
+    } else {
+        printf("params: defaults\n");
+    }
+    for (int i = 0; i < tune_param_cnt; i++)
+        printf("  %s = %d\n", tune_param[i].name, *tune_param[i].val);
+}
+
+
+// A decoder that's not in the roster (new, or replacing one that is) runs
+// with the calibration of a roster loco the user names, remembered in
+// RosterAlias so it's found next time.
+static const Loco *loco_alias(uint32_t sn)
+{
+    const Loco *l = nullptr;
+    while (l == nullptr) {
+        printf("loco: %lu not in roster, run it as: ", sn);
+        char name[16];
+        int len = 0;
+        while (true) {
+            const int c = stdio_getchar_timeout_us(100'000);
+            if (c < 0)
+                continue;
+            if (c == '\r' || c == '\n')
+                break;
+            if (len < int(sizeof(name)) - 1) {
+                name[len++] = char(c);
+                putchar(c);
+            }
+        }
+        name[len] = '\0';
+        printf("\n");
+        l = roster_index.find(name);
+        if (l == nullptr)
+            printf("loco: no %s in roster\n", name);
+    }
+    printf("alias: %lu to %s ... ", sn, l->name);
+    if (RosterAlias::add(sn, l->sn))
+        printf("ok\n");
+    else
+        printf("failed\n");
+    return l;
+}
+
+
+// the tuner's best setting
+static void params_save()
+{
+    int16_t val[tune_param_cnt];
+    for (int i = 0; i < tune_param_cnt; i++)
+        val[i] = tuner.best(i);
+    printf("params: saving for %s ... ", loco->name);
+    if (ParamStore::save(loco->sn, tune_version, val, tune_param_cnt))
+        printf("ok\n");
+    else
+        printf("failed\n");
+}
@@ -0,0 +1,201 @@
+
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/pio.h"
+#include "pico/stdio.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+// misc
+#include "sys_led.h"
+// railroad
+#include "config.h"
+// track
+#include "dcc_adc_capture.h"
+#include "dcc_fast_trip.h"
+#include "dcc_funcs.h"
+#include "dcc_tx.h"
+#include "dcc_tx_pkt.h"
+#include "railcom_rx.h"
+
+// Runs one loco straight from DccTx and RailComRx, with no DccApi under
+// them, to try the PIO bitstream and the RailCom receiver on the track.
+// The track current is captured with the packets marked in it, and the
+// fast trip cuts the power on a short.
+//
+// Keys (usb):
+//   + -   speed up or down a notch
+//   0     stop
+//   r     reverse
+//   e     emergency stop
+//   t     track power on or off
+//   s     RailCom stats
+//   f     lights (F0)
+//   b     bell (F1)
+//   h     horn (F2)
+//   a     arm the capture trigger (rising edge at capture_level)
+//   c     export a capture window (the triggered one if armed)
+//   l     trip log
+//   x     export the last trip's trace
+//   z     clear a latched trip
+
+static constexpr int loco_address = 3;
+
+static DccTx tx(pio0, dcc_sig_gpio, dcc_pwr_gpio);
+
+static RailComRx railcom(dcc_rcom_uart, dcc_rcom_gpio);
+
+static DccAdcCapture capture(dcc_adc_gpio, 250'000);
+
+static constexpr uint16_t capture_level = 2048; // raw adc counts
+
+static constexpr uint16_t trip_level = 3000;   // raw adc counts
+static constexpr uint16_t inrush_level = 3800; // during blanking
+static constexpr uint32_t inrush_us = 20'000;
+
+static DccFastTrip trip(capture, dcc_pwr_gpio, trip_level);
+
+// refresh slots
+static constexpr int slot_speed = 0;
+static constexpr int slot_funcs = 1;
+
+// the usual sound decoder's; other decoders may differ
+static constexpr int f_lights = 0;
+static constexpr int f_bell = 1;
+static constexpr int f_horn = 2;
+
+static DccFuncs funcs(loco_address);
+
+static constexpr int speed_notch = 8; // of 126
+static int speed = 0;                 // -126..126
+
+static void speed_set(int s);
+static void func_toggle(int f, const char *name);
+static void tx_end(const DccTxPkt &pkt, intptr_t arg);
+
+
+int main()
+{
+    stdio_init_all();
+    SysLed::init();
+
+    SysLed::pattern(50, 950);
+
+#if 1
+    while (!stdio_usb_connected()) {
+        SysLed::loop();
+        tight_loop_contents();
+    }
+    sleep_ms(10); // small delay needed or we lose the first prints
+#endif
+
+    SysLed::off();
+
+    printf("\n");
+    printf("dcc_tx_test\n");
+    printf("\n");
+
+    railcom.init();
+    trip.blanking(inrush_us, inrush_level);
+    trip.retry(5, 100'000, 2'000'000);
+    trip.init();
+    capture.start();
+    tx.init();
+    tx.end_callback(tx_end, 0);
+
+    speed_set(0);
+
+    tx.power(true);
+    trip.power_on();
+    printf("loco %d, track on\n", loco_address);
+
+    while (true) {
+
+        SysLed::loop();
+        railcom.loop();
+        capture.loop();
+        tx.funcs(funcs, slot_funcs);
+
+        const int c = stdio_getchar_timeout_us(0);
+        if (c == '+') {
+            speed_set(speed + ((speed < 0) ? -speed_notch : speed_notch));
+        } else if (c == '-') {
+            if (speed > speed_notch)
+                speed_set(speed - speed_notch);
+            else if (speed < -speed_notch)
+                speed_set(speed + speed_notch);
+            else
+                speed_set(0);
+        } else if (c == '0') {
+            speed_set(0);
+        } else if (c == 'r') {
+            speed_set(-speed);
+        } else if (c == 'e') {
+            tx.estop();
+            speed = 0;
+            printf("estop\n");
+        } else if (c == 't') {
+            tx.power(!tx.power());
+            if (tx.power())
+                trip.power_on();
+            printf("track %s\n", tx.power() ? "on" : "off");
+        } else if (c == 's') {
+            const RailComRx::Stats *st = railcom.stats(loco_address);
+            if (st != nullptr && st->speed_kmh >= 0)
+                printf("speed %d, railcom %d km/h, quality %d%%\n", speed,
+                       st->speed_kmh, railcom.quality(loco_address));
+            else
+                printf("speed %d, no railcom speed\n", speed);
+            railcom.print_stats();
+        } else if (c == 'f') {
+            func_toggle(f_lights, "lights");
+        } else if (c == 'b') {
+            func_toggle(f_bell, "bell");
+        } else if (c == 'h') {
+            func_toggle(f_horn, "horn");
+        } else if (c == 'a') {
+            capture.trigger(DccAdcCapture::Trigger::Rising, capture_level);
+            printf("capture armed\n");
+        } else if (c == 'c') {
+            capture.export_window();
+        } else if (c == 'l') {
+            trip.print_log();
+        } else if (c == 'x') {
+            trip.export_trace();
+        } else if (c == 'z') {
+            trip.reset();
+        }
+    }
+
+    return 0;
+
+} // main()
+
+
+static void speed_set(int s)
+{
+    if (s > 126)
+        s = 126;
+    else if (s < -126)
+        s = -126;
+    speed = s;
+    tx.refresh(slot_speed, DccTxPkt::speed128(loco_address, speed));
+    printf("speed %d\n", speed);
+}
+
+
+// DccTx::funcs() in the loop sends it
+static void func_toggle(int f, const char *name)
+{
+    funcs.set(f, !funcs.get(f));
+    printf("%s %s\n", name, funcs.get(f) ? "on" : "off");
+}
+
+
+// DccTx calls this (interrupt context) as each packet's end bit starts.
+// RailCom lines its cutout up on it, and the capture marks it.
+static void tx_end(const DccTxPkt &pkt, intptr_t)
+{
+    RailComRx::end_callback(pkt, intptr_t(&railcom));
+    capture.packet();
+}
@@ -0,0 +1,674 @@
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+// railroad
+#include "locos.h"
+// track
+#include "consist.h"
+#include "dcc_funcs.h"
+#include "dcc_tx_pkt.h"
+#include "dcc_tx_queue.h"
+#include "dcc_tx_sched.h"
+#include "railcom_code.h"
+
+// Host benchmarks and fuzz checks for the packet encoder, the transmit
+// queue and scheduler, function groups (and their refresh), and the
+// RailCom decoder, and a check of Consist's speed matching against the
+// simulator's roster.
+//
+// The checks run first; any failure is printed and the exit status is 1, so
+// a regression fails a CI step the same as a build error. Then each
+// benchmark runs for a fixed number of iterations and prints the rate.
+//
+// Usage: dcc_bench [iterations]
+
+static constexpr int iter_dflt = 2'000'000;
+
+static int fails = 0;
+
+#define CHECK(cond, ...)                                                       \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                        \
+            printf(__VA_ARGS__);                                               \
+            printf("\n");                                                      \
+            fails++;                                                           \
+        }                                                                      \
+    } while (0)
+
+// keeps results alive so the optimizer can't drop the work
+static volatile uint32_t sink = 0;
+
+static std::mt19937 rng(12345);
+
+
+static int rand_int(int lo, int hi)
+{
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+
+static int rand_address()
+{
+    return (rand_int(0, 1) == 0) ? rand_int(1, 127) : rand_int(128, 10239);
+}
+
+
+// random message without checksum, 1..msg_max-1 bytes
+static int rand_msg(uint8_t *msg)
+{
+    int len = rand_int(1, DccTxPkt::msg_max - 1);
+    for (int i = 0; i < len; i++)
+        msg[i] = rand_int(0, 255);
+    return len;
+}
+
+
+// channel 2 with a dyn speed datagram (3 bytes), a pom datagram (2 bytes)
+// and an ack
+static void put_ch2(uint8_t *code, int speed, int pom)
+{
+    const uint32_t dyn = (RailComCode::id_dyn << 14) | (speed << 6) |
+                         RailComCode::dyn_speed_1;
+    code[0] = RailComCode::encode(dyn >> 12);
+    code[1] = RailComCode::encode(dyn >> 6);
+    code[2] = RailComCode::encode(dyn);
+    const uint32_t pom_dg = (RailComCode::id_pom << 8) | pom;
+    code[3] = RailComCode::encode(pom_dg >> 6);
+    code[4] = RailComCode::encode(pom_dg);
+    code[5] = RailComCode::code_ack;
+}
+
+
+template <typename F>
+static void bench(const char *name, const char *unit, int iters, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++)
+        func(i);
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+    printf("%-24s %12.0f %s/s %8.2f ns\n", name, iters * 1e9 / ns, unit,
+           ns / iters);
+}
+
+
+///// Checks
+
+
+static void check_pkt_fixed()
+{
+    constexpr DccTxPkt idle = DccTxPkt::idle();
+    static_assert(idle.len() == 3);
+    static_assert(idle.word_cnt() == 3);
+    static_assert(idle.address() == -1);
+
+    constexpr DccTxPkt estop = DccTxPkt::estop();
+    static_assert(estop.address() == 0);
+
+    constexpr DccTxPkt spd = DccTxPkt::speed128(1234, -50);
+    static_assert(spd.address() == 1234);
+    static_assert(spd.len() == 5);
+
+    uint8_t msg[DccTxPkt::msg_max];
+    bool cutout = false;
+    int len = DccTxPkt::decode(spd.words(), spd.word_cnt(), msg, cutout);
+    CHECK(len == 5, "speed128 decode len %d", len);
+    CHECK(cutout, "speed128 decode cutout");
+    CHECK(len == 5 && memcmp(msg, spd.msg(), 5) == 0, "speed128 decode msg");
+    CHECK(msg[3] == 51, "speed128 step %d", msg[3]);
+}
+
+
+// encode random messages and decode them back
+static void check_pkt_round_trip(int iters)
+{
+    for (int i = 0; i < iters; i++) {
+        uint8_t msg[DccTxPkt::msg_max];
+        int len = rand_msg(msg);
+        bool cutout = rand_int(0, 1);
+        int preamble = rand_int(14, DccTxPkt::preamble_svc);
+
+        DccTxPkt pkt(msg, len, cutout, preamble);
+
+        uint8_t out[DccTxPkt::msg_max];
+        bool out_cutout = !cutout;
+        int out_len = DccTxPkt::decode(pkt.words(), pkt.word_cnt(), out,
+                                       out_cutout);
+
+        CHECK(out_len == len + 1, "round trip len %d != %d", out_len,
+              len + 1);
+        CHECK(out_len == pkt.len() && memcmp(out, pkt.msg(), out_len) == 0,
+              "round trip msg");
+        CHECK(memcmp(out, msg, len) == 0, "round trip msg bytes");
+        CHECK(out_cutout == cutout, "round trip cutout");
+        if (fails > 0)
+            return;
+    }
+}
+
+
+// Flip one data bit anywhere in the message; the checksum has to catch it.
+static void check_pkt_bit_error(int iters)
+{
+    for (int i = 0; i < iters; i++) {
+        uint8_t msg[DccTxPkt::msg_max];
+        int len = rand_msg(msg);
+        int preamble = rand_int(14, DccTxPkt::preamble_svc);
+        DccTxPkt pkt(msg, len, true, preamble);
+
+        uint32_t words[DccTxPkt::word_max];
+        memcpy(words, pkt.words(), sizeof(words));
+
+        // symbol index of a data bit: preamble, then 9 symbols per byte
+        int byte = rand_int(0, pkt.len() - 1);
+        int sym = preamble + byte * 9 + 1 + rand_int(0, 7);
+        int bit = sym * 2; // low bit of the symbol: 0 <-> 1
+        words[bit / 32] ^= 1u << (bit % 32);
+
+        uint8_t out[DccTxPkt::msg_max];
+        bool cutout;
+        int out_len = DccTxPkt::decode(words, pkt.word_cnt(), out, cutout);
+        CHECK(out_len == -1, "bit error not caught (byte %d sym %d)", byte,
+              sym);
+        if (fails > 0)
+            return;
+    }
+}
+
+
+// Random words must never crash the decoder or overrun msg.
+static void check_pkt_garbage(int iters)
+{
+    for (int i = 0; i < iters; i++) {
+        uint32_t words[DccTxPkt::word_max];
+        for (int w = 0; w < DccTxPkt::word_max; w++)
+            words[w] = rng();
+        // mostly-valid preamble so decoding gets past it sometimes
+        if (rand_int(0, 1) == 0)
+            words[0] = 0x55555555;
+
+        uint8_t out[DccTxPkt::msg_max + 1];
+        out[DccTxPkt::msg_max] = 0xa5;
+        bool cutout;
+        int len = DccTxPkt::decode(words, DccTxPkt::word_max, out, cutout);
+        CHECK(len == -1 || (len >= 2 && len <= DccTxPkt::msg_max),
+              "garbage decode len %d", len);
+        CHECK(out[DccTxPkt::msg_max] == 0xa5, "garbage decode overrun");
+        if (fails > 0)
+            return;
+    }
+}
+
+
+static void check_queue()
+{
+    DccTxQueue<int, 8> q;
+    int v;
+
+    CHECK(q.empty() && !q.get(v), "queue empty");
+
+    // wrap several times
+    int put = 0;
+    int got = 0;
+    for (int round = 0; round < 5; round++) {
+        while (q.put(put))
+            put++;
+        CHECK(q.count() == 8, "queue full count %d", q.count());
+        for (int i = 0; i < 5; i++) {
+            CHECK(q.get(v) && v == got, "queue order %d != %d", v, got);
+            got++;
+        }
+    }
+
+    q.flush();
+    CHECK(q.empty() && q.count() == 0, "queue flush");
+}
+
+
+// After an estop, nothing that follows may start a loco again: the
+// refresh slots' speed packets are stopped, with their addresses and
+// directions kept, and other packets left alone.
+static void check_estop(int iters)
+{
+    for (int n = 0; n < iters; n++) {
+        DccTxSched sched;
+        int address[DccTxSched::refresh_max];
+        bool speed[DccTxSched::refresh_max] = {};
+        for (int s = 0; s < DccTxSched::refresh_max; s++) {
+            address[s] = rand_address();
+            const int k = rand_int(0, 3);
+            speed[s] = k >= 2;
+            if (k == 0)
+                continue;
+            if (k == 1) {
+                sched.refresh(s, DccTxPkt::func_group(address[s],
+                                                      rand_int(0, 9),
+                                                      rand_int(0, 255)));
+            } else if (k == 2) {
+                sched.refresh(s, DccTxPkt::speed128(address[s],
+                                                    rand_int(-126, 126)));
+            } else {
+                // 28 steps, 01DCSSSS
+                uint8_t msg[DccTxPkt::msg_max - 1] = {};
+                int len = DccTxPkt::put_address(msg, address[s]);
+                msg[len++] = 0x40 | rand_int(0, 0x3f);
+                sched.refresh(s, DccTxPkt(msg, len));
+            }
+        }
+        DccTxPkt was[DccTxSched::refresh_max];
+        for (int s = 0; s < DccTxSched::refresh_max; s++)
+            was[s] = sched.refresh_pkt(s);
+        for (int q = rand_int(0, 8); q > 0; q--)
+            sched.put(DccTxPkt::speed128(rand_address(), rand_int(1, 126)));
+
+        sched.estop();
+
+        DccTxPkt pkt;
+        for (int i = 0; i < DccTxSched::estop_cnt; i++) {
+            sched.next(pkt);
+            CHECK(pkt.len() == 3 && memcmp(pkt.msg(), "\x00\x51\x51", 3) == 0,
+                  "estop %d not sent", i);
+        }
+        for (int i = 0; i < 3 * DccTxSched::refresh_max; i++) {
+            sched.next(pkt);
+            CHECK(pkt.speed() == 0, "estop: speed %d to %d after it",
+                  pkt.speed(), pkt.address());
+        }
+        for (int s = 0; s < DccTxSched::refresh_max; s++) {
+            if (!sched.refresh_used(s))
+                continue;
+            const DccTxPkt &now = sched.refresh_pkt(s);
+            CHECK(now.address() == was[s].address(), "estop: slot %d address",
+                  s);
+            CHECK(now.len() == was[s].len(), "estop: slot %d len", s);
+            if (!speed[s])
+                CHECK(memcmp(now.msg(), was[s].msg(), now.len()) == 0,
+                      "estop: slot %d changed", s);
+            // direction bit: 128 steps in the last data byte, 28 in the
+            // instruction
+            const int d = now.len() - 2;
+            if (now.msg()[d - 1] == 0x3f)
+                CHECK((now.msg()[d] & 0x80) == (was[s].msg()[d] & 0x80),
+                      "estop: slot %d direction", s);
+            else if ((now.msg()[d] & 0xc0) == 0x40)
+                CHECK((now.msg()[d] & 0x20) == (was[s].msg()[d] & 0x20),
+                      "estop: slot %d direction", s);
+        }
+
+        // the app can set a speed again
+        sched.refresh(0, DccTxPkt::speed128(3, 50));
+        bool moving = false;
+        for (int i = 0; i < DccTxSched::refresh_max && !moving; i++) {
+            sched.next(pkt);
+            moving = pkt.speed() == 50;
+        }
+        CHECK(moving, "estop: no speed after a new refresh");
+    }
+}
+
+
+// Apply a function group packet the way a decoder would.
+static bool func_apply(const DccTxPkt &pkt, int address, bool *f)
+{
+    uint8_t msg[DccTxPkt::msg_max];
+    bool cutout = false;
+    int len = DccTxPkt::decode(pkt.words(), pkt.word_cnt(), msg, cutout);
+    if (len < 3 || pkt.address() != address)
+        return false;
+    const int a = (address <= 127) ? 1 : 2;
+    const uint8_t i = msg[a];
+    int first = -1;
+    int bits = 0;
+    int cnt = 0;
+    if ((i & 0xe0) == 0x80) {
+        f[0] = (i >> 4) & 1;
+        first = 1;
+        bits = i & 0x0f;
+        cnt = 4;
+    } else if ((i & 0xf0) == 0xb0) {
+        first = 5;
+        bits = i & 0x0f;
+        cnt = 4;
+    } else if ((i & 0xf0) == 0xa0) {
+        first = 9;
+        bits = i & 0x0f;
+        cnt = 4;
+    } else if (i == 0xde || i == 0xdf) {
+        first = 13 + 8 * (i - 0xde);
+        bits = msg[a + 1];
+        cnt = 8;
+    } else if (i >= 0xd8 && i <= 0xdc) {
+        first = 29 + 8 * (i - 0xd8);
+        bits = msg[a + 1];
+        cnt = 8;
+    } else {
+        return false;
+    }
+    for (int b = 0; b < cnt; b++)
+        f[first + b] = (bits >> b) & 1;
+    return true;
+}
+
+
+// random function changes, sent as dirty groups, end up in the decoder
+static void check_funcs(int iters)
+{
+    std::mt19937 rng(4);
+
+    for (int address : {3, 1234}) {
+        DccFuncs funcs(address);
+        bool dec[DccTxPkt::func_max] = {};
+        int pkts = 0;
+
+        for (int i = 0; i < iters; i++) {
+            const int f = rng() % DccTxPkt::func_max;
+            const bool on = rng() & 1;
+            const bool was = funcs.get(f);
+            funcs.set(f, on);
+            CHECK(funcs.get(f) == on, "funcs get f%d", f);
+            if (was == on) {
+                CHECK(funcs.dirty() < 0, "funcs f%d dirty, not changed", f);
+                continue;
+            }
+            const int g = funcs.dirty();
+            CHECK(g == DccTxPkt::func_group_of(f), "funcs f%d group %d", f, g);
+            if (g < 0)
+                continue;
+            CHECK(f >= DccTxPkt::func_group_first(g) &&
+                      f < DccTxPkt::func_group_first(g) +
+                              DccTxPkt::func_group_size(g),
+                  "funcs f%d group %d range", f, g);
+            CHECK(func_apply(funcs.pkt(g), address, dec), "funcs pkt f%d", f);
+            funcs.clean(g);
+            pkts++;
+            for (int n = 0; n < DccTxPkt::func_max; n++)
+                CHECK(dec[n] == funcs.get(n), "funcs f%d decoder", n);
+        }
+        CHECK(pkts > 0, "funcs no packets");
+
+        // the rotation covers every group used, and no others
+        uint16_t seen = 0;
+        for (int i = 0; i < 2 * DccFuncs::group_cnt; i++)
+            seen |= 1 << funcs.rotate();
+        CHECK(seen == funcs.used(), "funcs rotation %04x != %04x",
+              unsigned(seen), unsigned(funcs.used()));
+    }
+
+    DccFuncs idle(3);
+    CHECK(idle.rotate() == 0 && idle.rotate() == 0, "funcs rotation F0-F4");
+}
+
+
+// A change stays in the decoder while the refresh slot goes round, even
+// when the slot has the group that changed.
+static void check_funcs_refresh(int iters)
+{
+    std::mt19937 rng(5);
+    constexpr int address = 3;
+    constexpr int slot = 0;
+    constexpr int repeat = 2;
+
+    DccTxSched sched;
+    DccFuncs funcs(address);
+    bool dec[DccTxPkt::func_max] = {};
+
+    for (int i = 0; i < iters; i++) {
+        // F0-F20, four groups, so the slot often has the changed one
+        const int f = rng() % 21;
+        funcs.set(f, !funcs.get(f));
+        for (int n = 0; n < 4 * repeat; n++) {
+            sched.funcs(funcs, slot, repeat); // the app's loop
+            DccTxPkt pkt;
+            sched.next(pkt);
+            func_apply(pkt, address, dec);
+            for (int m = 0; m < DccTxPkt::func_max; m++)
+                CHECK(dec[m] == funcs.get(m), "funcs refresh f%d after f%d",
+                      m, f);
+            if (fails > 0)
+                return;
+        }
+    }
+}
+
+
+static void check_railcom()
+{
+    int data = 0;
+    int special = 0;
+
+    for (int code = 0; code < 256; code++) {
+        int val = RailComCode::decode(code);
+        int ones = __builtin_popcount(code);
+        if (val >= 0) {
+            data++;
+            CHECK(ones == 4, "railcom 0x%02x has %d ones", code, ones);
+            CHECK(RailComCode::encode(val) == code, "railcom 0x%02x -> %d",
+                  code, val);
+        } else if (val != RailComCode::invalid) {
+            special++;
+            CHECK(ones == 4, "railcom 0x%02x has %d ones", code, ones);
+        }
+    }
+
+    CHECK(data == 64, "railcom data codes %d", data);
+    CHECK(special == 4, "railcom special codes %d", special);
+    CHECK(RailComCode::decode(RailComCode::code_ack) == RailComCode::ack,
+          "railcom ack");
+    CHECK(RailComCode::decode(RailComCode::code_nack) == RailComCode::nack,
+          "railcom nack");
+    CHECK(RailComCode::decode(RailComCode::code_busy) == RailComCode::busy,
+          "railcom busy");
+}
+
+
+static void check_railcom_ch2(int iters)
+{
+    for (int i = 0; i < iters; i++) {
+        const int speed = rand_int(0, 255);
+        const int pom = rand_int(0, 255);
+        uint8_t code[RailComCode::ch2_bytes];
+        put_ch2(code, speed, pom);
+
+        RailComCode::Datagram dg[3];
+        RailComCode::Ch2 r =
+            RailComCode::ch2(code, RailComCode::ch2_bytes, dg, 3);
+        CHECK(r.dgrams == 2 && r.acks == 1 && r.invalid == 0,
+              "ch2 framing %d %d %d", r.dgrams, r.acks, r.invalid);
+        CHECK(dg[0].id == RailComCode::id_dyn &&
+                  dg[0].data == uint32_t((speed << 6) |
+                                         RailComCode::dyn_speed_1),
+              "ch2 dyn %d 0x%x", dg[0].id, dg[0].data);
+        CHECK(dg[1].id == RailComCode::id_pom && dg[1].data == uint32_t(pom),
+              "ch2 pom %d 0x%x", dg[1].id, dg[1].data);
+
+        // a bad byte anywhere must be noticed
+        code[rand_int(0, RailComCode::ch2_bytes - 1)] ^= 1 << rand_int(0, 7);
+        r = RailComCode::ch2(code, RailComCode::ch2_bytes, dg, 3);
+        CHECK(r.invalid > 0, "ch2 bad byte not caught");
+
+        if (fails > 0)
+            return;
+    }
+
+    // channel 1 takes exactly two data bytes
+    const uint8_t adr[] = {RailComCode::encode(RailComCode::id_adr_low << 2),
+                           RailComCode::encode(42)};
+    RailComCode::Datagram dg;
+    CHECK(RailComCode::ch1(adr, 2, dg) &&
+              dg.id == RailComCode::id_adr_low && dg.data == 42,
+          "ch1 adr_low");
+    CHECK(!RailComCode::ch1(adr, 1, dg), "ch1 short");
+}
+
+
+// sum over the members of how far each is from mms at step
+static int consist_err(const Loco *const *loco, int cnt, int step, int mms)
+{
+    int err = 0;
+    for (int m = 0; m < cnt; m++)
+        err += abs(loco[m]->speed_mms(step) - mms);
+    return err;
+}
+
+
+static void check_consist()
+{
+    const Loco *const up = Loco::find_loco("UP852");
+    const Loco *const sw = Loco::find_loco("SW1500");
+    CHECK(up != nullptr && sw != nullptr, "consist roster");
+    if (up == nullptr || sw == nullptr)
+        return;
+
+    Consist one(10);
+    CHECK(one.add(3, up), "consist add");
+    CHECK(!one.add(3, sw), "consist add same loco_id twice");
+    CHECK(!one.add(4, nullptr), "consist add no loco");
+    for (int step = 1; step <= 126; step++)
+        CHECK(one.mismatch_mms(step) == 0, "consist one mismatch %d", step);
+    CHECK(one.mms_max() == up->speed_mms(126), "consist one mms_max");
+
+    Consist two(10);
+    two.add(3, up);
+    two.add(4, sw, true);
+    const Loco *const loco[] = {up, sw};
+    CHECK(two.mms_max() == sw->speed_mms(126), "consist mms_max %d",
+          two.mms_max());
+    for (int step = 1; step <= 126; step++)
+        CHECK(two.mismatch_mms(step) ==
+                  abs(up->speed_mms(step) - sw->speed_mms(step)),
+              "consist mismatch at %d", step);
+
+    CHECK(two.speed_dcc(0) == 0, "consist speed_dcc(0)");
+    for (int mms = 1; mms <= up->speed_mms(126); mms++) {
+        const int step = two.speed_dcc(mms);
+        CHECK(step >= 1 && step <= 126, "consist %d mm/s step %d", mms, step);
+        CHECK(two.speed_dcc(-mms) == -step, "consist -%d mm/s", mms);
+        // curves only go up, so no better neighbor means the best step
+        const int err = consist_err(loco, 2, step, mms);
+        CHECK(step == 1 || consist_err(loco, 2, step - 1, mms) >= err,
+              "consist %d mm/s better below %d", mms, step);
+        CHECK(step == 126 || consist_err(loco, 2, step + 1, mms) >= err,
+              "consist %d mm/s better above %d", mms, step);
+        if (fails > 0)
+            return;
+    }
+
+    Consist full(10);
+    for (int m = 0; m < Consist::member_max; m++)
+        CHECK(full.add(3 + m, up), "consist add %d", m);
+    CHECK(!full.add(3 + Consist::member_max, up), "consist add when full");
+}
+
+
+///// Benchmarks
+
+
+static void bench_all(int iters)
+{
+    // precompute inputs so only the work under test is timed
+    static constexpr int inputs = 1024; // power of 2
+    static int address[inputs];
+    static int speed[inputs];
+    static DccTxPkt pkt[inputs];
+    static uint8_t code[inputs * 2];
+
+    for (int i = 0; i < inputs; i++) {
+        address[i] = rand_address();
+        speed[i] = rand_int(-126, 126);
+        pkt[i] = DccTxPkt::speed128(address[i], speed[i]);
+    }
+    for (int i = 0; i < inputs * 2; i++)
+        code[i] = RailComCode::encode(rand_int(0, 63));
+
+    bench("pkt speed128", "pkts", iters, [&](int i) {
+        int n = i & (inputs - 1);
+        DccTxPkt p = DccTxPkt::speed128(address[n], speed[n]);
+        sink = sink + p.words()[1];
+    });
+
+    bench("pkt encode", "pkts", iters, [&](int i) {
+        const DccTxPkt &src = pkt[i & (inputs - 1)];
+        DccTxPkt p(src.msg(), src.len() - 1);
+        sink = sink + p.words()[1];
+    });
+
+    bench("pkt decode", "pkts", iters, [&](int i) {
+        const DccTxPkt &p = pkt[i & (inputs - 1)];
+        uint8_t msg[DccTxPkt::msg_max];
+        bool cutout;
+        sink = sink + DccTxPkt::decode(p.words(), p.word_cnt(), msg, cutout);
+    });
+
+    DccTxQueue<DccTxPkt, 16> q;
+    bench("queue put/get", "pkts", iters, [&](int i) {
+        q.put(pkt[i & (inputs - 1)]);
+        DccTxPkt p;
+        q.get(p);
+        sink = sink + p.word_cnt();
+    });
+
+    bench("railcom decode", "bytes", iters, [&](int i) {
+        sink = sink + RailComCode::decode(code[i & (inputs * 2 - 1)]);
+    });
+
+    // channel 1 datagram: two bytes, 4-bit id + 8-bit data
+    bench("railcom ch1", "dgrams", iters, [&](int i) {
+        int n = (i & (inputs - 1)) * 2;
+        RailComCode::Datagram dg;
+        if (RailComCode::ch1(&code[n], 2, dg))
+            sink = sink + dg.data;
+    });
+
+    // channel 2: dyn speed datagram + pom datagram + ack
+    static uint8_t ch2[inputs][RailComCode::ch2_bytes];
+    for (int i = 0; i < inputs; i++)
+        put_ch2(ch2[i], rand_int(0, 255), rand_int(0, 255));
+
+    bench("railcom ch2", "cutouts", iters, [&](int i) {
+        RailComCode::Datagram dg[3];
+        RailComCode::Ch2 r = RailComCode::ch2(ch2[i & (inputs - 1)],
+                                              RailComCode::ch2_bytes, dg, 3);
+        sink = sink + r.dgrams + dg[0].data;
+    });
+}
+
+
+int main(int argc, char *argv[])
+{
+    int iters = iter_dflt;
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0) {
+        printf("usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    check_pkt_fixed();
+    check_pkt_round_trip(100'000);
+    check_pkt_bit_error(100'000);
+    check_pkt_garbage(100'000);
+    check_queue();
+    check_estop(10'000);
+    check_funcs(10'000);
+    check_funcs_refresh(10'000);
+    check_railcom();
+    check_railcom_ch2(100'000);
+    check_consist();
+
+    if (fails > 0) {
+        printf("%d check(s) failed\n", fails);
+        return 1;
+    }
+    printf("checks ok\n");
+
+    bench_all(iters);
+
+    return 0;
+}
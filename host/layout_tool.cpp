@@ -0,0 +1,213 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+// track
+#include "layout.h"
+
+// Compiles a layout description into the image Layout loads, and prints
+// it as an upload: 'L', the image in hex, and a '.'. Sending that to an
+// app's console (e.g. cat'ing it to /dev/ttyACM0) saves it in flash.
+//
+// Usage: layout_tool FILE [--bin OUT]
+//
+// The description is a line per node or segment; # starts a comment.
+//
+//   node NAME [sensor N] [sensor2 N] [turnout N]
+//   seg NODE.END NODE.END MM
+//
+// END is a or b, the node's two ends; a train passes through a node
+// from one to the other. For a turnout, a is the points, and s or d is
+// the straight or diverging leg (both on its b end). A bare NODE is
+// NODE.a.
+
+static Layout::Node node[Layout::node_max];
+static int node_cnt = 0;
+static Layout::Seg seg[Layout::seg_max];
+static int seg_cnt = 0;
+
+static const char *file_name = nullptr;
+static int line_num = 0;
+
+
+[[noreturn]] static void fail(const char *msg, const char *what = "")
+{
+    fprintf(stderr, "%s:%d: %s%s\n", file_name, line_num, msg, what);
+    exit(1);
+}
+
+
+static int find_node(const char *name)
+{
+    for (int n = 0; n < node_cnt; n++)
+        if (strncmp(node[n].name, name, Layout::name_max) == 0)
+            return n;
+    return -1;
+}
+
+
+static int number(const char *tok)
+{
+    char *end;
+    const long v = (tok == nullptr) ? -1 : strtol(tok, &end, 0);
+    if (tok == nullptr || *end != '\0' || v < 0)
+        fail("expected a number, got ", (tok == nullptr) ? "nothing" : tok);
+    return int(v);
+}
+
+
+static void parse_node(char *save)
+{
+    if (node_cnt >= Layout::node_max)
+        fail("too many nodes");
+    Layout::Node &n = node[node_cnt];
+    n.sensor = -1;
+    n.sensor2 = -1;
+    n.turnout = -1;
+
+    const char *name = strtok_r(nullptr, " \t", &save);
+    if (name == nullptr || strlen(name) > Layout::name_max ||
+        strchr(name, '.') != nullptr)
+        fail("bad node name");
+    if (find_node(name) >= 0)
+        fail("duplicate node ", name);
+    strncpy(n.name, name, Layout::name_max);
+
+    const char *tok;
+    while ((tok = strtok_r(nullptr, " \t", &save)) != nullptr) {
+        const int v = number(strtok_r(nullptr, " \t", &save));
+        if (strcmp(tok, "sensor") == 0)
+            n.sensor = int8_t(v);
+        else if (strcmp(tok, "sensor2") == 0)
+            n.sensor2 = int8_t(v);
+        else if (strcmp(tok, "turnout") == 0 && v < Layout::turnout_max)
+            n.turnout = int8_t(v);
+        else
+            fail("bad node attribute ", tok);
+    }
+    node_cnt++;
+}
+
+
+// NODE[.a|.b|.s|.d] into seg's kth end
+static void parse_end(char *tok, Layout::Seg &s, int k)
+{
+    if (tok == nullptr)
+        fail("expected NODE.END");
+    char *dot = strchr(tok, '.');
+    const char end = (dot == nullptr) ? 'a' : dot[1];
+    if (dot != nullptr) {
+        if (dot[1] == '\0' || dot[2] != '\0')
+            fail("bad end ", tok);
+        *dot = '\0';
+    }
+    const int n = find_node(tok);
+    if (n < 0)
+        fail("no node ", tok);
+    const bool turnout = node[n].turnout >= 0;
+
+    s.node[k] = uint8_t(n);
+    s.leg[k] = Layout::leg_straight;
+    if (end == 'a') {
+        s.end[k] = Layout::end_a;
+    } else if (end == 'b' && !turnout) {
+        s.end[k] = Layout::end_b;
+    } else if ((end == 's' || end == 'd') && turnout) {
+        s.end[k] = Layout::end_b;
+        if (end == 'd')
+            s.leg[k] = Layout::leg_diverging;
+    } else {
+        fail("bad end for ", tok);
+    }
+}
+
+
+static void parse_seg(char *save)
+{
+    if (seg_cnt >= Layout::seg_max)
+        fail("too many segments");
+    Layout::Seg &s = seg[seg_cnt];
+    parse_end(strtok_r(nullptr, " \t", &save), s, 0);
+    parse_end(strtok_r(nullptr, " \t", &save), s, 1);
+    const int mm = number(strtok_r(nullptr, " \t", &save));
+    if (mm < 1 || mm >= UINT16_MAX)
+        fail("bad length");
+    s.len_mm = uint16_t(mm);
+    if (strtok_r(nullptr, " \t", &save) != nullptr)
+        fail("extra on the line");
+    seg_cnt++;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *bin_name = nullptr;
+    if (argc == 4 && strcmp(argv[2], "--bin") == 0) {
+        bin_name = argv[3];
+    } else if (argc != 2) {
+        fprintf(stderr, "usage: layout_tool FILE [--bin OUT]\n");
+        return 1;
+    }
+    file_name = argv[1];
+
+    FILE *f = fopen(file_name, "r");
+    if (f == nullptr) {
+        perror(file_name);
+        return 1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        line_num++;
+        char *hash = strchr(line, '#');
+        if (hash != nullptr)
+            *hash = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        char *save;
+        const char *kind = strtok_r(line, " \t", &save);
+        if (kind == nullptr)
+            continue;
+        if (strcmp(kind, "node") == 0)
+            parse_node(save);
+        else if (strcmp(kind, "seg") == 0)
+            parse_seg(save);
+        else
+            fail("expected node or seg, got ", kind);
+    }
+    fclose(f);
+    if (node_cnt == 0)
+        fail("no nodes");
+
+    static uint8_t image[Layout::size_max];
+    Layout::Header hdr = {};
+    const size_t size = sizeof(hdr) + node_cnt * sizeof(Layout::Node) +
+                        seg_cnt * sizeof(Layout::Seg);
+    static_assert(sizeof(hdr) + sizeof(node) + sizeof(seg) <=
+                  Layout::size_max);
+    memcpy(image + sizeof(hdr), node, node_cnt * sizeof(Layout::Node));
+    memcpy(image + sizeof(hdr) + node_cnt * sizeof(Layout::Node), seg,
+           seg_cnt * sizeof(Layout::Seg));
+    hdr.magic = Layout::magic;
+    hdr.version = Layout::version;
+    hdr.size = uint16_t(size);
+    hdr.node_cnt = uint8_t(node_cnt);
+    hdr.seg_cnt = uint8_t(seg_cnt);
+    hdr.crc = Layout::crc(image + sizeof(hdr), size - sizeof(hdr));
+    memcpy(image, &hdr, sizeof(hdr));
+
+    if (bin_name != nullptr) {
+        FILE *b = fopen(bin_name, "wb");
+        if (b == nullptr || fwrite(image, 1, size, b) != size) {
+            perror(bin_name);
+            return 1;
+        }
+        fclose(b);
+    }
+
+    printf("L\n");
+    for (size_t i = 0; i < size; i++)
+        printf("%02x%s", image[i], (i % 32 == 31 || i == size - 1) ? "\n" : "");
+    printf(".\n");
+
+    return 0;
+}
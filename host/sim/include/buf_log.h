@@ -0,0 +1,12 @@
+#pragma once
+
+// Simulator stand-in; nothing is buffered.
+
+class BufLog
+{
+public:
+
+    static void loop()
+    {
+    }
+};
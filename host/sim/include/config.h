@@ -0,0 +1,4 @@
+#pragma once
+
+// Simulator stand-in for the board configuration; everything the apps need
+// comes from desktop_layout.h.
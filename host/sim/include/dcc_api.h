@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+struct uart_inst_t;
+
+// Simulator stand-in for the dcc library's api. Commands go straight to the
+// simulated decoder (sim_model.h); cv operations always succeed and take
+// about as long as they do on the track.
+
+namespace DccApi {
+
+enum class Status {
+    Ok,
+    Busy,
+    Error,
+};
+
+const char *status(Status s);
+
+Status init(int sig_gpio, int pwr_gpio, int adc_gpio, int rcom_gpio,
+            uart_inst_t *rcom_uart);
+
+Status track_set(bool on);
+
+// service mode
+Status cv_val_set(int cv_num, int cv_val);
+
+Status loco_create(int loco_id);
+
+Status loco_speed_set(int loco_id, int speed);
+
+Status loco_func_set(int loco_id, int func, bool on);
+
+// ops mode
+Status loco_cv_val_set(int loco_id, int cv_num, int cv_val);
+Status loco_cv_val_get(int loco_id, int cv_num, int &cv_val);
+Status loco_cv_bit_set(int loco_id, int cv_num, int b_num, int b_val);
+
+} // namespace DccApi
@@ -0,0 +1,59 @@
+#pragma once
+
+// Simulator stand-in for the desktop layout.
+//
+//   house          uncoupler      t0
+//   |[home]==========|=============+===============================[1]
+//                  sensor,          \        t1
+//                  magnet            \=======+======================[2]
+//                                             \=====================[3]
+//
+// Distances are along the track from the uncoupler, positive toward the
+// spurs; each spur ends at a distance sensor (sim_model.h has the numbers).
+
+#include "sensor.h"
+#include "sensor2.h"
+#include "turnout.h"
+
+struct uart_inst_t;
+
+static constexpr int dcc_sig_gpio = 2;
+static constexpr int dcc_pwr_gpio = 3;
+static constexpr int dcc_adc_gpio = 26;
+static constexpr int dcc_rcom_gpio = 5;
+static uart_inst_t *const dcc_rcom_uart = nullptr;
+
+static constexpr int tp_gpio = 6;
+
+static constexpr int sensor_unc_gpio = 10;
+
+static constexpr int sensor_max = 1;
+extern Sensor sensor[sensor_max];
+
+static constexpr int sensor2_max = 4; // home, spur 1-3
+extern Sensor2 sensor2[sensor2_max];
+
+static constexpr int turnout_max = 2;
+extern Turnout turnout[turnout_max];
+
+inline Sensor &sensor_unc()
+{
+    return sensor[0];
+}
+
+inline Sensor2 &sensor_home()
+{
+    return sensor2[0];
+}
+
+inline Sensor2 &sensor_spur(int spur)
+{
+    return sensor2[spur];
+}
+
+// uncoupler to the sensor at the end of a spur
+int unc_to_spur_mm(int spur);
+
+// line the turnouts for a spur
+void line_turnout_0(int spur);
+void line_turnout_1(int spur);
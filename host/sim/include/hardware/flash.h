@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Simulator flash: a small image in RAM, loaded from and saved to a file
+// with --flash. The XIP window maps straight onto it.
+
+static constexpr uint32_t FLASH_PAGE_SIZE = 256;
+static constexpr uint32_t FLASH_SECTOR_SIZE = 4096;
+
+#define PICO_FLASH_SIZE_BYTES (64 * 1024)
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+#define XIP_BASE (uintptr_t(sim_flash))
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count);
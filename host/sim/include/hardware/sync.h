@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Simulator interrupts are alarms; while they're off, alarms that come due
+// wait until they're back on.
+
+uint32_t save_and_disable_interrupts();
+
+void restore_interrupts(uint32_t status);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "dcc_api.h"
+
+// Simulator stand-in for the loco roster.
+//
+// Speed calibration is linear from mms_min at step 1 to mms_max at step
+// 126; the simulated loco follows the same curve, off by a per-run error
+// (sim_model.h), which is what the automation has to cope with.
+
+struct Loco {
+    uint32_t sn;
+    const char *name;
+    int len_mm;
+
+    int mms_min; // mm/sec at step 1
+    int mms_max; // mm/sec at step 126
+    int dec_mms2; // braking at cv4=0, mm/sec^2
+
+    int v_master; // cv63
+    int v_engine; // cv259, -1 if no sound
+
+    int f_headlight;
+    int f_engine;
+    int f_bell;
+    int f_horn;
+    int f_clank;
+    int f_cab_light;
+
+    // signed mm/sec to signed dcc step
+    int speed_dcc(int mms) const;
+
+    // signed dcc step to signed mm/sec
+    int speed_mms(int dcc) const;
+
+    // distance to stop from mms with no deceleration set
+    int stop_mm(int mms) const;
+
+    static DccApi::Status read_sn(int loco_id, uint32_t &sn);
+
+    static const Loco *find_loco(uint32_t sn);
+    static const Loco *find_loco(const char *name);
+
+    static const Loco roster[];
+    static const int roster_max;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+#define PICO_OK 0
+
+// Nothing else runs in the simulator; func is just called.
+int flash_safe_execute(void (*func)(void *), void *param,
+                       uint32_t enter_exit_timeout_ms);
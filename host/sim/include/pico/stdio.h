@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+bool stdio_init_all();
+
+void stdio_flush();
+
+// Console input in the simulator is whatever --key typed, then --input's
+// file, and a space otherwise.
+int stdio_getchar_timeout_us(uint32_t timeout_us);
+
+extern const char *sim_input; // what's left of --input's file
@@ -0,0 +1,3 @@
+#pragma once
+
+bool stdio_usb_connected();
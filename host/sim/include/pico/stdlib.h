@@ -0,0 +1,20 @@
+#pragma once
+
+// Simulator stand-in for the pico sdk: time is virtual and advances a tick
+// each time it is read (sim_model.h).
+
+#include <cassert> // as pico.h does
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+static inline void tight_loop_contents()
+{
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+// Alarms go off as the clock passes them (sim_stubs.cpp), between the
+// app's reads of it, unless interrupts are off (hardware/sync.h).
+
+typedef int32_t alarm_id_t;
+
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+// >0 id; 0 if it went off during the call (fire_if_past and us is 0)
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past);
+
+bool cancel_alarm(alarm_id_t alarm_id);
@@ -0,0 +1,23 @@
+#pragma once
+
+// Simulator stand-in for an on/off (ir) sensor.
+
+class Sensor
+{
+public:
+
+    Sensor(int gpio) :
+        _gpio(gpio)
+    {
+    }
+
+    void init()
+    {
+    }
+
+    operator bool() const;
+
+private:
+
+    int _gpio;
+};
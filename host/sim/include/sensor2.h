@@ -0,0 +1,56 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+
+// Simulator stand-in for a distance sensor.
+//
+// The sensor reports a count that maps to distance as in the real one:
+// mm = ((count - 1000) * 3 + 2) / 4, with counts from count_none up meaning
+// nothing in range.
+
+class Sensor2
+{
+public:
+
+    static constexpr uint16_t count_none = 1990;
+
+    Sensor2(int id) :
+        _id(id),
+        _func(nullptr),
+        _arg(0)
+    {
+    }
+
+    void init()
+    {
+    }
+
+    // INT_MAX if nothing in range
+    int dist_mm() const;
+
+    // called with each new count (from loop context in the simulator)
+    typedef void(CountFunc)(uint16_t count, intptr_t arg);
+    void set_callback(CountFunc *func, intptr_t arg)
+    {
+        _func = func;
+        _arg = arg;
+    }
+
+    int id() const
+    {
+        return _id;
+    }
+
+    void count(uint16_t cnt) const
+    {
+        if (_func != nullptr)
+            _func(cnt, _arg);
+    }
+
+private:
+
+    int _id;
+    CountFunc *_func;
+    intptr_t _arg;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Simulator stand-in; the led is not modeled.
+
+class SysLed
+{
+public:
+
+    static void init()
+    {
+    }
+
+    static void on()
+    {
+    }
+
+    static void off()
+    {
+    }
+
+    static void pattern(uint32_t, uint32_t)
+    {
+    }
+
+    static void loop()
+    {
+    }
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+// Simulator stand-in for a turnout. Throwing one with a car over its points
+// is a simulator fault (derailment).
+
+class Turnout
+{
+public:
+
+    Turnout(int gpio_a, int gpio_b) :
+        _gpio_a(gpio_a),
+        _gpio_b(gpio_b)
+    {
+    }
+
+    static void init(int tp_gpio)
+    {
+        (void)tp_gpio;
+    }
+
+    void set(bool straight);
+
+private:
+
+    int _gpio_a;
+    int _gpio_b;
+};
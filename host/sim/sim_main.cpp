@@ -0,0 +1,263 @@
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+//
+#include "hardware/flash.h"
+#include "locos.h"
+#include "pico/stdio.h"
+#include "sensor2.h"
+#include "sim_model.h"
+#include "sim_replay.h"
+
+// Runs an app against the layout model.
+//
+// The app is compiled with -Dmain=sim_app_main; its main loop never
+// returns, so the model ends the run by throwing from the clock. The
+// summary goes to stderr, so --quiet (app output to /dev/null) still shows
+// it. Exit status is 0 for a clean run, 2 for a fault.
+//
+// With --replay, the app runs against a session trace captured from the
+// app's output (circuits with trace_on) instead of the model
+// (sim_replay.h), until the end of the trace. Exit status is 3 if the app
+// did not make the recorded calls.
+
+int sim_app_main();
+
+extern Sensor2 sensor2[];
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --scene NAME      circuits, uncouple_test, stops,\n"
+            "                    speed_match\n"
+            "                    (default from the program name)\n"
+            "  --cycles N        stop after N cycles (default 10)\n"
+            "  --time SEC        stop after SEC virtual seconds\n"
+            "  --hang SEC        fault if no cycle for SEC (default 600)\n"
+            "  --seed N          random seed (default 1)\n"
+            "  --loco NAME       loco from the sim roster (default %s)\n"
+            "  --tick US         clock tick (default 1000)\n"
+            "  --speed-err F     sd of loco speed error (default 0.03)\n"
+            "  --p-couple F      couplers engage on contact (default 0.97)\n"
+            "  --p-uncouple F    magnet opens couplers (default 0.85)\n"
+            "  --p-recouple F    open couplers engage (default 0.03)\n"
+            "  --p-recouple-s F  ... in the spur 2 s-curve (default 0.20)\n"
+            "  --cdu SEC         turnout CDU recharge time (default 0.8)\n"
+            "  --replay LOG      replay the session trace in LOG\n"
+            "  --key C@SEC       type C at SEC virtual seconds\n"
+            "  --flash FILE      flash image, loaded and saved back\n"
+            "  --input FILE      typed after the --keys (e.g. an upload)\n"
+            "  --quiet           discard app output\n",
+            prog, Loco::roster[0].name);
+}
+
+
+static void sample(int id, uint16_t count)
+{
+    sensor2[id].count(count);
+}
+
+
+int main(int argc, char *argv[])
+{
+    SimModel::Config cfg;
+    const char *scene_name = nullptr;
+    const char *loco_name = Loco::roster[0].name;
+    const char *replay_log = nullptr;
+    const char *flash_file = nullptr;
+    const char *input_file = nullptr;
+    bool quiet = false;
+    struct {
+        char c;
+        double sec;
+    } keys[8];
+    constexpr int key_max = sizeof(keys) / sizeof(keys[0]);
+    int key_cnt = 0;
+
+    // sim_circuits -> circuits
+    const char *prog = strrchr(argv[0], '/');
+    prog = (prog == nullptr) ? argv[0] : prog + 1;
+    if (strncmp(prog, "sim_", 4) == 0)
+        scene_name = prog + 4;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--quiet") == 0) {
+            quiet = true;
+            continue;
+        }
+        if (val == nullptr) {
+            usage(prog);
+            return 1;
+        }
+        i++;
+        if (strcmp(arg, "--scene") == 0)
+            scene_name = val;
+        else if (strcmp(arg, "--cycles") == 0)
+            cfg.cycles = atoi(val);
+        else if (strcmp(arg, "--time") == 0)
+            cfg.time_s = atof(val);
+        else if (strcmp(arg, "--hang") == 0)
+            cfg.hang_s = atof(val);
+        else if (strcmp(arg, "--seed") == 0)
+            cfg.seed = strtoul(val, nullptr, 0);
+        else if (strcmp(arg, "--loco") == 0)
+            loco_name = val;
+        else if (strcmp(arg, "--tick") == 0)
+            cfg.tick_us = strtoul(val, nullptr, 0);
+        else if (strcmp(arg, "--speed-err") == 0)
+            cfg.speed_err = atof(val);
+        else if (strcmp(arg, "--p-couple") == 0)
+            cfg.p_couple = atof(val);
+        else if (strcmp(arg, "--p-uncouple") == 0)
+            cfg.p_uncouple = atof(val);
+        else if (strcmp(arg, "--p-recouple") == 0)
+            cfg.p_recouple = atof(val);
+        else if (strcmp(arg, "--p-recouple-s") == 0)
+            cfg.p_recouple_s = atof(val);
+        else if (strcmp(arg, "--cdu") == 0)
+            cfg.cdu_recharge_s = atof(val);
+        else if (strcmp(arg, "--replay") == 0)
+            replay_log = val;
+        else if (strcmp(arg, "--flash") == 0)
+            flash_file = val;
+        else if (strcmp(arg, "--input") == 0)
+            input_file = val;
+        else if (strcmp(arg, "--key") == 0 && val[0] != '\0' &&
+                 val[1] == '@' && key_cnt < key_max)
+            keys[key_cnt++] = {val[0], atof(val + 2)};
+        else {
+            usage(prog);
+            return 1;
+        }
+    }
+
+    SimModel::Scene scene;
+    if (scene_name != nullptr && strcmp(scene_name, "circuits") == 0) {
+        scene = SimModel::Scene::Circuits;
+    } else if (scene_name != nullptr &&
+               strcmp(scene_name, "uncouple_test") == 0) {
+        scene = SimModel::Scene::UncoupleTest;
+    } else if (scene_name != nullptr && strcmp(scene_name, "stops") == 0) {
+        scene = SimModel::Scene::Stops;
+    } else if (scene_name != nullptr &&
+               strcmp(scene_name, "speed_match") == 0) {
+        scene = SimModel::Scene::Stops; // same layout, spur 1 empty
+    } else {
+        usage(prog);
+        return 1;
+    }
+
+    const Loco *loco = Loco::find_loco(loco_name);
+    if (loco == nullptr || cfg.tick_us == 0) {
+        usage(prog);
+        return 1;
+    }
+
+    if (replay_log != nullptr) {
+        if (!sim_replay.load(replay_log))
+            return 1;
+        cfg.replay = true;
+        cfg.cycles = 0;
+        cfg.time_s = sim_replay.duration_us() / 1e6 + 1.0;
+        cfg.hang_s = 0;
+    } else if (cfg.cycles <= 0 && cfg.time_s <= 0) {
+        cfg.cycles = 10;
+    }
+
+    // erased, unless there's an image to start from
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+    if (flash_file != nullptr) {
+        FILE *f = fopen(flash_file, "rb");
+        if (f != nullptr) {
+            if (fread(sim_flash, 1, sizeof(sim_flash), f) != sizeof(sim_flash))
+                fprintf(stderr, "%s: short image, rest erased\n", flash_file);
+            fclose(f);
+        }
+    }
+
+    static std::string input;
+    if (input_file != nullptr) {
+        FILE *f = fopen(input_file, "rb");
+        if (f == nullptr) {
+            perror(input_file);
+            return 1;
+        }
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            input.append(buf, n);
+        fclose(f);
+        sim_input = input.c_str();
+    }
+
+    if (quiet && freopen("/dev/null", "w", stdout) == nullptr) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    sim_model.config(cfg);
+    sim_model.scene(scene, loco);
+    sim_model.sample_callback(sample);
+    for (int i = 0; i < key_cnt; i++)
+        sim_model.key(keys[i].c, sim_model.now_us() + keys[i].sec * 1e6);
+    sim_replay.start(sim_model.now_us());
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        sim_app_main();
+    } catch (const SimDone &) {
+    }
+    auto end = std::chrono::steady_clock::now();
+    fflush(stdout);
+
+    if (flash_file != nullptr) {
+        FILE *f = fopen(flash_file, "wb");
+        if (f == nullptr ||
+            fwrite(sim_flash, 1, sizeof(sim_flash), f) != sizeof(sim_flash))
+            perror(flash_file);
+        if (f != nullptr)
+            fclose(f);
+    }
+
+    const double real_s = std::chrono::duration<double>(end - start).count();
+    const double virt_s = (sim_model.now_us() - 1'000'000) / 1e6;
+    const SimModel::Stats &st = sim_model.stats();
+
+    fprintf(stderr, "sim %s: loco %s (speed x%.3f), seed %u\n", scene_name,
+            loco->name, sim_model.speed_k(), cfg.seed);
+    fprintf(stderr,
+            "cycles %d in %.1f sec virtual, %.3f sec real (%.0fx), "
+            "%.1f cycles/sec\n",
+            st.cycles, virt_s, real_s, virt_s / real_s, st.cycles / real_s);
+    if (st.cycles > 0)
+        fprintf(stderr, "cycle sec: min %.1f mean %.1f max %.1f\n",
+                st.cycle_min_us / 1e6, st.cycle_sum_us / 1e6 / st.cycles,
+                st.cycle_max_us / 1e6);
+    fprintf(stderr,
+            "couplers: couples %d misses %d, magnet tries %d opens %d, "
+            "separations %d, recouples %d\n",
+            st.couples, st.couple_misses, st.unc_tries, st.unc_opens,
+            st.separations, st.recouples);
+    fprintf(stderr, "turnouts: throws %d, weak %d\n", st.throws,
+            st.weak_throws);
+
+    if (sim_replay.active()) {
+        sim_replay.report(stderr);
+        return sim_replay.diverged() ? 3 : 0;
+    }
+
+    if (sim_model.fault() != nullptr) {
+        fprintf(stderr, "FAULT at %.1f sec: %s\n", virt_s, sim_model.fault());
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,572 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+//
+#include "desktop_layout.h"
+#include "locos.h"
+#include "sim_model.h"
+
+SimModel sim_model;
+
+
+int SimModel::spur_end_mm(int spur)
+{
+    static constexpr int end_mm[spur_max + 1] = {0, 900, 950, 880};
+    return (spur >= 1 && spur <= spur_max) ? end_mm[spur] : 0;
+}
+
+
+SimModel::SimModel() :
+    _cfg(),
+    _scene(Scene::Circuits),
+    _rng(1),
+    _now_us(0),
+    _done(false),
+    _fault{},
+    _loco(nullptr),
+    _cv{},
+    _cmd_step(0),
+    _step(0),
+    _v(0),
+    _speed_k(1),
+    _dec_k(1),
+    _unc_at_mm(0),
+    _veh{},
+    _veh_cnt(0),
+    _coupled(-1),
+    _contact(-1),
+    _sturn_tried(false),
+    _slack_s(0),
+    _unc_tried(false),
+    _turnout{true, true},
+    _cdu_used(false),
+    _cdu_us(0),
+    _sample_us(0),
+    _count{},
+    _sample_func(nullptr),
+    _key{},
+    _key_cnt(0),
+    _moving(false),
+    _last_dir(0),
+    _cycle_us(0),
+    _stats{}
+{
+}
+
+
+void SimModel::scene(Scene scene, const Loco *loco)
+{
+    _scene = scene;
+    _rng.seed(_cfg.seed);
+    _now_us = 1'000'000;
+    _done = false;
+    _fault[0] = '\0';
+
+    _loco = loco;
+    memset(_cv, 0, sizeof(_cv));
+    // serial number on the railcom page, little-endian
+    _cv[265] = loco->sn & 0xff;
+    _cv[266] = (loco->sn >> 8) & 0xff;
+    _cv[267] = (loco->sn >> 16) & 0xff;
+    _cv[268] = (loco->sn >> 24) & 0xff;
+    _cmd_step = 0;
+    _step = 0;
+    _v = 0;
+    _speed_k = 1.0 + normal(_cfg.speed_err);
+    _dec_k = 1.0 + normal(_cfg.speed_err);
+    _unc_at_mm = normal(1.0);
+
+    const int loco_len = loco->len_mm;
+    _veh[0] = {loco_len, 0, 0, false};
+    _veh_cnt = 1;
+
+    switch (scene) {
+    case Scene::Circuits:
+        // in the house; boxcar and tanker 60 mm from the ends of spurs 1, 2
+        _veh[0].x0 = house_mm + 35;
+        _veh[1] = {152, spur_end_mm(1) - 60.0 - 152, 1, false};
+        _veh[2] = {148, spur_end_mm(2) - 60.0 - 148, 2, false};
+        _veh_cnt = 3;
+        break;
+    case Scene::UncoupleTest:
+        // left of the uncoupler, car a loco-length right of it (past t0)
+        _veh[0].x0 = -60.0 - loco_len;
+        _veh[1] = {152, std::max(loco_len, t0_mm) + 12.0, 1, false};
+        _veh_cnt = 2;
+        break;
+    case Scene::Stops:
+        _veh[0].x0 = -loco_len / 2.0;
+        break;
+    }
+
+    _coupled = -1;
+    _contact = -1;
+    _sturn_tried = false;
+    _slack_s = 0;
+    _unc_tried = false;
+    _turnout[0] = true;
+    _turnout[1] = true;
+    _cdu_used = false;
+
+    _sample_us = _now_us;
+    for (int id = 0; id < 4; id++)
+        _count[id] = Sensor2::count_none;
+
+    _moving = false;
+    _last_dir = 0;
+    _cycle_us = _now_us;
+    _stats = Stats{};
+    _stats.cycle_min_us = UINT64_MAX;
+}
+
+
+uint64_t SimModel::tick()
+{
+    if (_done)
+        throw SimDone();
+
+    if (!_cfg.replay)
+        step(_cfg.tick_us * 1e-6);
+    _now_us += _cfg.tick_us;
+    check_end();
+
+    if (_done)
+        throw SimDone();
+
+    return _now_us;
+}
+
+
+void SimModel::advance(uint64_t us)
+{
+    const uint64_t end_us = _now_us + us;
+    while (_now_us < end_us)
+        tick();
+}
+
+
+void SimModel::speed_set(int dcc)
+{
+    _cmd_step = std::clamp(dcc, -126, 126);
+}
+
+
+void SimModel::func_set(int, bool)
+{
+    // sound and lights aren't modeled
+}
+
+
+void SimModel::cv_set(int cv, int val)
+{
+    if (cv == 8) {
+        // decoder reset: everything but the serial number
+        for (int i = 0; i < cv_max; i++)
+            if (i < 265 || i > 268)
+                _cv[i] = 0;
+        return;
+    }
+    if (cv >= 0 && cv < cv_max)
+        _cv[cv] = val;
+}
+
+
+int SimModel::cv_get(int cv) const
+{
+    return (cv >= 0 && cv < cv_max) ? _cv[cv] : 0;
+}
+
+
+// The uncoupler sensor sees vehicle bodies, not the gaps between them. Its
+// edges are clean (the real one is debounced), but it isn't exactly where
+// the layout says.
+bool SimModel::sensor(int gpio)
+{
+    if (gpio != sensor_unc_gpio)
+        return false;
+
+    const double at_mm = _unc_at_mm;
+    for (int v = 0; v < _veh_cnt; v++)
+        if (_veh[v].x0 <= at_mm && x1(v) >= at_mm)
+            return true;
+
+    return false;
+}
+
+
+bool SimModel::key(int c, uint64_t at_us)
+{
+    if (_key_cnt >= key_max)
+        return false;
+    _key[_key_cnt++] = {c, at_us};
+    return true;
+}
+
+
+int SimModel::key()
+{
+    for (int i = 0; i < _key_cnt; i++) {
+        if (_key[i].at_us <= _now_us) {
+            const int c = _key[i].c;
+            _key[i] = _key[--_key_cnt];
+            return c;
+        }
+    }
+    return -1;
+}
+
+
+uint16_t SimModel::sensor2_count(int id) const
+{
+    return (id >= 0 && id < 4) ? _count[id] : Sensor2::count_none;
+}
+
+
+// The turnouts share a capacitive discharge unit, which fires whether or
+// not the points move, and is too weak to move them until it recharges.
+void SimModel::turnout_set(int idx, bool straight)
+{
+    if (idx < 0 || idx > 1)
+        return;
+
+    const bool charged =
+        !_cdu_used || _now_us - _cdu_us >= _cfg.cdu_recharge_s * 1e6;
+    _cdu_used = true;
+    _cdu_us = _now_us;
+    _stats.throws++;
+    if (!charged) {
+        _stats.weak_throws++;
+        return;
+    }
+
+    if (_turnout[idx] == straight)
+        return;
+
+    const int points_mm = (idx == 0) ? t0_mm : t1_mm;
+    for (int v = 0; v < _veh_cnt; v++) {
+        if (idx == 1 && _veh[v].route != 2 && _veh[v].route != 3)
+            continue;
+        if (_veh[v].x0 < points_mm && x1(v) > points_mm) {
+            fail("derail: turnout %d thrown under %s", idx,
+                 (v == 0) ? "the loco" : "a car");
+            return;
+        }
+    }
+
+    _turnout[idx] = straight;
+}
+
+
+void SimModel::step(double dt)
+{
+    loco_step(dt);
+
+    // forward is toward the house
+    const double dx = -_v * dt;
+    if (dx != 0.0)
+        move(dx);
+
+    couplers(dx, dt);
+
+    if (_now_us >= _sample_us) {
+        sample();
+        _sample_us += sample_us;
+    }
+
+    at_rest();
+}
+
+
+// Decoder momentum (nmra: cv3/cv4 times 0.896 sec for the full range),
+// then the loco's own braking/acceleration limit.
+void SimModel::loco_step(double dt)
+{
+    const double target = _cmd_step;
+
+    if (_step != target) {
+        const bool faster = (target > _step) ? (_step >= 0) : (_step <= 0);
+        const int cv = faster ? _cv[3] : _cv[4];
+        const double d = (cv == 0) ? 126.0 : (126.0 / (cv * 0.896)) * dt;
+        if (target > _step)
+            _step = std::min(_step + d, target);
+        else
+            _step = std::max(_step - d, target);
+    }
+
+    const double s = std::fabs(_step);
+    const double span = _loco->mms_max - _loco->mms_min;
+    double mms = 0;
+    if (s >= 1.0)
+        mms = _loco->mms_min + (s - 1.0) * span / 125.0;
+    else
+        mms = s * _loco->mms_min;
+    const double v_target = ((_step < 0) ? -mms : mms) * _speed_k;
+
+    const double dv = _loco->dec_mms2 * _dec_k * dt;
+    if (_v < v_target)
+        _v = std::min(_v + dv, v_target);
+    else
+        _v = std::max(_v - dv, v_target);
+}
+
+
+void SimModel::move(double dx)
+{
+    double old_x1[vehicle_max];
+    for (int v = 0; v < _veh_cnt; v++)
+        old_x1[v] = x1(v);
+
+    _veh[0].x0 += dx;
+    route(0, old_x1[0]);
+
+    if (_coupled >= 0) {
+        _veh[_coupled].x0 = x1(0) + gap_mm;
+        route(_coupled, old_x1[_coupled]);
+    }
+
+    if (dx > 0) {
+        // push free cars that were ahead, and whatever they run into
+        bool pushed[vehicle_max] = {};
+        pushed[0] = true;
+        if (_coupled >= 0)
+            pushed[_coupled] = true;
+        bool again = true;
+        while (again) {
+            again = false;
+            for (int p = 0; p < _veh_cnt; p++) {
+                if (!pushed[p])
+                    continue;
+                for (int v = 1; v < _veh_cnt; v++) {
+                    if (pushed[v] || !touches(p, v))
+                        continue;
+                    if (_veh[v].x0 < old_x1[p] || _veh[v].x0 >= x1(p) + gap_mm)
+                        continue;
+                    _veh[v].x0 = x1(p) + gap_mm;
+                    route(v, old_x1[v]);
+                    pushed[v] = true;
+                    again = true;
+                }
+            }
+        }
+        for (int v = 0; v < _veh_cnt; v++) {
+            const int r = _veh[v].route;
+            if (r > 0 && r <= spur_max && x1(v) > spur_end_mm(r)) {
+                fail("bumper: %s hit the end of spur %d",
+                     (v == 0) ? "loco" : "car", r);
+                return;
+            }
+        }
+    } else if (_veh[0].x0 < house_mm) {
+        fail("bumper: loco hit the end of the house");
+    }
+}
+
+
+// Route is decided by the turnouts as a vehicle's right end crosses them.
+void SimModel::route(int v, double old_x1)
+{
+    const double new_x1 = x1(v);
+
+    if (new_x1 <= t0_mm) {
+        _veh[v].route = 0;
+        return;
+    }
+
+    if (old_x1 <= t0_mm)
+        _veh[v].route = _turnout[0] ? 1 : route_23;
+
+    if (_veh[v].route == route_23 && new_x1 > t1_mm)
+        _veh[v].route = _turnout[1] ? 2 : 3;
+}
+
+
+bool SimModel::touches(int a, int b) const
+{
+    const int ra = _veh[a].route;
+    const int rb = _veh[b].route;
+    if (ra == route_23)
+        return rb != 1;
+    if (rb == route_23)
+        return ra != 1;
+    return ra == rb || ra == 0 || rb == 0;
+}
+
+
+void SimModel::couplers(double dx, double dt)
+{
+    // free car whose coupler is against the loco's
+    int c = -1;
+    if (_coupled < 0) {
+        for (int v = 1; v < _veh_cnt; v++) {
+            const double gap = _veh[v].x0 - x1(0);
+            if (touches(0, v) && gap >= -1.0 && gap <= gap_mm + 0.5)
+                c = v;
+        }
+    }
+
+    if (c != _contact) {
+        if (c >= 0) {
+            const bool open = _veh[c].open;
+            if (uniform() < (open ? _cfg.p_recouple : _cfg.p_couple)) {
+                _coupled = c;
+                c = -1;
+                _stats.couples++;
+                if (open)
+                    _stats.recouples++;
+                _veh[_coupled].open = false;
+            } else if (!open) {
+                _stats.couple_misses++;
+            }
+        }
+        _contact = c;
+        _sturn_tried = false;
+    }
+
+    // pushing an uncoupled car through the spur 2 s-curve
+    if (_contact >= 0 && dx > 0 && _veh[_contact].route == 2 &&
+        _veh[_contact].x0 > t1_mm && _veh[_contact].x0 < t1_mm + sturn_mm &&
+        !_sturn_tried) {
+        _sturn_tried = true;
+        if (uniform() < _cfg.p_recouple_s) {
+            _coupled = _contact;
+            _contact = -1;
+            _stats.couples++;
+            _stats.recouples++;
+            _veh[_coupled].open = false;
+        }
+    }
+
+    if (_coupled >= 0) {
+        const double j_mm = (x1(0) + _veh[_coupled].x0) / 2.0;
+        if (std::fabs(j_mm) > magnet_mm) {
+            // off the magnet the knuckles close again
+            _slack_s = 0;
+            _unc_tried = false;
+            _veh[0].open = false;
+        } else if (std::fabs(_v) < 0.5) {
+            _slack_s += dt;
+            if (_slack_s >= 0.2 && !_unc_tried) {
+                _unc_tried = true;
+                _stats.unc_tries++;
+                if (uniform() < _cfg.p_uncouple) {
+                    _stats.unc_opens++;
+                    _veh[0].open = true;
+                }
+            }
+        } else {
+            _slack_s = 0;
+        }
+
+        if (_veh[0].open && dx < 0) {
+            // pulled apart; the car's knuckle stays open (delayed)
+            _veh[_coupled].open = true;
+            _contact = _coupled;
+            _coupled = -1;
+            _veh[0].open = false;
+            _stats.separations++;
+        }
+    }
+
+    // a car left clear of the magnet closes its knuckle
+    for (int v = 1; v < _veh_cnt; v++)
+        if (v != _coupled && v != _contact &&
+            std::fabs(_veh[v].x0) > magnet_mm + 5)
+            _veh[v].open = false;
+}
+
+
+void SimModel::sample()
+{
+    for (int id = 0; id < 4; id++) {
+        double dist_mm = -1;
+        if (id == 0) {
+            dist_mm = std::min(_veh[0].x0 - house_mm, double(wall_mm));
+        } else {
+            double far_mm = -1e9;
+            for (int v = 0; v < _veh_cnt; v++)
+                if (_veh[v].route == id)
+                    far_mm = std::max(far_mm, x1(v));
+            if (far_mm > -1e9)
+                dist_mm = spur_end_mm(id) - far_mm;
+        }
+
+        uint16_t count = Sensor2::count_none;
+        if (dist_mm >= 0) {
+            dist_mm += normal(_cfg.sensor2_sd_mm);
+            long c = 1000 + std::lround(std::max(dist_mm, 0.0) * 4.0 / 3.0);
+            count = std::min(c, long(Sensor2::count_none));
+        }
+
+        _count[id] = count;
+        if (_sample_func != nullptr)
+            _sample_func(id, count);
+    }
+}
+
+
+// Count a cycle each time the loco comes to rest in the scene's end state.
+void SimModel::at_rest()
+{
+    const bool rolling = std::fabs(_v) > 0.5;
+    const bool moving = rolling || _cmd_step != 0;
+
+    if (rolling)
+        _last_dir = (_v > 0) ? 1 : -1;
+
+    if (_moving && !moving) {
+        bool cycle = false;
+        switch (_scene) {
+        case Scene::Circuits:
+            cycle = _veh[0].x0 < house_mm + 100;
+            break;
+        case Scene::UncoupleTest:
+            if (x1(0) < 0)
+                for (int v = 1; v < _veh_cnt; v++)
+                    if (v != _coupled && _veh[v].x0 > 100)
+                        cycle = true;
+            break;
+        case Scene::Stops:
+            cycle = _last_dir > 0 && _veh[0].x0 <= 0 && x1(0) >= 0;
+            break;
+        }
+        if (cycle) {
+            const uint64_t cycle_us = _now_us - _cycle_us;
+            _stats.cycles++;
+            _stats.cycle_min_us = std::min(_stats.cycle_min_us, cycle_us);
+            _stats.cycle_max_us = std::max(_stats.cycle_max_us, cycle_us);
+            _stats.cycle_sum_us += cycle_us;
+            _cycle_us = _now_us;
+        }
+    }
+
+    _moving = moving;
+}
+
+
+void SimModel::check_end()
+{
+    if (_cfg.cycles > 0 && _stats.cycles >= _cfg.cycles)
+        _done = true;
+
+    if (_cfg.time_s > 0 && (_now_us - 1'000'000) >= _cfg.time_s * 1e6)
+        _done = true;
+
+    if (_cfg.hang_s > 0 && (_now_us - _cycle_us) > _cfg.hang_s * 1e6)
+        fail("hang: no cycle in %.0f sec", _cfg.hang_s);
+}
+
+
+void SimModel::fail(const char *fmt, ...)
+{
+    if (_fault[0] == '\0') {
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(_fault, sizeof(_fault), fmt, args);
+        va_end(args);
+    }
+    _done = true;
+}
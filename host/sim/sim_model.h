@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+//
+#include "locos.h"
+
+// Kinematic model of the desktop layout, in virtual time.
+//
+// The track is one line measured in mm from the uncoupler, positive toward
+// the spurs. Each vehicle has a position and a route: 0 while it is left of
+// turnout 0, else the spur it was sent to as it crossed the turnouts (or
+// route_23 between the two turnouts on the way to spur 2 or 3).
+// Vehicles only touch others on the same route, or on the trunk.
+//
+// Time advances by one tick each time the app reads the clock, and the
+// model steps with it. The loco follows its roster speed curve, off by a
+// per-run error, with cv3/cv4 momentum and a braking limit. Couplers engage
+// (usually) when the loco backs into a car. Over the magnet with the slack
+// out they open (usually) and stay open (delayed uncoupling) until the car
+// is pushed clear, though they sometimes engage again, more so in the spur
+// 2 s-curve.
+//
+// The app never sees the end of a run: the clock throws SimDone when the
+// cycle count or time limit is reached, or on a fault (derailment, hitting
+// a bumper, no progress for too long).
+
+struct SimDone {
+};
+
+class SimModel
+{
+public:
+
+    enum class Scene {
+        Circuits,     // loco in house, cars on spurs 1 and 2
+        UncoupleTest, // loco left of uncoupler, car on spur 1 a loco-length
+                      // right of it
+        Stops,        // loco over uncoupler sensor
+    };
+
+    struct Config {
+        uint32_t tick_us = 1'000;
+        uint32_t seed = 1;
+        double speed_err = 0.03;    // sd of the loco speed error (fraction)
+        double p_couple = 0.97;     // couplers engage when loco backs into car
+        double p_uncouple = 0.85;   // magnet opens couplers once slack
+        double p_recouple = 0.03;   // delayed-open couplers engage anyway
+        double p_recouple_s = 0.20; // ... pushed through the spur 2 s-curve
+        double sensor2_sd_mm = 1.5; // distance sensor noise
+        double cdu_recharge_s = 0.8; // a throw sooner than this is too weak
+        int cycles = 0;             // stop after this many (0 = no limit)
+        double time_s = 0;          // stop after this much virtual time
+        double hang_s = 600;        // fault if no cycle for this long
+        bool replay = false;        // clock only; sensors are from a trace
+    };
+
+    struct Stats {
+        int cycles;
+        uint64_t cycle_min_us;
+        uint64_t cycle_max_us;
+        uint64_t cycle_sum_us;
+        int couples;       // couplers engaged
+        int couple_misses; // backed into car without coupling
+        int unc_tries;     // couplers slack over the magnet
+        int unc_opens;     // ... and the magnet opened them
+        int separations;   // loco pulled away from car
+        int recouples;     // delayed-open couplers engaged
+        int throws;        // turnout throws, whether they moved it or not
+        int weak_throws;   // ... before the CDU recharged (didn't move it)
+    };
+
+    // layout, mm from the uncoupler
+    static constexpr int house_mm = -700; // home sensor
+    static constexpr int wall_mm = 210;   // home sensor sees the wall here
+    static constexpr int t0_mm = 200;
+    static constexpr int t1_mm = 400;
+    static constexpr int sturn_mm = 150; // spur 2 s-curve, past t1
+    static constexpr int magnet_mm = 12; // either side of the uncoupler
+    static constexpr int gap_mm = 12;    // between coupled bodies
+    static constexpr int spur_max = 3;
+    static constexpr int route_23 = 4; // past t0 diverging, short of t1
+
+    static int spur_end_mm(int spur);
+
+    SimModel();
+
+    void config(const Config &cfg)
+    {
+        _cfg = cfg;
+    }
+
+    const Config &config() const
+    {
+        return _cfg;
+    }
+
+    void scene(Scene scene, const Loco *loco);
+
+    // App reads the clock: advance one tick. Throws SimDone at the end.
+    uint64_t tick();
+
+    // App sleeps
+    void advance(uint64_t us);
+
+    uint64_t now_us() const
+    {
+        return _now_us;
+    }
+
+    bool done() const
+    {
+        return _done;
+    }
+
+    const char *fault() const
+    {
+        return _fault[0] == '\0' ? nullptr : _fault;
+    }
+
+    const Stats &stats() const
+    {
+        return _stats;
+    }
+
+    double speed_k() const
+    {
+        return _speed_k;
+    }
+
+    const Loco *loco() const
+    {
+        return _loco;
+    }
+
+    // decoder
+    void speed_set(int dcc);
+    void func_set(int f, bool on);
+    void cv_set(int cv, int val);
+    int cv_get(int cv) const;
+
+    // layout
+    bool sensor(int gpio);
+    uint16_t sensor2_count(int id) const;
+    void turnout_set(int idx, bool straight);
+
+    // console: c is typed at at_us (virtual), and key() returns it once,
+    // at or after that; -1 if nothing is due
+    bool key(int c, uint64_t at_us);
+    int key();
+
+    // sensor2 sample hook (the stubs pass counts to Sensor2 callbacks)
+    typedef void(SampleFunc)(int id, uint16_t count);
+    void sample_callback(SampleFunc *func)
+    {
+        _sample_func = func;
+    }
+
+private:
+
+    Config _cfg;
+    Scene _scene;
+    std::mt19937 _rng;
+
+    uint64_t _now_us;
+    bool _done;
+    char _fault[96];
+
+    // decoder
+    const Loco *_loco;
+    static constexpr int cv_max = 1024;
+    uint8_t _cv[cv_max];
+    int _cmd_step;  // commanded, signed
+    double _step;   // after momentum
+    double _v;      // mm/sec, positive is forward (toward the house)
+    double _speed_k; // actual speed / roster speed
+    double _dec_k;   // actual braking / roster braking
+
+    double _unc_at_mm; // where the uncoupler sensor really is
+
+    // vehicles; 0 is the loco, facing the house
+    struct Vehicle {
+        int len_mm;
+        double x0; // left end
+        int route;
+        bool open; // coupler held open (delayed uncoupling)
+    };
+    static constexpr int vehicle_max = 4;
+    Vehicle _veh[vehicle_max];
+    int _veh_cnt;
+
+    int _coupled; // car coupled to the loco, -1 if none
+    int _contact; // uncoupled car touching the loco, -1 if none
+    bool _sturn_tried;
+    double _slack_s; // coupled and stopped over the magnet
+    bool _unc_tried;
+
+    bool _turnout[2]; // true is straight
+    bool _cdu_used;
+    uint64_t _cdu_us; // last throw
+
+    static constexpr uint32_t sample_us = 20'000;
+    uint64_t _sample_us;
+    uint16_t _count[4];
+    SampleFunc *_sample_func;
+
+    struct Key {
+        int c;
+        uint64_t at_us;
+    };
+    static constexpr int key_max = 8;
+    Key _key[key_max];
+    int _key_cnt;
+
+    // cycle detection
+    bool _moving;
+    int _last_dir;
+    uint64_t _cycle_us;
+    Stats _stats;
+
+    double x1(int v) const
+    {
+        return _veh[v].x0 + _veh[v].len_mm;
+    }
+
+    double uniform()
+    {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(_rng);
+    }
+
+    double normal(double sd)
+    {
+        return std::normal_distribution<double>(0.0, sd)(_rng);
+    }
+
+    void step(double dt);
+    void loco_step(double dt);
+    void move(double dx);
+    void route(int v, double old_x1);
+    bool touches(int a, int b) const;
+    void couplers(double dx, double dt);
+    void sample();
+    void at_rest();
+    void check_end();
+    void fail(const char *fmt, ...);
+};
+
+extern SimModel sim_model;
@@ -0,0 +1,283 @@
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+//
+#include "sim_model.h"
+#include "sim_replay.h"
+#include "trace.h"
+
+SimReplay sim_replay;
+
+// how far ahead of the next recorded call to look for the app's call
+static constexpr int window = 16;
+
+// how much of the end of a capture might not have been streamed out
+static constexpr uint32_t tail_us = 1'000'000;
+
+// divergences printed (all are counted)
+static constexpr int show_max = 10;
+
+
+SimReplay::SimReplay() :
+    _active(false),
+    _next(0),
+    _start_us(0),
+    _end_us(0),
+    _app_us(0),
+    _records(0),
+    _lost(0),
+    _matched(0),
+    _skipped(0),
+    _extra(0),
+    _shown(0),
+    _drift_sum_us(0),
+    _drift_max_us(0)
+{
+}
+
+
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+bool SimReplay::load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        if (line[0] != '@')
+            continue;
+        for (const char *p = line + 1; hex_val(p[0]) >= 0; p += 2) {
+            const int hi = hex_val(p[0]);
+            const int lo = hex_val(p[1]);
+            if (lo < 0)
+                break;
+            buf.push_back(uint8_t(hi << 4 | lo));
+        }
+    }
+    fclose(f);
+
+    TraceReader reader(buf.data(), int(buf.size()));
+    TraceRec rec;
+    bool have_start = false;
+    while (reader.next(rec)) {
+        if (rec.kind == TraceRec::Kind::Start) {
+            // only the last session in the log
+            for (int i = 0; i < sensor_max; i++) {
+                _sensor[i].clear();
+                _sensor2[i].clear();
+            }
+            _dcc.clear();
+            _records = 0;
+            _lost = 0;
+            _start_us = rec.time_us;
+            have_start = true;
+        }
+        if (!have_start)
+            continue;
+        _records++;
+        _end_us = rec.time_us;
+        const uint32_t t_us = rec.time_us - _start_us;
+        switch (rec.kind) {
+        case TraceRec::Kind::Sensor:
+            if (rec.a >= 0 && rec.a < sensor_max)
+                _sensor[rec.a].push_back({t_us, rec.b});
+            break;
+        case TraceRec::Kind::Sensor2:
+            if (rec.a >= 0 && rec.a < sensor_max)
+                _sensor2[rec.a].push_back({t_us, rec.b});
+            break;
+        case TraceRec::Kind::Speed:
+        case TraceRec::Kind::Func:
+        case TraceRec::Kind::CvSet:
+        case TraceRec::Kind::CvGet:
+        case TraceRec::Kind::CvBit:
+            rec.time_us = t_us;
+            _dcc.push_back(rec);
+            break;
+        case TraceRec::Kind::Lost:
+            _lost += rec.a;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (reader.pos() < int(buf.size()))
+        fprintf(stderr, "%s: bad trace at byte %d of %d, ignoring the rest\n",
+                path, reader.pos(), int(buf.size()));
+
+    if (!have_start) {
+        fprintf(stderr, "%s: no trace\n", path);
+        return false;
+    }
+
+    _active = true;
+    return true;
+}
+
+
+uint64_t SimReplay::duration_us() const
+{
+    return _end_us - _start_us;
+}
+
+
+void SimReplay::start(uint64_t now_us)
+{
+    _app_us = now_us;
+}
+
+
+// The app's time since the start record.
+uint32_t SimReplay::now_us()
+{
+    return uint32_t(sim_model.now_us() - _app_us);
+}
+
+
+// value at t_us: the last sample at or before it
+int32_t SimReplay::at(const std::vector<Sample> &v, uint32_t t_us,
+                      int32_t none)
+{
+    auto it = std::upper_bound(
+        v.begin(), v.end(), t_us,
+        [](uint32_t t, const Sample &s) { return t < s.t_us; });
+    return (it == v.begin()) ? none : (it - 1)->val;
+}
+
+
+bool SimReplay::sensor(int idx)
+{
+    if (idx < 0 || idx >= sensor_max)
+        return false;
+    return at(_sensor[idx], now_us(), 0) != 0;
+}
+
+
+int SimReplay::sensor2(int idx)
+{
+    if (idx < 0 || idx >= sensor_max)
+        return INT_MAX;
+    const int32_t mm = at(_sensor2[idx], now_us(), TraceRec::dist_none);
+    return (mm >= TraceRec::dist_none) ? INT_MAX : mm;
+}
+
+
+// Find the app's call among the next few recorded ones; n is how many of
+// a, b, c must match.
+const TraceRec *SimReplay::match(TraceRec::Kind kind, int32_t a, int32_t b,
+                                 int32_t c, int n)
+{
+    const uint32_t t_us = now_us();
+    const int end = std::min(_next + window, int(_dcc.size()));
+
+    // At the end of a capture the last records can still be in the
+    // recorder's ring; nothing to compare with.
+    if (_next >= int(_dcc.size()) && t_us + tail_us > duration_us())
+        return nullptr;
+
+    for (int i = _next; i < end; i++) {
+        const TraceRec &rec = _dcc[i];
+        if (rec.kind != kind || rec.a != a || (n > 1 && rec.b != b) ||
+            (n > 2 && rec.c != c))
+            continue;
+        for (int j = _next; j < i; j++)
+            if (_shown++ < show_max)
+                fprintf(stderr, "replay %.3f: recorded %s %d %d not made\n",
+                        _dcc[j].time_us / 1e6,
+                        TraceReader::name(_dcc[j].kind), int(_dcc[j].a),
+                        int(_dcc[j].b));
+        _skipped += i - _next;
+        _next = i + 1;
+        _matched++;
+        const int64_t drift_us = int64_t(t_us) - int64_t(rec.time_us);
+        _drift_sum_us += llabs(drift_us);
+        if (llabs(drift_us) > llabs(_drift_max_us))
+            _drift_max_us = drift_us;
+        return &rec;
+    }
+
+    _extra++;
+    if (_shown++ < show_max)
+        fprintf(stderr, "replay %.3f: %s %d %d not in trace\n", t_us / 1e6,
+                TraceReader::name(kind), int(a), int(b));
+    return nullptr;
+}
+
+
+int SimReplay::speed(int loco, int speed)
+{
+    match(TraceRec::Kind::Speed, loco, speed, 0, 2);
+    return 0;
+}
+
+
+int SimReplay::func(int loco, int f, bool on)
+{
+    match(TraceRec::Kind::Func, loco, f, on ? 1 : 0, 3);
+    return 0;
+}
+
+
+int SimReplay::cv_set(int cv, int val)
+{
+    const TraceRec *rec = match(TraceRec::Kind::CvSet, cv, val, 0, 2);
+    return (rec == nullptr) ? 0 : rec->c;
+}
+
+
+int SimReplay::cv_get(int cv, int &val)
+{
+    const TraceRec *rec = match(TraceRec::Kind::CvGet, cv, 0, 0, 1);
+    if (rec == nullptr) {
+        val = sim_model.cv_get(cv);
+        return 0;
+    }
+    val = rec->b;
+    return rec->c;
+}
+
+
+int SimReplay::cv_bit(int cv, int bit, int val)
+{
+    const TraceRec *rec = match(TraceRec::Kind::CvBit, cv, bit, val, 3);
+    return (rec == nullptr) ? 0 : rec->d;
+}
+
+
+void SimReplay::report(FILE *f) const
+{
+    const int left = int(_dcc.size()) - _next;
+    fprintf(f, "replay: %d records, %.1f sec", _records,
+            duration_us() / 1e6);
+    if (_lost > 0)
+        fprintf(f, ", %d lost in recording", _lost);
+    fprintf(f, "\n");
+    fprintf(f,
+            "replay: dcc calls %d matched, %d skipped, %d extra, "
+            "%d never reached\n",
+            _matched, _skipped, _extra, left);
+    if (_matched > 0)
+        fprintf(f, "replay: drift mean %.1f ms, max %+.1f ms\n",
+                _drift_sum_us / 1e3 / _matched, _drift_max_us / 1e3);
+}
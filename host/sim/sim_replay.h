@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+//
+#include "trace.h"
+
+// Replays a session trace (libraries/track/trace.h) into an app.
+//
+// The sensors read what they read in the session at the same time since
+// the start. The app's DCC calls are matched in order against the recorded
+// ones: a CV read returns the recorded value and every call returns the
+// recorded status, so retries happen where they happened. A call that
+// doesn't match within a few records is a divergence. For each match the
+// difference between the app's time and the recorded time is kept. Once
+// the app reproduces a session, a change in that drift shows a timing
+// regression.
+//
+// The model supplies only the clock; it does no physics while replaying.
+
+class SimReplay
+{
+public:
+
+    SimReplay();
+
+    // Load the "@" lines of a captured log; false if there are none.
+    bool load(const char *path);
+
+    bool active() const
+    {
+        return _active;
+    }
+
+    // length of the trace from its start record
+    uint64_t duration_us() const;
+
+    // The app starts now; the start record was made about then (the first
+    // thing the app does).
+    void start(uint64_t now_us);
+
+    bool sensor(int idx);
+    int sensor2(int idx); // INT_MAX if nothing in range
+
+    // Return the recorded status (0 is ok).
+    int speed(int loco, int speed);
+    int func(int loco, int f, bool on);
+    int cv_set(int cv, int val);
+    int cv_get(int cv, int &val);
+    int cv_bit(int cv, int bit, int val);
+
+    // any call made that wasn't recorded, or recorded and not made
+    bool diverged() const
+    {
+        return _skipped > 0 || _extra > 0 || _next < int(_dcc.size());
+    }
+
+    void report(FILE *f) const;
+
+private:
+
+    bool _active;
+
+    // level or mm, in time order per sensor
+    struct Sample {
+        uint32_t t_us; // since the start record
+        int32_t val;
+    };
+    static constexpr int sensor_max = Trace::sensor_max;
+    std::vector<Sample> _sensor[sensor_max];
+    std::vector<Sample> _sensor2[sensor_max];
+
+    // dcc calls, in order; t_us since the start record
+    std::vector<TraceRec> _dcc;
+    int _next;
+
+    uint32_t _start_us; // start record
+    uint32_t _end_us;   // last record
+    uint64_t _app_us;   // sim time of the start record
+
+    int _records;
+    int _lost;
+    int _matched;
+    int _skipped; // recorded, app didn't make it
+    int _extra;   // app made it, not recorded
+    int _shown;
+    int64_t _drift_sum_us;
+    int64_t _drift_max_us; // largest magnitude, signed
+
+    uint32_t now_us();
+    static int32_t at(const std::vector<Sample> &v, uint32_t t_us,
+                      int32_t none);
+    const TraceRec *match(TraceRec::Kind kind, int32_t a, int32_t b,
+                          int32_t c, int n);
+};
+
+extern SimReplay sim_replay;
@@ -0,0 +1,449 @@
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+// pico (sim)
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/flash.h"
+#include "pico/stdio.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+// dcc, misc, railroad (sim)
+#include "dcc_api.h"
+#include "desktop_layout.h"
+#include "locos.h"
+#include "sensor.h"
+#include "sensor2.h"
+#include "turnout.h"
+// track
+#include "roster_index.h"
+//
+#include "sim_model.h"
+#include "sim_replay.h"
+
+// The library calls the apps make, implemented against the model, or
+// against a recorded session when replaying.
+
+///// pico
+
+
+static struct {
+    alarm_id_t id; // 0 if free
+    uint64_t at_us;
+    alarm_callback_t callback;
+    void *user_data;
+} alarm[8];
+
+static alarm_id_t alarm_next_id = 1;
+static bool irq_off = false;
+static bool in_alarm = false;
+
+
+// Anything due goes off, as if interrupting the app here.
+static void alarms_run()
+{
+    if (irq_off || in_alarm)
+        return;
+    in_alarm = true;
+    const uint64_t now_us = sim_model.now_us();
+    for (auto &a : alarm) {
+        if (a.id == 0 || a.at_us > now_us)
+            continue;
+        const alarm_id_t id = a.id;
+        a.id = 0;
+        const int64_t again_us = a.callback(id, a.user_data);
+        if (again_us != 0 && a.id == 0) {
+            a.id = id;
+            a.at_us = now_us + uint64_t(again_us < 0 ? -again_us : again_us);
+        }
+    }
+    in_alarm = false;
+}
+
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past)
+{
+    if (us == 0 && fire_if_past) {
+        callback(0, user_data);
+        return 0;
+    }
+    for (auto &a : alarm) {
+        if (a.id == 0) {
+            a.id = alarm_next_id++;
+            a.at_us = sim_model.now_us() + us;
+            a.callback = callback;
+            a.user_data = user_data;
+            return a.id;
+        }
+    }
+    return -1;
+}
+
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    for (auto &a : alarm) {
+        if (a.id != 0 && a.id == alarm_id) {
+            a.id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+uint32_t save_and_disable_interrupts()
+{
+    const uint32_t status = irq_off ? 1 : 0;
+    irq_off = true;
+    return status;
+}
+
+
+void restore_interrupts(uint32_t status)
+{
+    irq_off = (status != 0);
+    alarms_run();
+}
+
+
+uint32_t time_us_32()
+{
+    const uint64_t now_us = sim_model.tick();
+    alarms_run();
+    return uint32_t(now_us);
+}
+
+
+uint64_t time_us_64()
+{
+    const uint64_t now_us = sim_model.tick();
+    alarms_run();
+    return now_us;
+}
+
+
+void sleep_ms(uint32_t ms)
+{
+    sim_model.advance(uint64_t(ms) * 1000);
+    alarms_run();
+}
+
+
+void sleep_us(uint64_t us)
+{
+    sim_model.advance(us);
+    alarms_run();
+}
+
+
+bool stdio_init_all()
+{
+    return true;
+}
+
+
+void stdio_flush()
+{
+    fflush(stdout);
+}
+
+
+int stdio_getchar_timeout_us(uint32_t)
+{
+    sim_model.tick();
+    const int c = sim_model.key();
+    if (c >= 0)
+        return c;
+    if (sim_input != nullptr && *sim_input != '\0')
+        return *sim_input++;
+    return ' ';
+}
+
+
+const char *sim_input = nullptr;
+
+
+bool stdio_usb_connected()
+{
+    return true;
+}
+
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    assert(flash_offs % FLASH_SECTOR_SIZE == 0);
+    assert(count % FLASH_SECTOR_SIZE == 0);
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    memset(sim_flash + flash_offs, 0xff, count);
+}
+
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count)
+{
+    assert(flash_offs % FLASH_PAGE_SIZE == 0);
+    assert(count % FLASH_PAGE_SIZE == 0);
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    // programming only clears bits
+    for (size_t i = 0; i < count; i++)
+        sim_flash[flash_offs + i] &= data[i];
+}
+
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t)
+{
+    func(param);
+    return PICO_OK;
+}
+
+
+///// dcc
+
+// how long the decoder operations take on the track
+static constexpr uint64_t svc_us = 200'000;
+static constexpr uint64_t ops_set_us = 50'000;
+static constexpr uint64_t ops_get_us = 100'000;
+
+namespace DccApi {
+
+
+const char *status(Status s)
+{
+    switch (s) {
+    case Status::Ok:
+        return "ok";
+    case Status::Busy:
+        return "busy";
+    default:
+        return "error";
+    }
+}
+
+
+Status init(int, int, int, int, uart_inst_t *)
+{
+    return Status::Ok;
+}
+
+
+Status track_set(bool)
+{
+    return Status::Ok;
+}
+
+
+Status cv_val_set(int cv_num, int cv_val)
+{
+    sim_model.advance(svc_us);
+    if (sim_replay.active())
+        return Status(sim_replay.cv_set(cv_num, cv_val));
+    sim_model.cv_set(cv_num, cv_val);
+    return Status::Ok;
+}
+
+
+Status loco_create(int)
+{
+    return Status::Ok;
+}
+
+
+Status loco_speed_set(int loco_id, int speed)
+{
+    if (sim_replay.active())
+        return Status(sim_replay.speed(loco_id, speed));
+    sim_model.speed_set(speed);
+    return Status::Ok;
+}
+
+
+Status loco_func_set(int loco_id, int func, bool on)
+{
+    if (sim_replay.active())
+        return Status(sim_replay.func(loco_id, func, on));
+    sim_model.func_set(func, on);
+    return Status::Ok;
+}
+
+
+Status loco_cv_val_set(int, int cv_num, int cv_val)
+{
+    sim_model.advance(ops_set_us);
+    if (sim_replay.active())
+        return Status(sim_replay.cv_set(cv_num, cv_val));
+    sim_model.cv_set(cv_num, cv_val);
+    return Status::Ok;
+}
+
+
+Status loco_cv_val_get(int, int cv_num, int &cv_val)
+{
+    sim_model.advance(ops_get_us);
+    if (sim_replay.active())
+        return Status(sim_replay.cv_get(cv_num, cv_val));
+    cv_val = sim_model.cv_get(cv_num);
+    return Status::Ok;
+}
+
+
+Status loco_cv_bit_set(int, int cv_num, int b_num, int b_val)
+{
+    sim_model.advance(ops_set_us);
+    if (sim_replay.active())
+        return Status(sim_replay.cv_bit(cv_num, b_num, b_val));
+    int cv_val = sim_model.cv_get(cv_num);
+    if (b_val != 0)
+        cv_val |= (1 << b_num);
+    else
+        cv_val &= ~(1 << b_num);
+    sim_model.cv_set(cv_num, cv_val);
+    return Status::Ok;
+}
+
+} // namespace DccApi
+
+
+///// locos
+
+// clang-format off
+constexpr Loco Loco::roster[] = {
+    // sn          name      len  min  max   dec  cv63 cv259 hl eng bell horn clank cab
+    {0x1d2c3b4a, "UP852",    210, 12, 420, 1500, 100, 100,  0,  8,  1,   2,   6,    10},
+    {0x0e0f1011, "SW1500",   190,  9, 300, 1200, 0,   -1,   0,  -1, -1,  -1,  -1,   -1},
+};
+// clang-format on
+
+const int Loco::roster_max = sizeof(roster) / sizeof(roster[0]);
+
+static constexpr RosterIndex roster_index(Loco::roster);
+static_assert(roster_index.ok());
+
+
+int Loco::speed_dcc(int mms) const
+{
+    if (mms == 0)
+        return 0;
+    const int a = abs(mms);
+    int step = 1;
+    if (a > mms_min) {
+        const int span = mms_max - mms_min;
+        step = 1 + ((a - mms_min) * 125 + span / 2) / span;
+        if (step > 126)
+            step = 126;
+    }
+    return (mms < 0) ? -step : step;
+}
+
+
+int Loco::speed_mms(int dcc) const
+{
+    if (dcc == 0)
+        return 0;
+    const int step = abs(dcc);
+    const int mms = mms_min + ((step - 1) * (mms_max - mms_min) + 62) / 125;
+    return (dcc < 0) ? -mms : mms;
+}
+
+
+int Loco::stop_mm(int mms) const
+{
+    return (mms * mms + dec_mms2) / (2 * dec_mms2);
+}
+
+
+DccApi::Status Loco::read_sn(int loco_id, uint32_t &sn)
+{
+    sn = 0;
+    for (int cv_num = 268; cv_num >= 265; cv_num--) {
+        int cv_val;
+        DccApi::Status s = DccApi::loco_cv_val_get(loco_id, cv_num, cv_val);
+        if (s != DccApi::Status::Ok)
+            return s;
+        sn = (sn << 8) | cv_val;
+    }
+    return DccApi::Status::Ok;
+}
+
+
+const Loco *Loco::find_loco(uint32_t sn)
+{
+    return roster_index.find(sn);
+}
+
+
+const Loco *Loco::find_loco(const char *name)
+{
+    return roster_index.find(name);
+}
+
+
+///// railroad
+
+Sensor sensor[sensor_max] = {
+    Sensor(sensor_unc_gpio),
+};
+
+Sensor2 sensor2[sensor2_max] = {
+    Sensor2(0), // home
+    Sensor2(1), // spur 1
+    Sensor2(2), // spur 2
+    Sensor2(3), // spur 3
+};
+
+Turnout turnout[turnout_max] = {
+    Turnout(7, 8),
+    Turnout(9, 11),
+};
+
+
+Sensor::operator bool() const
+{
+    if (sim_replay.active())
+        return sim_replay.sensor(int(this - sensor));
+    return sim_model.sensor(_gpio);
+}
+
+
+int Sensor2::dist_mm() const
+{
+    if (sim_replay.active())
+        return sim_replay.sensor2(_id);
+    const int count = sim_model.sensor2_count(_id);
+    if (count >= count_none)
+        return INT_MAX;
+    return ((count - 1000) * 3 + 2) / 4;
+}
+
+
+void Turnout::set(bool straight)
+{
+    sim_model.turnout_set(int(this - turnout), straight);
+}
+
+
+int unc_to_spur_mm(int spur)
+{
+    return SimModel::spur_end_mm(spur);
+}
+
+
+void line_turnout_0(int spur)
+{
+    turnout[0].set(spur == 1);
+}
+
+
+void line_turnout_1(int spur)
+{
+    if (spur != 1)
+        turnout[1].set(spur == 2);
+}
@@ -0,0 +1,150 @@
+
+#include <cstdint>
+#include <cstdio>
+//
+#include "blocks.h"
+
+
+Blocks::Blocks(int block_cnt, const char *const *name, SenseFunc *sense,
+               intptr_t sense_arg) :
+    _block_cnt(block_cnt < block_max ? block_cnt : block_max),
+    _name(name),
+    _sense(sense),
+    _sense_arg(sense_arg),
+    _sensed(false),
+    _owner{},
+    _occupied{},
+    _turnout_owner{},
+    _request{},
+    _request_cnt(0)
+{
+    for (int b = 0; b < block_max; b++)
+        _owner[b] = none;
+    for (int t = 0; t < turnout_max; t++)
+        _turnout_owner[t] = none;
+}
+
+
+bool Blocks::overlap(const Route &a, const Route &b)
+{
+    return (a.blocks & b.blocks) != 0 || (a.turnouts & b.turnouts) != 0;
+}
+
+
+// Nobody else holds any of route.
+bool Blocks::free_for(int train, const Route &route) const
+{
+    for (int b = 0; b < _block_cnt; b++)
+        if ((route.blocks & (1u << b)) != 0 && _owner[b] != none &&
+            _owner[b] != train)
+            return false;
+    for (int t = 0; t < turnout_max; t++)
+        if ((route.turnouts & (1u << t)) != 0 && _turnout_owner[t] != none &&
+            _turnout_owner[t] != train)
+            return false;
+    return true;
+}
+
+
+void Blocks::remove(int i)
+{
+    for (int j = i + 1; j < _request_cnt; j++)
+        _request[j - 1] = _request[j];
+    _request_cnt--;
+}
+
+
+bool Blocks::reserve(int train, const Route &route)
+{
+    // train's place in line, if it's been waiting
+    int mine = -1;
+    for (int i = 0; i < _request_cnt && mine < 0; i++)
+        if (_request[i].train == train)
+            mine = i;
+
+    // anyone ahead of it that wants any of the same things goes first
+    const int ahead = (mine >= 0) ? mine : _request_cnt;
+    bool clear = free_for(train, route);
+    for (int i = 0; i < ahead && clear; i++)
+        if (overlap(_request[i].route, route))
+            clear = false;
+
+    if (!clear) {
+        if (mine >= 0) {
+            _request[mine].route = route;
+        } else if (_request_cnt < request_max) {
+            _request[_request_cnt].train = int8_t(train);
+            _request[_request_cnt].route = route;
+            _request_cnt++;
+        }
+        return false;
+    }
+
+    if (mine >= 0)
+        remove(mine);
+    for (int b = 0; b < _block_cnt; b++)
+        if ((route.blocks & (1u << b)) != 0)
+            _owner[b] = int8_t(train);
+    for (int t = 0; t < turnout_max; t++)
+        if ((route.turnouts & (1u << t)) != 0)
+            _turnout_owner[t] = int8_t(train);
+    return true;
+}
+
+
+void Blocks::cancel(int train)
+{
+    for (int i = 0; i < _request_cnt; i++) {
+        if (_request[i].train == train) {
+            remove(i);
+            return;
+        }
+    }
+}
+
+
+void Blocks::release(int train, int block)
+{
+    if (block >= 0 && block < _block_cnt && _owner[block] == train)
+        _owner[block] = none;
+}
+
+
+void Blocks::release(int train)
+{
+    for (int b = 0; b < _block_cnt; b++)
+        if (_owner[b] == train)
+            _owner[b] = none;
+    for (int t = 0; t < turnout_max; t++)
+        if (_turnout_owner[t] == train)
+            _turnout_owner[t] = none;
+}
+
+
+void Blocks::loop()
+{
+    for (int b = 0; b < _block_cnt; b++) {
+        const bool occ = _sense(b, _sense_arg);
+        if (_sensed && occ && !_occupied[b] && _owner[b] == none)
+            printf("blocks: %s occupied, not reserved\n", _name[b]);
+        _occupied[b] = occ;
+    }
+    _sensed = true;
+}
+
+
+void Blocks::print() const
+{
+    printf("blocks:");
+    for (int b = 0; b < _block_cnt; b++) {
+        printf(" %s%s", _name[b], _occupied[b] ? "*" : "");
+        if (_owner[b] != none)
+            printf("(%d)", _owner[b]);
+    }
+    printf("\n");
+    for (int t = 0; t < turnout_max; t++)
+        if (_turnout_owner[t] != none)
+            printf("  turnout %d held by %d\n", t, _turnout_owner[t]);
+    for (int i = 0; i < _request_cnt; i++)
+        printf("  %d waiting\n", _request[i].train);
+}
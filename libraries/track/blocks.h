@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+
+// Block occupancy and reservations, so more than one train can share a
+// layout.
+//
+// The layout is cut into blocks, each with a way to sense whether
+// anything is in it (a sensor, or a distance sensor's reading in range),
+// and turnouts. A train reserves a route (the blocks and turnouts it's
+// going to use) before it moves. A route whose blocks and turnouts are
+// free, or already the train's own, is granted at once. Otherwise the
+// request waits its turn: a train asks again (e.g. each time around its
+// loop) until it's granted, and conflicting requests are granted in the
+// order they were first made, so one train can't starve another. A
+// turnout in a reservation is locked, and only the train holding it may
+// throw it. Blocks stay reserved until the train releases them.
+//
+// loop() senses every block, and complains when a block that nobody has
+// reserved becomes occupied (a train where it shouldn't be, or a car
+// that rolled). Whatever is there the first time is taken as parked.
+
+class Blocks
+{
+public:
+
+    static constexpr int block_max = 16;
+    static constexpr int turnout_max = 8;
+    static constexpr int request_max = 8;
+    static constexpr int none = -1;
+
+    struct Route {
+        uint16_t blocks;  // bit per block
+        uint8_t turnouts; // bit per turnout
+    };
+
+    // true if anything is in block
+    typedef bool(SenseFunc)(int block, intptr_t arg);
+
+    Blocks(int block_cnt, const char *const *name, SenseFunc *sense,
+           intptr_t sense_arg = 0);
+
+    // Reserve route for train; false if it has to wait (ask again).
+    bool reserve(int train, const Route &route);
+
+    // Stop waiting for a route.
+    void cancel(int train);
+
+    void release(int train, int block);
+
+    // Everything the train holds.
+    void release(int train);
+
+    int owner(int block) const
+    {
+        return _owner[block];
+    }
+
+    bool occupied(int block) const
+    {
+        return _occupied[block];
+    }
+
+    // Whether train holds turnout (and so may throw it).
+    bool holds(int train, int turnout) const
+    {
+        return _turnout_owner[turnout] == train;
+    }
+
+    void loop();
+
+    void print() const;
+
+private:
+
+    int _block_cnt;
+    const char *const *_name;
+    SenseFunc *_sense;
+    intptr_t _sense_arg;
+    bool _sensed; // loop() has been called
+
+    int8_t _owner[block_max];
+    bool _occupied[block_max];
+    int8_t _turnout_owner[turnout_max];
+
+    struct Request {
+        int8_t train;
+        Route route;
+    };
+
+    // waiting, oldest first
+    Request _request[request_max];
+    int _request_cnt;
+
+    bool free_for(int train, const Route &route) const;
+    static bool overlap(const Route &a, const Route &b);
+    void remove(int i);
+};
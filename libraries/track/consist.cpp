@@ -0,0 +1,157 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+// dcc
+#include "dcc_api.h"
+// railroad
+#include "locos.h"
+//
+#include "consist.h"
+
+using Status = DccApi::Status;
+
+
+Consist::Consist(int address) :
+    _address(address),
+    _member{},
+    _member_cnt(0)
+{
+}
+
+
+bool Consist::add(int loco_id, const Loco *loco, bool reversed)
+{
+    if (_member_cnt >= member_max || loco == nullptr)
+        return false;
+    for (int m = 0; m < _member_cnt; m++)
+        if (_member[m].loco_id == loco_id)
+            return false;
+    _member[_member_cnt++] = {loco_id, loco, reversed};
+    return true;
+}
+
+
+// Every member's CV19; stops at the first one that fails.
+Status Consist::cv19(int val)
+{
+    for (int m = 0; m < _member_cnt; m++) {
+        const Member &mb = _member[m];
+        const int v = (val == 0) ? 0 : (val | (mb.reversed ? 0x80 : 0));
+        Status s = DccApi::loco_cv_val_set(mb.loco_id, 19, v);
+        if (s != Status::Ok) {
+            printf("consist %d: loco %d cv19=%d: %s\n", _address, mb.loco_id,
+                   v, DccApi::status(s));
+            return s;
+        }
+    }
+    return Status::Ok;
+}
+
+
+Status Consist::assign()
+{
+    if (_address < 1 || _address > 127 || _member_cnt == 0)
+        return Status::Error;
+    Status s = DccApi::loco_create(_address);
+    if (s != Status::Ok)
+        return s;
+    // stopped before any member starts listening to it
+    s = DccApi::loco_speed_set(_address, 0);
+    if (s != Status::Ok)
+        return s;
+    return cv19(_address);
+}
+
+
+Status Consist::dissolve()
+{
+    DccApi::loco_speed_set(_address, 0);
+    return cv19(0);
+}
+
+
+Status Consist::speed_set(int mms)
+{
+    return DccApi::loco_speed_set(_address, speed_dcc(mms));
+}
+
+
+// The step with the least total error over the members. Curves only go up
+// with the step, so the search stops once it's past.
+int Consist::speed_dcc(int mms) const
+{
+    if (mms == 0 || _member_cnt == 0)
+        return 0;
+    const int want = abs(mms);
+
+    int best = 1;
+    int best_err = -1;
+    for (int s = 1; s <= 126; s++) {
+        int err = 0;
+        int below = 0;
+        for (int m = 0; m < _member_cnt; m++) {
+            const int got = _member[m].loco->speed_mms(s);
+            err += abs(got - want);
+            if (got < want)
+                below++;
+        }
+        if (best_err < 0 || err < best_err) {
+            best = s;
+            best_err = err;
+        }
+        if (below == 0)
+            break;
+    }
+    return (mms < 0) ? -best : best;
+}
+
+
+int Consist::mms_max() const
+{
+    int mms = 0;
+    for (int m = 0; m < _member_cnt; m++) {
+        const int top = _member[m].loco->speed_mms(126);
+        if (m == 0 || top < mms)
+            mms = top;
+    }
+    return mms;
+}
+
+
+// Fastest member less slowest, at a step.
+int Consist::mismatch_mms(int dcc) const
+{
+    int lo = 0;
+    int hi = 0;
+    for (int m = 0; m < _member_cnt; m++) {
+        const int mms = abs(_member[m].loco->speed_mms(dcc));
+        if (m == 0 || mms < lo)
+            lo = mms;
+        if (m == 0 || mms > hi)
+            hi = mms;
+    }
+    return hi - lo;
+}
+
+
+void Consist::print() const
+{
+    printf("consist %d: %d locos, top speed %d mm/s\n", _address, _member_cnt,
+           mms_max());
+    for (int m = 0; m < _member_cnt; m++) {
+        const Member &mb = _member[m];
+        printf("  %-8s loco %d%s\n", mb.loco->name, mb.loco_id,
+               mb.reversed ? " (reversed)" : "");
+    }
+    printf("  step");
+    for (int m = 0; m < _member_cnt; m++)
+        printf("  %8s", _member[m].loco->name);
+    printf("  apart\n");
+    for (int s = 14; s <= 126; s += 28) {
+        printf("  %4d", s);
+        for (int m = 0; m < _member_cnt; m++)
+            printf("  %8d", _member[m].loco->speed_mms(s));
+        printf("  %5d\n", mismatch_mms(s));
+    }
+}
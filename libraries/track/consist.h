@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+// dcc
+#include "dcc_api.h"
+
+struct Loco;
+
+// Advanced consist: several locos that take one speed packet.
+//
+// assign() writes the consist address to each member's CV19 (ops mode),
+// with bit 7 set for a member that runs backwards in the consist, so the
+// decoders sort out direction themselves. From then on speed_set() sends
+// to the consist address only, one packet for the whole train, and the
+// members can't get out of step with each other. dissolve() puts CV19
+// back to 0. Functions still go to each member's own address (CV21/22
+// are left alone), so each loco keeps its own horn and lights.
+//
+// Every member gets the same step, so they pull together only as well as
+// their curves agree. speed_dcc() picks the step that puts the members,
+// taken together, closest to the speed asked for; mismatch_mms() says how
+// far apart they are at a step, and mms_max() is as fast as the slowest
+// one goes. The curves are the members' Locos' own.
+
+class Consist
+{
+public:
+
+    static constexpr int member_max = 4;
+
+    // 1..127 (CV19 holds a short address)
+    Consist(int address);
+
+    int address() const
+    {
+        return _address;
+    }
+
+    // Lead first. False if it's full or the loco is already in it.
+    bool add(int loco_id, const Loco *loco, bool reversed = false);
+
+    DccApi::Status assign();
+    DccApi::Status dissolve();
+
+    // Signed mm/sec; negative is the lead's reverse.
+    DccApi::Status speed_set(int mms);
+
+    int speed_dcc(int mms) const;
+    int mms_max() const;
+    int mismatch_mms(int dcc) const;
+
+    void print() const;
+
+private:
+
+    int _address;
+
+    struct Member {
+        int loco_id;
+        const Loco *loco;
+        bool reversed;
+    };
+    Member _member[member_max];
+    int _member_cnt;
+
+    DccApi::Status cv19(int val);
+};
@@ -0,0 +1,89 @@
+
+#include <cstdint>
+#include <cstdio>
+// dcc
+#include "dcc_api.h"
+//
+#include "cv_batch.h"
+
+using Status = DccApi::Status;
+
+
+CvBatch::CvBatch(int loco_id) :
+    _loco_id(loco_id),
+    _cv{},
+    _cv_cnt(0),
+    _writes(0),
+    _reads(0),
+    _rounds(0)
+{
+}
+
+
+bool CvBatch::add(int cv_num, int cv_val)
+{
+    if (cv_val < 0 || cv_val > 255)
+        return false;
+    for (int i = 0; i < _cv_cnt; i++) {
+        if (_cv[i].num == cv_num) {
+            _cv[i].val = uint8_t(cv_val);
+            _cv[i].state = State::Write;
+            return true;
+        }
+    }
+    if (_cv_cnt >= cv_max)
+        return false;
+    _cv[_cv_cnt++] = {uint16_t(cv_num), uint8_t(cv_val), State::Write};
+    return true;
+}
+
+
+int CvBatch::write(int round_max)
+{
+    int left = 0;
+    for (int round = 0; round < round_max; round++) {
+        _rounds++;
+
+        for (int i = 0; i < _cv_cnt; i++) {
+            Cv &cv = _cv[i];
+            if (cv.state != State::Write)
+                continue;
+            _writes++;
+            if (DccApi::loco_cv_val_set(_loco_id, cv.num, cv.val) == Status::Ok)
+                cv.state = State::Read;
+        }
+
+        left = 0;
+        for (int i = 0; i < _cv_cnt; i++) {
+            Cv &cv = _cv[i];
+            if (cv.state == State::Read) {
+                _reads++;
+                int val = -1;
+                Status s = DccApi::loco_cv_val_get(_loco_id, cv.num, val);
+                if (s == Status::Ok)
+                    cv.state = (val == cv.val) ? State::Ok : State::Write;
+            }
+            if (cv.state != State::Ok)
+                left++;
+        }
+
+        if (left == 0)
+            break;
+    }
+    return left;
+}
+
+
+void CvBatch::print() const
+{
+    int ok = 0;
+    for (int i = 0; i < _cv_cnt; i++)
+        if (_cv[i].state == State::Ok)
+            ok++;
+    printf("cvs: %d of %d verified; %d writes, %d reads, %d rounds\n", ok,
+           _cv_cnt, _writes, _reads, _rounds);
+    for (int i = 0; i < _cv_cnt; i++)
+        if (_cv[i].state != State::Ok)
+            printf("  cv%u = %u not verified\n", unsigned(_cv[i].num),
+                   unsigned(_cv[i].val));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+// dcc
+#include "dcc_api.h"
+
+// Ops-mode cv writes as a batch, each one read back.
+//
+// write() sends every cv, then reads them all back; a cv that reads back
+// wrong is written again, and one that couldn't be read is read again,
+// for up to round_max rounds. Writing them all before reading any gives
+// the decoder time to finish each one (some are slow to commit to
+// eeprom), rather than waiting on each cv in turn.
+
+class CvBatch
+{
+public:
+
+    static constexpr int cv_max = 40;
+
+    CvBatch(int loco_id);
+
+    // Replaces cv_num's value if it's already in the batch.
+    bool add(int cv_num, int cv_val);
+
+    // Returns how many cvs aren't verified (0 if all are).
+    int write(int round_max = 3);
+
+    void print() const;
+
+private:
+
+    int _loco_id;
+
+    enum class State : uint8_t {
+        Write, // to be written
+        Read,  // written, to be read back
+        Ok,
+    };
+
+    struct Cv {
+        uint16_t num;
+        uint8_t val;
+        State state;
+    };
+    Cv _cv[cv_max];
+    int _cv_cnt;
+
+    // stats
+    int _writes;
+    int _reads;
+    int _rounds;
+};
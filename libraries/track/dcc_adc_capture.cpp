@@ -0,0 +1,326 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico/stdio.h"
+#include "pico/stdlib.h"
+//
+#include "dcc_adc_capture.h"
+
+
+DccAdcCapture::DccAdcCapture(int gpio, int rate_hz) :
+    _gpio(gpio),
+    _rate_hz(rate_hz),
+    _running(false),
+    _dma_data(-1),
+    _dma_ctrl(-1),
+    _block_count(block_len),
+    _block_func(nullptr),
+    _block_arg(0),
+    _block_idx(0),
+    _mode(Trigger::None),
+    _level(0),
+    _pre(0),
+    _state(State::Idle),
+    _scan_idx(0),
+    _trig_idx(0),
+    _post_need(0),
+    _prev(0),
+    _overruns(0),
+    _mark_cnt(0),
+    _window_len(0),
+    _window_trig(-1),
+    _window_mark_cnt(0)
+{
+    assert(rate_hz > 0);
+}
+
+
+DccAdcCapture *DccAdcCapture::_irq_capture = nullptr;
+
+
+DccAdcCapture::~DccAdcCapture()
+{
+    stop();
+}
+
+
+void DccAdcCapture::block_callback(BlockFunc *func, intptr_t arg)
+{
+    assert(!_running);
+    _block_func = func;
+    _block_arg = arg;
+}
+
+
+void DccAdcCapture::start()
+{
+    if (_running)
+        return;
+
+    adc_init();
+    adc_gpio_init(_gpio);
+    adc_select_input(_gpio - ADC_BASE_PIN);
+
+    // one conversion per (1 + div) adc clocks
+    float div = float(clock_get_hz(clk_adc)) / _rate_hz - 1.0f;
+    adc_set_clkdiv(div);
+
+    // fifo on, dreq on at 1 sample, no error bit, no byte shift
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_fifo_drain();
+
+    if (_dma_data < 0)
+        _dma_data = dma_claim_unused_channel(true);
+    if (_dma_ctrl < 0)
+        _dma_ctrl = dma_claim_unused_channel(true);
+
+    // data channel: adc fifo -> ring, wrapping on the ring size, and chained
+    // to the control channel when a block is done
+    dma_channel_config dc = dma_channel_get_default_config(_dma_data);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_16);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_ring(&dc, true, ring_bits);
+    channel_config_set_dreq(&dc, DREQ_ADC);
+    channel_config_set_chain_to(&dc, _dma_ctrl);
+    dma_channel_configure(_dma_data, &dc, _ring, &adc_hw->fifo, block_len,
+                          false);
+
+    // control channel: rewrite the data channel's count, which retriggers it
+    // (the write address just carries on, wrapping at the end of the ring)
+    dma_channel_config cc = dma_channel_get_default_config(_dma_ctrl);
+    channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+    channel_config_set_read_increment(&cc, false);
+    channel_config_set_write_increment(&cc, false);
+    dma_channel_configure(_dma_ctrl, &cc,
+                          &dma_hw->ch[_dma_data].al1_transfer_count_trig,
+                          &_block_count, 1, false);
+
+    _scan_idx = 0;
+    _prev = 0;
+    _mark_cnt = 0;
+    _block_idx = 0;
+
+    if (_block_func != nullptr) {
+        assert(_irq_capture == nullptr || _irq_capture == this);
+        _irq_capture = this;
+        dma_channel_acknowledge_irq1(_dma_data);
+        dma_channel_set_irq1_enabled(_dma_data, true);
+        irq_add_shared_handler(DMA_IRQ_1, dma_irq,
+                               PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+        irq_set_priority(DMA_IRQ_1, PICO_HIGHEST_IRQ_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+
+    dma_channel_start(_dma_data);
+    adc_run(true);
+
+    _running = true;
+}
+
+
+void DccAdcCapture::stop()
+{
+    if (!_running)
+        return;
+
+    adc_run(false);
+    if (_block_func != nullptr) {
+        dma_channel_set_irq1_enabled(_dma_data, false);
+        irq_remove_handler(DMA_IRQ_1, dma_irq);
+        _irq_capture = nullptr;
+    }
+    dma_channel_abort(_dma_ctrl);
+    dma_channel_abort(_dma_data);
+    adc_fifo_drain();
+
+    _running = false;
+}
+
+
+int DccAdcCapture::write_idx() const
+{
+    uintptr_t addr = dma_channel_hw_addr(_dma_data)->write_addr;
+    return ((addr - uintptr_t(_ring)) / sizeof(uint16_t)) & ring_mask;
+}
+
+
+// DMA_IRQ_1 handler; passes each completed block to the block callback. If
+// the interrupt was held off for longer than a block, it catches up on all
+// the blocks completed since the last one.
+void DccAdcCapture::dma_irq()
+{
+    DccAdcCapture *c = _irq_capture;
+
+    if (c == nullptr || !dma_channel_get_irq1_status(c->_dma_data))
+        return;
+
+    dma_channel_acknowledge_irq1(c->_dma_data);
+
+    // start of the block the dma is writing now
+    const int cur_idx = c->write_idx() & ~(block_len - 1);
+
+    while (c->_block_idx != cur_idx) {
+        c->_block_func(&c->_ring[c->_block_idx], c->_block_idx, c->_block_arg);
+        c->_block_idx = (c->_block_idx + block_len) & ring_mask;
+    }
+}
+
+
+void DccAdcCapture::copy(uint16_t *buf, int end_idx, int len) const
+{
+    assert(0 <= len && len <= ring_len);
+    const int start_idx = end_idx - len;
+    for (int i = 0; i < len; i++)
+        buf[i] = _ring[(start_idx + i) & ring_mask];
+}
+
+
+void DccAdcCapture::packet()
+{
+    if (!_running)
+        return;
+
+    uint32_t n = _mark_cnt;
+    Mark &m = _mark[n % mark_max];
+    m.time_us = time_us_32();
+    m.idx = write_idx();
+    _mark_cnt = n + 1;
+}
+
+
+void DccAdcCapture::trigger(Trigger mode, uint16_t level, int pre)
+{
+    assert(0 <= pre && pre < window_max);
+
+    _mode = mode;
+    _level = level;
+    _pre = pre;
+
+    if (mode == Trigger::None) {
+        _state = State::Idle;
+        return;
+    }
+
+    if (_running) {
+        _scan_idx = write_idx();
+        _prev = _ring[(_scan_idx - 1) & ring_mask];
+    }
+    _state = State::Armed;
+}
+
+
+void DccAdcCapture::loop()
+{
+    if (!_running)
+        return;
+
+    if (_state == State::Armed) {
+
+        const int end_idx = write_idx();
+        int cnt = (end_idx - _scan_idx) & ring_mask;
+
+        if (cnt > (ring_len - window_max)) {
+            // Fell behind far enough that the pre-trigger samples for
+            // anything found now may already be overwritten. Start over
+            // from the newest sample.
+            _overruns++;
+            _scan_idx = end_idx;
+            _prev = _ring[(end_idx - 1) & ring_mask];
+            return;
+        }
+
+        while (cnt-- > 0) {
+            const uint16_t s = _ring[_scan_idx];
+            bool hit = false;
+            if (_mode == Trigger::Level)
+                hit = (s >= _level);
+            else if (_mode == Trigger::Rising)
+                hit = (_prev < _level && s >= _level);
+            else if (_mode == Trigger::Falling)
+                hit = (_prev >= _level && s < _level);
+            _prev = s;
+            if (hit) {
+                _trig_idx = _scan_idx;
+                _post_need = window_max - _pre;
+                _state = State::Post;
+                break;
+            }
+            _scan_idx = (_scan_idx + 1) & ring_mask;
+        }
+    }
+
+    if (_state == State::Post) {
+        int have = (write_idx() - _trig_idx) & ring_mask;
+        if (have >= _post_need) {
+            freeze((_trig_idx + _post_need) & ring_mask, _pre);
+            _state = State::Done;
+        }
+    }
+}
+
+
+uint16_t DccAdcCapture::last() const
+{
+    if (!_running)
+        return 0;
+    return _ring[(write_idx() - 1) & ring_mask];
+}
+
+
+// Copy the window_max samples ending just before end_idx out of the ring,
+// along with the packet marks that fall inside it.
+void DccAdcCapture::freeze(int end_idx, int trig_pos)
+{
+    const int start_idx = (end_idx - window_max) & ring_mask;
+
+    copy(_window, end_idx, window_max);
+    _window_len = window_max;
+    _window_trig = trig_pos;
+
+    // A mark older than one pass through the ring would alias onto a newer
+    // position, so only look at marks newer than that.
+    const uint32_t ring_us = uint32_t(uint64_t(ring_len) * 1'000'000 / _rate_hz);
+    const uint32_t now_us = time_us_32();
+    const uint32_t mark_cnt = _mark_cnt;
+    const uint32_t first = (mark_cnt > mark_max) ? (mark_cnt - mark_max) : 0;
+
+    _window_mark_cnt = 0;
+    for (uint32_t n = first; n < mark_cnt; n++) {
+        const Mark &m = _mark[n % mark_max];
+        if ((now_us - m.time_us) >= ring_us)
+            continue;
+        int pos = (m.idx - start_idx) & ring_mask;
+        if (pos < _window_len)
+            _window_mark[_window_mark_cnt++] = pos;
+    }
+}
+
+
+void DccAdcCapture::export_window()
+{
+    if (_state != State::Done) {
+        if (!_running)
+            return;
+        freeze(write_idx(), -1);
+    }
+
+    printf("capture %d %d %d %d", _window_len, _rate_hz, _window_trig,
+           _window_mark_cnt);
+    for (int i = 0; i < _window_mark_cnt; i++)
+        printf(" %d", _window_mark[i]);
+    printf("\n");
+    stdio_flush();
+
+    for (int i = 0; i < _window_len; i++) {
+        putchar_raw(_window[i] & 0xff);
+        putchar_raw(_window[i] >> 8);
+    }
+    stdio_flush();
+}
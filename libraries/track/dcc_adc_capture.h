@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+
+// Continuous capture of the track current.
+//
+// The ADC free-runs on the current-sense input and a DMA channel writes the
+// conversions into a ring buffer, block_len samples at a time. A second DMA
+// channel re-arms the first each time it finishes a block, so once started
+// the capture runs with no CPU involvement per sample.
+//
+// If a block callback is set, it is called from the DMA interrupt with each
+// completed block. That is the hook for anything that has to see every
+// sample with low latency (e.g. DccFastTrip), so the interrupt gets the
+// highest priority, ahead of DccTx's.
+//
+// packet() marks the ring position between two packets, so the waveform
+// can be lined up with the packet that caused it (decoder acks, RailCom
+// cutouts, motor load). Call it from DccTx's end callback: the mark is
+// where a packet's end bit starts, with the cutout and the next packet's
+// preamble after it.
+//
+// A trigger (level or edge) freezes a window of samples around the event,
+// with a configurable number of samples kept from before the event. The
+// frozen window (or the most recent samples if no trigger is armed) is sent
+// to the host with export_window().
+//
+// The capture owns the ADC while it is running. DccAdc only needs the ADC
+// for service-mode acks, so stop() the capture before using service mode.
+
+class DccAdcCapture
+{
+public:
+
+    enum class Trigger {
+        None,    // free-run; export sends the most recent window
+        Level,   // first sample at or above level
+        Rising,  // sample goes from below level to at or above it
+        Falling, // sample goes from at or above level to below it
+    };
+
+    DccAdcCapture(int gpio, int rate_hz = rate_hz_dflt);
+    ~DccAdcCapture();
+
+    // Called from the DMA interrupt with each completed block. Set before
+    // start(); only one callback is supported.
+    typedef void(BlockFunc)(const uint16_t *blk, int idx, intptr_t arg);
+    void block_callback(BlockFunc *func, intptr_t arg);
+
+    // Copy the 'len' samples ending just before ring index 'end_idx' into
+    // 'buf' (interrupt safe).
+    void copy(uint16_t *buf, int end_idx, int len) const;
+
+    void start();
+    void stop();
+
+    bool running() const
+    {
+        return _running;
+    }
+
+    int rate_hz() const
+    {
+        return _rate_hz;
+    }
+
+    // Mark a packet boundary (interrupt safe).
+    void packet();
+
+    // Arm the trigger. 'pre' samples before the trigger point are kept.
+    void trigger(Trigger mode, uint16_t level, int pre = window_max / 4);
+
+    // True once a triggered window has been frozen.
+    bool triggered() const
+    {
+        return _state == State::Done;
+    }
+
+    // Scan new samples for the trigger. Call from the main loop; it has to
+    // run at least once per pass through the ring or samples are skipped.
+    void loop();
+
+    // Most recent sample (raw counts).
+    uint16_t last() const;
+
+    // Send a window to the host over stdio: one text header line, then the
+    // samples as raw little-endian uint16.
+    //   capture <samples> <rate_hz> <trigger_pos> <marks> [<mark_pos> ...]
+    // trigger_pos is -1 if the window was not triggered.
+    void export_window();
+
+    // How many times loop() fell more than a ring behind.
+    uint32_t overruns() const
+    {
+        return _overruns;
+    }
+
+    static constexpr int rate_hz_dflt = 100'000;
+
+    // Ring length must be a power of two for the DMA ring wrap.
+    static constexpr int ring_bits = 13; // bytes, log2
+    static constexpr int ring_len = (1 << ring_bits) / sizeof(uint16_t);
+    static constexpr int ring_mask = ring_len - 1;
+
+    // DMA block size, which sets the block callback latency (16 us at
+    // 250 kHz); must divide ring_len
+    static constexpr int block_len = 4;
+    static_assert((ring_len % block_len) == 0);
+
+    static constexpr int window_max = 1024;
+
+    static constexpr int mark_max = 32;
+
+private:
+
+    enum class State {
+        Idle,  // not armed
+        Armed, // looking for the trigger
+        Post,  // triggered, collecting samples after trigger
+        Done,  // window frozen
+    };
+
+    int _gpio;
+    int _rate_hz;
+    bool _running;
+
+    int _dma_data;
+    int _dma_ctrl;
+
+    // the control channel copies this into the data channel's count
+    uint32_t _block_count;
+
+    BlockFunc *_block_func;
+    intptr_t _block_arg;
+    int _block_idx; // next block to pass to _block_func
+
+    static DccAdcCapture *_irq_capture;
+    static void dma_irq();
+
+    Trigger _mode;
+    uint16_t _level;
+    int _pre;
+    volatile State _state;
+    int _scan_idx;  // next sample loop() will look at
+    int _trig_idx;  // ring index of trigger sample
+    int _post_need; // samples still needed after trigger
+    uint16_t _prev; // sample before _scan_idx (for edges)
+    uint32_t _overruns;
+
+    // packet start marks; written from interrupt context
+    struct Mark {
+        uint32_t time_us;
+        uint16_t idx;
+    };
+    Mark _mark[mark_max];
+    volatile uint32_t _mark_cnt;
+
+    // frozen window
+    uint16_t _window[window_max];
+    int _window_len;
+    int _window_trig; // -1 if not triggered
+    int16_t _window_mark[mark_max];
+    int _window_mark_cnt;
+
+    int write_idx() const;
+    void freeze(int end_idx, int trig_pos);
+
+    alignas(1 << ring_bits) uint16_t _ring[ring_len];
+};
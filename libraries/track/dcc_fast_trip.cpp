@@ -0,0 +1,201 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/gpio.h"
+#include "pico/stdio.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+//
+#include "dcc_adc_capture.h"
+#include "dcc_fast_trip.h"
+
+
+DccFastTrip::DccFastTrip(DccAdcCapture &capture, int pwr_gpio,
+                         uint16_t trip_level, int trip_cnt) :
+    _capture(capture),
+    _pwr_gpio(pwr_gpio),
+    _trip_level(trip_level),
+    _trip_cnt(trip_cnt),
+    _blank_us(0),
+    _blank_level(trip_level),
+    _retry_max(0),
+    _retry_us(0),
+    _retry_max_us(0),
+    _state(State::On),
+    _on_us(0),
+    _over(0),
+    _retry(0),
+    _wait_us(0),
+    _alarm(0),
+    _log_cnt(0)
+{
+    assert(trip_cnt >= 1);
+}
+
+
+void DccFastTrip::blanking(uint32_t blank_us, uint16_t blank_level)
+{
+    assert(blank_level >= _trip_level);
+    _blank_us = blank_us;
+    _blank_level = blank_level;
+}
+
+
+void DccFastTrip::retry(int retry_max, uint32_t retry_us,
+                        uint32_t retry_max_us)
+{
+    assert(retry_max >= 0);
+    assert(retry_us <= retry_max_us);
+    _retry_max = retry_max;
+    _retry_us = retry_us;
+    _retry_max_us = retry_max_us;
+}
+
+
+void DccFastTrip::init()
+{
+    _capture.block_callback(block, intptr_t(this));
+}
+
+
+void DccFastTrip::power_on()
+{
+    _on_us = time_us_32();
+    _over = 0;
+}
+
+
+void DccFastTrip::reset()
+{
+    if (_alarm != 0) {
+        cancel_alarm(_alarm);
+        _alarm = 0;
+    }
+    _retry = 0;
+    release();
+}
+
+
+// Capture block callback (DMA interrupt)
+void DccFastTrip::block(const uint16_t *blk, int idx, intptr_t arg)
+{
+    DccFastTrip *t = (DccFastTrip *)arg;
+
+    if (t->_state != State::On)
+        return;
+
+    const uint32_t on_us = time_us_32() - t->_on_us;
+    const bool blanking = on_us < t->_blank_us;
+    const uint16_t level = blanking ? t->_blank_level : t->_trip_level;
+
+    if (t->_retry > 0 && on_us >= good_us)
+        t->_retry = 0; // stayed on long enough; retry worked
+
+    uint16_t peak = 0;
+    for (int i = 0; i < DccAdcCapture::block_len; i++) {
+        const uint16_t s = blk[i];
+        if (s > peak)
+            peak = s;
+        if (s < level) {
+            t->_over = 0;
+        } else if (++t->_over >= t->_trip_cnt) {
+            t->trip(peak, idx + i + 1, blanking);
+            return;
+        }
+    }
+}
+
+
+// Power off now, log it, and decide whether to retry (interrupt context).
+void DccFastTrip::trip(uint16_t peak, int end_idx, bool blanking)
+{
+    gpio_set_outover(_pwr_gpio, GPIO_OVERRIDE_LOW);
+
+    _over = 0;
+    _retry++;
+
+    uint32_t n = _log_cnt;
+    Trip &t = _log[n % log_max];
+    t.time_us = time_us_32();
+    t.peak = peak;
+    t.retry = (_retry < 255) ? _retry : 255;
+    t.blanking = blanking;
+    _capture.copy(t.trace, end_idx, trace_len);
+    _log_cnt = n + 1;
+
+    if (_retry > _retry_max) {
+        _state = State::Latched;
+        return;
+    }
+
+    // first retry waits _retry_us, each one after that twice as long
+    if (_retry == 1)
+        _wait_us = _retry_us;
+    else if (_wait_us < _retry_max_us / 2)
+        _wait_us *= 2;
+    else
+        _wait_us = _retry_max_us;
+
+    _state = State::Wait;
+    _alarm = add_alarm_in_us(_wait_us, retry_alarm, this, true);
+}
+
+
+int64_t DccFastTrip::retry_alarm(alarm_id_t, void *arg)
+{
+    DccFastTrip *t = (DccFastTrip *)arg;
+    t->_alarm = 0;
+    if (t->_state == State::Wait)
+        t->release();
+    return 0; // don't reschedule
+}
+
+
+void DccFastTrip::release()
+{
+    power_on();
+    _state = State::On;
+    gpio_set_outover(_pwr_gpio, GPIO_OVERRIDE_NORMAL);
+}
+
+
+void DccFastTrip::print_log() const
+{
+    const uint32_t log_cnt = _log_cnt;
+    printf("trips: %lu", log_cnt);
+    if (_state == State::Latched)
+        printf(" (latched)");
+    else if (_state == State::Wait)
+        printf(" (retry in %lu us)", _wait_us);
+    printf("\n");
+
+    const uint32_t first = (log_cnt > log_max) ? (log_cnt - log_max) : 0;
+    for (uint32_t n = first; n < log_cnt; n++) {
+        const Trip &t = _log[n % log_max];
+        printf("trip %lu: t=%lu us peak=%u retry=%u%s\n", n, t.time_us,
+               t.peak, t.retry, t.blanking ? " blanking" : "");
+    }
+}
+
+
+void DccFastTrip::export_trace() const
+{
+    const uint32_t log_cnt = _log_cnt;
+    if (log_cnt == 0)
+        return;
+
+    const Trip &t = _log[(log_cnt - 1) % log_max];
+
+    // the tripping sample is the last one in the trace
+    printf("capture %d %d %d 0\n", trace_len, _capture.rate_hz(),
+           trace_len - 1);
+    stdio_flush();
+
+    for (int i = 0; i < trace_len; i++) {
+        putchar_raw(t.trace[i] & 0xff);
+        putchar_raw(t.trace[i] >> 8);
+    }
+    stdio_flush();
+}
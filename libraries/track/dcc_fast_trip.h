@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+// pico
+#include "pico/time.h"
+//
+#include "dcc_adc_capture.h"
+
+// Fast overcurrent cutoff for the booster.
+//
+// Every block of current samples from DccAdcCapture is checked in the DMA
+// interrupt. When trip_cnt consecutive samples are at or above the trip
+// level, the power enable pin's output is forced low with the pad override,
+// whatever the main loop or DccCommand are doing. DccCommand can keep
+// driving the pin; the override wins until it is released.
+//
+// The worst case, from the first sample over the level to the pin going
+// low, is trip_cnt - 1 more samples, then up to a whole block before the
+// interrupt sees them, then the interrupt entry and the check (a couple
+// of us): at 250 kHz with trip_cnt 2 and 4-sample blocks, about 22 us.
+// Anything that disables interrupts adds to that; a flash write
+// (FlashSector) does for milliseconds, so the cutoff is only fast with
+// flash left alone.
+//
+// After power is turned on, the inrush into decoder capacitors looks like a
+// short for a while. For blank_us after each power-on, the trip level is
+// raised to blank_level.
+//
+// A trip schedules a retry with a timer alarm. Each retry that trips again
+// doubles the delay (up to retry_max_us); after retry_max consecutive
+// failed retries the cutoff latches off until reset(). Staying on for
+// good_us counts as success and resets the backoff.
+//
+// Each trip is logged with the samples leading up to it.
+
+class DccFastTrip
+{
+public:
+
+    DccFastTrip(DccAdcCapture &capture, int pwr_gpio, uint16_t trip_level,
+                int trip_cnt = 2);
+
+    // Higher trip level for blank_us after power on.
+    void blanking(uint32_t blank_us, uint16_t blank_level);
+
+    // Retry delay doubles from retry_us up to retry_max_us; give up after
+    // retry_max consecutive trips. retry_max = 0 latches on the first trip.
+    void retry(int retry_max, uint32_t retry_us, uint32_t retry_max_us);
+
+    // Hook into the capture. Call before capture.start().
+    void init();
+
+    // Start a blanking window; call when track power is turned on.
+    void power_on();
+
+    // Power is being held off (waiting for a retry, or latched).
+    bool tripped() const
+    {
+        return _state != State::On;
+    }
+
+    // Gave up retrying.
+    bool latched() const
+    {
+        return _state == State::Latched;
+    }
+
+    // Clear a latched trip and restore power.
+    void reset();
+
+    static constexpr int trace_len = 256;
+
+    struct Trip {
+        uint32_t time_us;
+        uint16_t peak;
+        uint8_t retry; // consecutive trips including this one
+        bool blanking; // tripped during blanking window
+        uint16_t trace[trace_len];
+    };
+
+    static constexpr int log_max = 4;
+
+    // Trips logged since startup (the log keeps the last log_max).
+    uint32_t trip_cnt() const
+    {
+        return _log_cnt;
+    }
+
+    // Print the log summary, and export the trace of the most recent trip
+    // in the same format as DccAdcCapture::export_window().
+    void print_log() const;
+    void export_trace() const;
+
+private:
+
+    enum class State {
+        On,      // power on, watching
+        Wait,    // tripped, retry scheduled
+        Latched, // tripped, no more retries
+    };
+
+    DccAdcCapture &_capture;
+    int _pwr_gpio;
+
+    uint16_t _trip_level;
+    int _trip_cnt;
+    uint32_t _blank_us;
+    uint16_t _blank_level;
+    int _retry_max;
+    uint32_t _retry_us;
+    uint32_t _retry_max_us;
+    static constexpr uint32_t good_us = 1'000'000;
+
+    volatile State _state;
+    uint32_t _on_us;  // time of last power on
+    int _over;        // consecutive samples over the level
+    int _retry;       // consecutive trips
+    uint32_t _wait_us; // current retry delay
+    alarm_id_t _alarm;
+
+    Trip _log[log_max];
+    volatile uint32_t _log_cnt;
+
+    static void block(const uint16_t *blk, int idx, intptr_t arg);
+    void trip(uint16_t peak, int end_idx, bool blanking);
+    static int64_t retry_alarm(alarm_id_t id, void *arg);
+    void release();
+};
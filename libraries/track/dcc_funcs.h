@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "dcc_tx_pkt.h"
+
+// One decoder's function state (F0-F68), and the packets that carry it.
+//
+// DCC sends functions in groups (F0-F4, F5-F8, F9-F12, then eight at a
+// time up to F68), one packet per group, and a decoder only needs the
+// groups that have changed. set() marks a function's group dirty if it
+// changed; DccTx::funcs() queues the dirty groups as soon as it can, and
+// otherwise keeps one refresh slot rotating through the groups that have
+// ever had something on (F0-F4 always), so a decoder that missed a packet
+// or was just put on the track catches up without a packet per group
+// going round the refresh cycle.
+//
+// Nothing here touches hardware, so it builds for the host too.
+
+class DccFuncs
+{
+public:
+
+    static constexpr int group_cnt = DccTxPkt::func_groups;
+
+    constexpr DccFuncs(int address) :
+        _address(address),
+        _bits{},
+        _dirty(0),
+        _used(1),
+        _next(0),
+        _changes(0)
+    {
+    }
+
+    constexpr int address() const
+    {
+        return _address;
+    }
+
+    constexpr bool get(int f) const
+    {
+        if (f < 0 || f >= DccTxPkt::func_max)
+            return false;
+        const int g = DccTxPkt::func_group_of(f);
+        return (_bits[g] >> (f - DccTxPkt::func_group_first(g))) & 1;
+    }
+
+    // Nothing is sent if it's already that way.
+    constexpr void set(int f, bool on)
+    {
+        if (f < 0 || f >= DccTxPkt::func_max || get(f) == on)
+            return;
+        const int g = DccTxPkt::func_group_of(f);
+        _bits[g] ^= 1 << (f - DccTxPkt::func_group_first(g));
+        _dirty |= 1 << g;
+        _used |= 1 << g;
+        _changes++;
+    }
+
+    // Lowest dirty group, or -1 if there isn't one.
+    constexpr int dirty() const
+    {
+        for (int g = 0; g < group_cnt; g++)
+            if (_dirty & (1 << g))
+                return g;
+        return -1;
+    }
+
+    // It's been sent (or queued).
+    constexpr void clean(int group)
+    {
+        _dirty &= ~(1 << group);
+    }
+
+    constexpr DccTxPkt pkt(int group) const
+    {
+        return DccTxPkt::func_group(_address, group, _bits[group]);
+    }
+
+    // Group in the refresh slot (the last rotate()).
+    constexpr int current() const
+    {
+        return _next;
+    }
+
+    // Next group for the refresh slot.
+    constexpr int rotate()
+    {
+        do
+            _next = (_next + 1) % group_cnt;
+        while ((_used & (1 << _next)) == 0);
+        return _next;
+    }
+
+    // groups in the rotation
+    constexpr uint16_t used() const
+    {
+        return _used;
+    }
+
+    constexpr uint32_t changes() const
+    {
+        return _changes;
+    }
+
+private:
+
+    int _address;
+    uint8_t _bits[group_cnt]; // bit 0 is the group's first function
+    uint16_t _dirty;          // group mask
+    uint16_t _used;           // group mask
+    int _next;                // group in the refresh slot
+    uint32_t _changes;
+};
@@ -0,0 +1,194 @@
+
+#include <cassert>
+#include <cstdint>
+// pico
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+//
+#include "dcc_tx.h"
+#include "dcc_tx.pio.h"
+#include "dcc_tx_pkt.h"
+
+DccTx *DccTx::_irq_tx = nullptr;
+
+
+DccTx::DccTx(PIO pio, int sig_gpio, int pwr_gpio) :
+    _pio(pio),
+    _sm(-1),
+    _sig_gpio(sig_gpio),
+    _pwr_gpio(pwr_gpio),
+    _dma(-1),
+    _power(false),
+    _sched(),
+    _flight_head(0),
+    _flight_tail(0),
+    _end_func(nullptr),
+    _end_arg(0)
+{
+}
+
+
+void DccTx::init()
+{
+    assert(_irq_tx == nullptr);
+    _irq_tx = this;
+
+    _sm = pio_claim_unused_sm(_pio, true);
+
+    // "out pc" lands on the jump table at the start of the program
+    assert(pio_can_add_program_at_offset(_pio, &dcc_tx_program, 0));
+    uint offset = pio_add_program(_pio, &dcc_tx_program);
+    assert(offset == 0);
+
+    float div = float(clock_get_hz(clk_sys)) / 1'000'000.0f;
+    dcc_tx_program_init(_pio, _sm, offset, _sig_gpio, _pwr_gpio, div);
+
+    // end bit interrupt ("irq 0 rel" is flag _sm)
+    const uint pio_irq_num = pio_get_irq_num(_pio, 0);
+    pio_interrupt_clear(_pio, _sm);
+    pio_set_irq0_source_enabled(
+        _pio, pio_interrupt_source_t(pis_interrupt0 + _sm), true);
+    irq_add_shared_handler(pio_irq_num, pio_irq,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(pio_irq_num, true);
+
+    // dma: packet words -> tx fifo
+    _dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(_pio, _sm, true));
+    dma_channel_configure(_dma, &c, &_pio->txf[_sm], nullptr, 0, false);
+
+    dma_channel_acknowledge_irq0(_dma);
+    dma_channel_set_irq0_enabled(_dma, true);
+    irq_add_shared_handler(DMA_IRQ_0, dma_irq,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // prime; the fifo fills up and waits for the state machine
+    next();
+}
+
+
+void DccTx::power(bool on)
+{
+    if (on == _power)
+        return;
+
+    if (on) {
+        pio_sm_exec(_pio, _sm, pio_encode_set(pio_pins, 1) | //
+                                   pio_encode_sideset(1, 0));
+        pio_sm_set_enabled(_pio, _sm, true);
+    } else {
+        pio_sm_set_enabled(_pio, _sm, false);
+        pio_sm_exec(_pio, _sm, pio_encode_set(pio_pins, 0) | //
+                                   pio_encode_sideset(1, 0));
+    }
+
+    _power = on;
+}
+
+
+bool DccTx::put(const DccTxPkt &pkt)
+{
+    return _sched.put(pkt);
+}
+
+
+void DccTx::estop()
+{
+    uint32_t save = save_and_disable_interrupts();
+    _sched.estop();
+    restore_interrupts(save);
+}
+
+
+void DccTx::refresh(int slot, const DccTxPkt &pkt)
+{
+    assert(0 <= slot && slot < refresh_max);
+    uint32_t save = save_and_disable_interrupts();
+    _sched.refresh(slot, pkt);
+    restore_interrupts(save);
+}
+
+
+void DccTx::refresh_clear(int slot)
+{
+    assert(0 <= slot && slot < refresh_max);
+    uint32_t save = save_and_disable_interrupts();
+    _sched.refresh_clear(slot);
+    restore_interrupts(save);
+}
+
+
+void DccTx::funcs(DccFuncs &funcs, int slot)
+{
+    assert(0 <= slot && slot < refresh_max);
+    uint32_t save = save_and_disable_interrupts();
+    _sched.funcs(funcs, slot, func_repeat);
+    restore_interrupts(save);
+}
+
+
+void DccTx::end_callback(EndFunc *func, intptr_t arg)
+{
+    uint32_t save = save_and_disable_interrupts();
+    _end_func = func;
+    _end_arg = arg;
+    restore_interrupts(save);
+}
+
+
+// Pick the next packet, copy it into the flight ring, and start the DMA on
+// it. Called from the DMA interrupt, and once from init().
+void DccTx::next()
+{
+    assert((_flight_head - _flight_tail) < flight_max);
+
+    DccTxPkt &pkt = _flight[_flight_head % flight_max];
+    _sched.next(pkt);
+
+    _flight_head = _flight_head + 1;
+
+    dma_channel_transfer_from_buffer_now(_dma, pkt.words(), pkt.word_cnt());
+}
+
+
+void DccTx::dma_irq()
+{
+    DccTx *tx = _irq_tx;
+
+    if (tx == nullptr || !dma_channel_get_irq0_status(tx->_dma))
+        return;
+
+    dma_channel_acknowledge_irq0(tx->_dma);
+
+    tx->next();
+}
+
+
+// A packet's end bit is starting; it is the oldest one in flight.
+void DccTx::pio_irq()
+{
+    DccTx *tx = _irq_tx;
+
+    if (tx == nullptr || !pio_interrupt_get(tx->_pio, tx->_sm))
+        return;
+
+    pio_interrupt_clear(tx->_pio, tx->_sm);
+
+    if (tx->_flight_tail == tx->_flight_head)
+        return; // can't happen
+
+    const DccTxPkt &pkt = tx->_flight[tx->_flight_tail % flight_max];
+
+    if (tx->_end_func != nullptr)
+        tx->_end_func(pkt, tx->_end_arg);
+
+    tx->_flight_tail = tx->_flight_tail + 1;
+}
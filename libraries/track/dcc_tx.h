@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+// pico
+#include "hardware/pio.h"
+//
+#include "dcc_funcs.h"
+#include "dcc_tx_pkt.h"
+#include "dcc_tx_sched.h"
+
+// DCC bitstream from a PIO state machine fed by DMA.
+//
+// The state machine (dcc_tx.pio) times every bit and the RailCom cutout, so
+// the signal has no jitter however busy the cores are. The CPU only picks
+// the next packet: each time the DMA finishes handing a packet to the state
+// machine, its interrupt starts the next one, as DccTxSched says (estops,
+// then the queue, then refresh slots, then idle). All of these are
+// pre-encoded DccTxPkts; the interrupt only copies one and points the DMA
+// at it. The joined TX FIFO holds 8 words, over 7 ms of bits, so interrupt
+// latency never shows on the track.
+//
+// The end callback runs (interrupt context) as each packet's end bit starts,
+// with the packet that is ending. That is where RailCom reception and
+// current capture line themselves up with the bitstream.
+
+class DccTx
+{
+public:
+
+    DccTx(PIO pio, int sig_gpio, int pwr_gpio);
+
+    // Claim a state machine (the program must go at offset 0) and a DMA
+    // channel, and start feeding idles. Power stays off.
+    void init();
+
+    void power(bool on);
+
+    bool power() const
+    {
+        return _power;
+    }
+
+    // Queue a packet; returns false if the queue is full.
+    bool put(const DccTxPkt &pkt);
+
+    // Drop anything queued, send broadcast emergency stops next, and set
+    // the speed in every refresh slot to 0.
+    void estop();
+
+    // Refresh slots are sent round-robin whenever the queue is empty.
+    static constexpr int refresh_max = DccTxSched::refresh_max;
+    void refresh(int slot, const DccTxPkt &pkt);
+    void refresh_clear(int slot);
+
+    // Send a decoder's changed function groups now, and keep its other
+    // groups going round in one refresh slot. Call from the app's loop.
+    static constexpr int func_repeat = 2; // sends per group per rotation
+    void funcs(DccFuncs &funcs, int slot);
+
+    typedef void(EndFunc)(const DccTxPkt &pkt, intptr_t arg);
+    void end_callback(EndFunc *func, intptr_t arg);
+
+    static constexpr int queue_max = DccTxSched::queue_max;
+    static constexpr int estop_cnt = DccTxSched::estop_cnt;
+
+private:
+
+    PIO _pio;
+    int _sm;
+    int _sig_gpio;
+    int _pwr_gpio;
+    int _dma;
+    bool _power;
+
+    DccTxSched _sched;
+
+    // Packets handed to the DMA whose end bits haven't been sent yet. The
+    // DMA reads straight from here. The FIFO holds less than three packets,
+    // so eight is plenty.
+    static constexpr int flight_max = 8;
+    DccTxPkt _flight[flight_max];
+    volatile uint32_t _flight_head;
+    volatile uint32_t _flight_tail;
+
+    EndFunc *_end_func;
+    intptr_t _end_arg;
+
+    static DccTx *_irq_tx;
+    static void dma_irq();
+    static void pio_irq();
+
+    void next();
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstdint>
+
+// One DCC packet, encoded for the dcc_tx state machine.
+//
+// The message bytes and checksum are encoded once into the symbol stream
+// dcc_tx.pio expects, packed LSB first into 32-bit words:
+//   preamble: one bits
+//   each byte: a zero start bit, then 8 data bits, msb first
+//   end: the packet end symbol, then one bit saying whether to do the
+//        RailCom cutout after it
+// The state machine discards the rest of the word after the cutout bit, so
+// every packet is a whole number of words that can be sent again and again
+// from wherever it is stored. Packets that never change (idle, broadcast
+// stop) are constexpr and live in flash.
+//
+// Nothing here touches hardware, so it builds for the host too.
+
+class DccTxPkt
+{
+public:
+
+    static constexpr int msg_max = 6; // bytes, including checksum
+
+    static constexpr int preamble_ops = 16; // ops mode (>= 14)
+    static constexpr int preamble_svc = 20; // service mode
+
+    // 2-bit symbols
+    static constexpr uint32_t sym_zero = 0;
+    static constexpr uint32_t sym_one = 1;
+    static constexpr uint32_t sym_end = 2;
+
+    static constexpr int bit_max = 2 * (preamble_svc + msg_max * 9 + 1) + 1;
+    static constexpr int word_max = (bit_max + 31) / 32;
+
+    constexpr DccTxPkt() :
+        _word{},
+        _words(0),
+        _msg{},
+        _len(0),
+        _cutout(false)
+    {
+    }
+
+    // msg is the packet without the checksum
+    constexpr DccTxPkt(const uint8_t *msg, int len, bool cutout = true,
+                       int preamble = preamble_ops) :
+        DccTxPkt()
+    {
+        encode(msg, len, cutout, preamble);
+    }
+
+    constexpr const uint32_t *words() const
+    {
+        return _word;
+    }
+
+    constexpr int word_cnt() const
+    {
+        return _words;
+    }
+
+    // message including checksum
+    constexpr const uint8_t *msg() const
+    {
+        return _msg;
+    }
+
+    constexpr int len() const
+    {
+        return _len;
+    }
+
+    constexpr bool cutout() const
+    {
+        return _cutout;
+    }
+
+    // Multi-function decoder address, 0 for broadcast, -1 for anything else
+    // (accessory, idle).
+    constexpr int address() const
+    {
+        if (_len < 1)
+            return -1;
+        const int b0 = _msg[0];
+        if (b0 <= 127)
+            return b0;
+        if (b0 >= 192 && b0 <= 231 && _len >= 2)
+            return ((b0 & 0x3f) << 8) | _msg[1];
+        return -1;
+    }
+
+    // Put a multi-function decoder address in msg, returning the number of
+    // bytes used (1 for short addresses, 2 for long).
+    static constexpr int put_address(uint8_t *msg, int address)
+    {
+        if (address <= 127) {
+            msg[0] = address;
+            return 1;
+        }
+        msg[0] = 0xc0 | ((address >> 8) & 0x3f);
+        msg[1] = address & 0xff;
+        return 2;
+    }
+
+    static constexpr DccTxPkt idle()
+    {
+        const uint8_t msg[] = {0xff, 0x00};
+        return DccTxPkt(msg, 2);
+    }
+
+    static constexpr DccTxPkt reset(int preamble = preamble_ops)
+    {
+        const uint8_t msg[] = {0x00, 0x00};
+        return DccTxPkt(msg, 2, true, preamble);
+    }
+
+    // broadcast emergency stop, direction ignored (01DC000S, C=1, S=1)
+    static constexpr DccTxPkt estop()
+    {
+        const uint8_t msg[] = {0x00, 0x51};
+        return DccTxPkt(msg, 2);
+    }
+
+    // 128-step speed; speed is -126...126, negative is reverse
+    static constexpr DccTxPkt speed128(int address, int speed)
+    {
+        uint8_t msg[msg_max - 1] = {};
+        int len = put_address(msg, address);
+        const int mag = (speed < 0) ? -speed : speed;
+        msg[len++] = 0x3f;
+        msg[len++] = ((speed < 0) ? 0x00 : 0x80) | ((mag == 0) ? 0 : mag + 1);
+        return DccTxPkt(msg, len);
+    }
+
+    // The same packet with the speed at 0 (direction kept) if it's a speed
+    // packet (28 or 128 steps) for a multi-function decoder; otherwise the
+    // packet as it is.
+    constexpr DccTxPkt stopped() const
+    {
+        const int address = this->address();
+        if (address < 0)
+            return *this;
+        const int a = (_msg[0] <= 127) ? 1 : 2;
+        uint8_t msg[msg_max - 1] = {};
+        for (int i = 0; i < _len - 1; i++)
+            msg[i] = _msg[i];
+        if (_msg[a] == 0x3f && _len - 1 == a + 2)
+            msg[a + 1] &= 0x80;
+        else if ((_msg[a] & 0xc0) == 0x40 && _len - 1 == a + 1)
+            msg[a] &= 0xe0;
+        else
+            return *this;
+        return DccTxPkt(msg, _len - 1, _cutout);
+    }
+
+    // Speed step of a speed packet (1-126 or 1-28), negative in reverse;
+    // 0 for stop or emergency stop, or if it isn't a speed packet.
+    constexpr int speed() const
+    {
+        if (address() < 0)
+            return 0;
+        const int a = (_msg[0] <= 127) ? 1 : 2;
+        int step = 0;
+        bool fwd = true;
+        if (_msg[a] == 0x3f && _len - 1 == a + 2) {
+            const int code = _msg[a + 1] & 0x7f;
+            step = (code < 2) ? 0 : code - 1;
+            fwd = (_msg[a + 1] & 0x80) != 0;
+        } else if ((_msg[a] & 0xc0) == 0x40 && _len - 1 == a + 1) {
+            // 01DCSSSS, C the low bit of the 28-step code
+            const int code = ((_msg[a] & 0x0f) << 1) | ((_msg[a] >> 4) & 1);
+            step = (code < 4) ? 0 : code - 3;
+            fwd = (_msg[a] & 0x20) != 0;
+        }
+        return fwd ? step : -step;
+    }
+
+    // Function groups, in the order DccFuncs keeps them: F0-F4, F5-F8,
+    // F9-F12, then F13-F68 eight at a time.
+    static constexpr int func_groups = 10;
+    static constexpr int func_max = 69; // F0-F68
+
+    static constexpr int func_group_first(int group)
+    {
+        return (group < 3) ? (group == 0 ? 0 : 1 + 4 * group)
+                           : 13 + 8 * (group - 3);
+    }
+
+    static constexpr int func_group_size(int group)
+    {
+        return (group == 0) ? 5 : (group < 3) ? 4 : 8;
+    }
+
+    static constexpr int func_group_of(int f)
+    {
+        return (f < 5) ? 0 : (f < 13) ? 1 + (f - 5) / 4 : 3 + (f - 13) / 8;
+    }
+
+    // One function group's state; bit 0 of bits is the group's first
+    // function. F0 goes in bit 4 of its instruction, after F1-F4.
+    static constexpr DccTxPkt func_group(int address, int group, uint8_t bits)
+    {
+        uint8_t msg[msg_max - 1] = {};
+        int len = put_address(msg, address);
+        if (group == 0) {
+            msg[len++] = 0x80 | ((bits & 1) << 4) | ((bits >> 1) & 0x0f);
+        } else if (group < 3) {
+            msg[len++] = (group == 1 ? 0xb0 : 0xa0) | (bits & 0x0f);
+        } else {
+            // F13-F20 0xde, F21-F28 0xdf, F29-F68 0xd8...0xdc
+            msg[len++] = (group < 5) ? 0xde + (group - 3) : 0xd8 + (group - 5);
+            msg[len++] = bits;
+        }
+        return DccTxPkt(msg, len);
+    }
+
+    // Decode a symbol stream back to message bytes (checksum included).
+    // Returns the byte count, or -1 if the stream is malformed or the
+    // checksum is wrong. Used to check the encoder.
+    static constexpr int decode(const uint32_t *word, int words, uint8_t *msg,
+                                bool &cutout)
+    {
+        const int bits = words * 32;
+        int bit = 0;
+
+        auto sym = [&]() -> int {
+            if (bit + 2 > bits)
+                return -1;
+            int s = (word[bit / 32] >> (bit % 32)) & 3;
+            bit += 2;
+            return s;
+        };
+
+        int preamble = 0;
+        int s = sym();
+        while (s == int(sym_one)) {
+            preamble++;
+            s = sym();
+        }
+        if (preamble < 10)
+            return -1;
+
+        int len = 0;
+        uint8_t check = 0;
+        while (s == int(sym_zero)) {
+            if (len >= msg_max)
+                return -1;
+            int b = 0;
+            for (int i = 0; i < 8; i++) {
+                s = sym();
+                if (s != int(sym_zero) && s != int(sym_one))
+                    return -1;
+                b = (b << 1) | s;
+            }
+            msg[len++] = b;
+            check ^= b;
+            s = sym();
+        }
+
+        if (s != int(sym_end) || len < 2 || check != 0 || bit >= bits)
+            return -1;
+
+        cutout = (word[bit / 32] >> (bit % 32)) & 1;
+        return len;
+    }
+
+private:
+
+    uint32_t _word[word_max];
+    int _words;
+    uint8_t _msg[msg_max];
+    int _len;
+    bool _cutout;
+
+    constexpr void encode(const uint8_t *msg, int len, bool cutout,
+                          int preamble)
+    {
+        int bit = 0;
+
+        auto put = [&](uint32_t val, int cnt) {
+            _word[bit / 32] |= val << (bit % 32);
+            bit += cnt;
+        };
+
+        uint8_t check = 0;
+        for (int i = 0; i < len && i < msg_max - 1; i++) {
+            _msg[_len++] = msg[i];
+            check ^= msg[i];
+        }
+        _msg[_len++] = check;
+
+        for (int i = 0; i < preamble; i++)
+            put(sym_one, 2);
+
+        for (int i = 0; i < _len; i++) {
+            put(sym_zero, 2); // start bit
+            for (int b = 7; b >= 0; b--)
+                put((_msg[i] >> b) & 1, 2);
+        }
+
+        put(sym_end, 2);
+        put(cutout ? 1 : 0, 1);
+
+        _cutout = cutout;
+        _words = (bit + 31) / 32;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed-size FIFO with one producer (main loop) and one consumer (the DMA
+// interrupt), on the same core. N must be a power of two.
+//
+// Nothing here touches hardware, so it builds for the host too.
+
+template <typename T, int N>
+class DccTxQueue
+{
+public:
+
+    static_assert(N > 0 && (N & (N - 1)) == 0);
+
+    constexpr DccTxQueue() :
+        _item{},
+        _head(0),
+        _tail(0)
+    {
+    }
+
+    bool empty() const
+    {
+        return _head == _tail;
+    }
+
+    int count() const
+    {
+        return _head - _tail;
+    }
+
+    // producer
+    bool put(const T &item)
+    {
+        if (count() >= N)
+            return false;
+        _item[_head % N] = item;
+        _head = _head + 1;
+        return true;
+    }
+
+    // consumer
+    bool get(T &item)
+    {
+        if (empty())
+            return false;
+        item = _item[_tail % N];
+        _tail = _tail + 1;
+        return true;
+    }
+
+    // consumer (or producer with the consumer held off)
+    void flush()
+    {
+        _tail = uint32_t(_head);
+    }
+
+private:
+
+    T _item[N];
+    volatile uint32_t _head; // next slot to put
+    volatile uint32_t _tail; // next slot to get
+};
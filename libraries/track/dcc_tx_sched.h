@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "dcc_funcs.h"
+#include "dcc_tx_pkt.h"
+#include "dcc_tx_queue.h"
+
+// Which packet DccTx sends next. In order:
+//   - broadcast emergency stops, after estop()
+//   - packets queued with put()
+//   - the refresh slots, round-robin
+//   - idle
+//
+// estop() also stops every speed packet in the refresh slots (same
+// direction, speed 0), so refreshing doesn't start the locos again; they
+// stay stopped until the app sets a speed.
+//
+// next() is for the DMA interrupt; the rest is for the app's loop, with
+// the interrupt held off (DccTx does that) for everything but put().
+//
+// Nothing here touches hardware, so it builds for the host too.
+
+class DccTxSched
+{
+public:
+
+    static constexpr int queue_max = 16;
+    static constexpr int refresh_max = 16;
+    static constexpr int estop_cnt = 4;
+
+    constexpr DccTxSched() :
+        _queue(),
+        _refresh{},
+        _refresh_use{},
+        _refresh_sent{},
+        _refresh_next(0),
+        _estop(0)
+    {
+    }
+
+    bool put(const DccTxPkt &pkt)
+    {
+        return _queue.put(pkt);
+    }
+
+    void estop()
+    {
+        _queue.flush();
+        for (int s = 0; s < refresh_max; s++)
+            if (_refresh_use[s])
+                _refresh[s] = _refresh[s].stopped();
+        _estop = estop_cnt;
+    }
+
+    void refresh(int slot, const DccTxPkt &pkt)
+    {
+        _refresh[slot] = pkt;
+        _refresh_use[slot] = true;
+        _refresh_sent[slot] = 0;
+    }
+
+    void refresh_clear(int slot)
+    {
+        _refresh_use[slot] = false;
+    }
+
+    bool refresh_used(int slot) const
+    {
+        return _refresh_use[slot];
+    }
+
+    const DccTxPkt &refresh_pkt(int slot) const
+    {
+        return _refresh[slot];
+    }
+
+    // times sent since refresh()
+    int refresh_sent(int slot) const
+    {
+        return _refresh_sent[slot];
+    }
+
+    // Dirty groups go in the queue (anything that doesn't fit goes next
+    // time); a dirty group that's the one in the slot is reloaded there
+    // too, or the slot would go on sending its old bits and the decoder
+    // would undo the change. The slot moves on to the next group once
+    // it's sent the one it has repeat times.
+    void funcs(DccFuncs &funcs, int slot, int repeat)
+    {
+        for (int g = funcs.dirty(); g >= 0; g = funcs.dirty()) {
+            if (_refresh_use[slot] && g == funcs.current())
+                refresh(slot, funcs.pkt(g));
+            if (!put(funcs.pkt(g)))
+                break;
+            funcs.clean(g);
+        }
+
+        if (!_refresh_use[slot] || _refresh_sent[slot] >= repeat)
+            refresh(slot, funcs.pkt(funcs.rotate()));
+    }
+
+    void next(DccTxPkt &pkt)
+    {
+        if (_estop > 0) {
+            _estop = _estop - 1;
+            pkt = estop_pkt;
+            return;
+        }
+        if (_queue.get(pkt))
+            return;
+        for (int i = 0; i < refresh_max; i++) {
+            const int s = (_refresh_next + i) % refresh_max;
+            if (!_refresh_use[s])
+                continue;
+            pkt = _refresh[s];
+            if (_refresh_sent[s] < UINT16_MAX)
+                _refresh_sent[s] = _refresh_sent[s] + 1;
+            _refresh_next = (s + 1) % refresh_max;
+            return;
+        }
+        pkt = idle_pkt;
+    }
+
+    // Encoded at compile time. next() copies them like any other packet
+    // (DccTx keeps what's in flight in RAM for the DMA).
+    static constexpr DccTxPkt idle_pkt = DccTxPkt::idle();
+    static constexpr DccTxPkt estop_pkt = DccTxPkt::estop();
+
+private:
+
+    DccTxQueue<DccTxPkt, queue_max> _queue;
+
+    DccTxPkt _refresh[refresh_max];
+    bool _refresh_use[refresh_max];
+    volatile uint16_t _refresh_sent[refresh_max]; // since refresh()
+    int _refresh_next;
+
+    volatile int _estop; // estops still to send
+};
@@ -0,0 +1,46 @@
+
+#include <cstdint>
+// pico
+#include "hardware/flash.h"
+#include "pico/flash.h"
+//
+#include "flash_sector.h"
+
+static_assert(FlashSector::size == FLASH_SECTOR_SIZE);
+
+// static to keep it off the stack
+static uint8_t sector[FLASH_SECTOR_SIZE];
+
+
+uint32_t FlashSector::offset(Id id)
+{
+    return PICO_FLASH_SIZE_BYTES - uint32_t(id) * FLASH_SECTOR_SIZE;
+}
+
+
+const uint8_t *FlashSector::data(Id id)
+{
+    return (const uint8_t *)(XIP_BASE + offset(id));
+}
+
+
+uint8_t *FlashSector::buf()
+{
+    return sector;
+}
+
+
+// param is the offset
+static void write_sector(void *param)
+{
+    const uint32_t offset = uint32_t(uintptr_t(param));
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    flash_range_program(offset, sector, FLASH_SECTOR_SIZE);
+}
+
+
+bool FlashSector::write(Id id)
+{
+    void *param = (void *)uintptr_t(offset(id));
+    return flash_safe_execute(write_sector, param, 100) == PICO_OK;
+}
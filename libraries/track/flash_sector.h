@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// The sectors at the end of flash that hold the apps' data, and writing
+// them.
+//
+// Each user has its own sector, counted back from the end of flash, so
+// they can't overlap; flash_sectors.ld fails the link if a program grows
+// into them. Rewriting a sector needs an image of all of it in RAM; there
+// is one such buffer, shared, since sectors are written one at a time from
+// the app's loop (never from an interrupt). A user fills buf() (starting
+// from a copy of data() if it's changing only part of it) and calls
+// write().
+//
+// Nothing else may use these sectors (btstack keeps its database at the
+// end of flash too; an app using it would need to move them).
+
+class FlashSector
+{
+public:
+
+    // how far back from the end of flash
+    enum class Id {
+        Params = 1, // ParamStore
+        Alias = 2,  // RosterAlias
+        Layout = 3, // Layout
+    };
+    static constexpr int reserved = 3; // keep in step with flash_sectors.ld
+
+    static constexpr uint32_t size = 4096; // FLASH_SECTOR_SIZE
+
+    // Where it reads, through XIP.
+    static const uint8_t *data(Id id);
+
+    // The shared image; size bytes.
+    static uint8_t *buf();
+
+    // Erase the sector and program buf() into it.
+    static bool write(Id id);
+
+private:
+
+    static uint32_t offset(Id id);
+};
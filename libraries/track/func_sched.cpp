@@ -0,0 +1,205 @@
+
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+//
+#include "func_sched.h"
+
+static_assert((FuncSched::ready_max & (FuncSched::ready_max - 1)) == 0);
+
+
+FuncSched::FuncSched(FuncFunc *func, intptr_t arg) :
+    _func(func),
+    _arg(arg),
+    _event{},
+    _event_cnt(0),
+    _alarm(0),
+    _ready{},
+    _ready_head(0),
+    _ready_tail(0),
+    _sent(0),
+    _late_max_us(0),
+    _event_max(0)
+{
+}
+
+
+bool FuncSched::push(const Event &e)
+{
+    if (_event_cnt >= event_max)
+        return false;
+    int i = _event_cnt++;
+    while (i > 0) {
+        const int up = (i - 1) / 2;
+        if (!before(e, _event[up]))
+            break;
+        _event[i] = _event[up];
+        i = up;
+    }
+    _event[i] = e;
+    if (_event_cnt > _event_max)
+        _event_max = _event_cnt;
+    return true;
+}
+
+
+void FuncSched::pop()
+{
+    const Event last = _event[--_event_cnt];
+    int i = 0;
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= _event_cnt)
+            break;
+        if (child + 1 < _event_cnt && before(_event[child + 1], _event[child]))
+            child++;
+        if (!before(_event[child], last))
+            break;
+        _event[i] = _event[child];
+        i = child;
+    }
+    if (_event_cnt > 0)
+        _event[i] = last;
+}
+
+
+// Alarm for the earliest event, replacing any there is. Interrupts off.
+void FuncSched::arm()
+{
+    if (_alarm != 0) {
+        cancel_alarm(_alarm);
+        _alarm = 0;
+    }
+    if (_event_cnt == 0)
+        return;
+    int32_t wait_us = int32_t(_event[0].time_us - time_us_32());
+    if (wait_us < 10)
+        wait_us = 10;
+    _alarm = add_alarm_in_us(wait_us, alarm, this, true);
+}
+
+
+// Due events to the ring, repeats back in the heap. Interrupts off.
+void FuncSched::fire()
+{
+    const uint32_t now_us = time_us_32();
+    while (_event_cnt > 0 && int32_t(now_us - _event[0].time_us) >= 0) {
+        if (_ready_head - _ready_tail >= ready_max)
+            break; // loop() is behind; the alarm comes back for the rest
+        Event e = _event[0];
+        pop();
+
+        if (now_us - e.time_us > _late_max_us)
+            _late_max_us = now_us - e.time_us;
+        _ready[_ready_head % ready_max] = {e.loco_id, e.f, e.on};
+        _ready_head = _ready_head + 1;
+
+        if (e.period_us == 0)
+            continue;
+        if (e.on) {
+            e.on = false;
+            e.time_us += e.on_us;
+        } else if (e.left == 1) {
+            continue;
+        } else {
+            if (e.left > 1)
+                e.left--;
+            e.on = true;
+            e.time_us += e.period_us - e.on_us;
+        }
+        push(e);
+    }
+    arm();
+}
+
+
+int64_t FuncSched::alarm(alarm_id_t id, void *arg)
+{
+    FuncSched *s = (FuncSched *)arg;
+    // one that was replaced but went off before it could be canceled
+    if (id != s->_alarm)
+        return 0;
+    s->_alarm = 0;
+    s->fire();
+    return 0; // fire() sets the next one
+}
+
+
+bool FuncSched::put(uint32_t time_us, int loco_id, int f, bool on)
+{
+    const Event e = {time_us, 0, 0, 0, int16_t(loco_id), int8_t(f), on};
+    const uint32_t irq = save_and_disable_interrupts();
+    const bool ok = push(e);
+    if (ok && _event[0].time_us == time_us)
+        arm();
+    restore_interrupts(irq);
+    return ok;
+}
+
+
+bool FuncSched::repeat(uint32_t time_us, int loco_id, int f, uint32_t on_us,
+                       uint32_t period_us, int cnt)
+{
+    if (on_us == 0 || on_us >= period_us)
+        return false;
+    const Event e = {time_us,          on_us,      period_us, int16_t(cnt),
+                     int16_t(loco_id), int8_t(f), true};
+    const uint32_t irq = save_and_disable_interrupts();
+    const bool ok = push(e);
+    if (ok && _event[0].time_us == time_us)
+        arm();
+    restore_interrupts(irq);
+    return ok;
+}
+
+
+void FuncSched::cancel(int loco_id, int f)
+{
+    const uint32_t irq = save_and_disable_interrupts();
+
+    // keep the others, then put them back in heap order
+    int keep = 0;
+    for (int i = 0; i < _event_cnt; i++)
+        if (_event[i].loco_id != loco_id || _event[i].f != f)
+            _event[keep++] = _event[i];
+    const int cnt = keep;
+    _event_cnt = 0;
+    for (int i = 0; i < cnt; i++) {
+        const Event e = _event[i]; // push() may move what's there
+        push(e);
+    }
+
+    for (uint32_t r = _ready_tail; r != _ready_head; r++) {
+        Ready &rd = _ready[r % ready_max];
+        if (rd.loco_id == loco_id && rd.f == f)
+            rd.f = -1;
+    }
+
+    arm();
+    restore_interrupts(irq);
+
+    _func(loco_id, f, false, _arg);
+}
+
+
+void FuncSched::loop()
+{
+    while (_ready_tail != _ready_head) {
+        const Ready rd = _ready[_ready_tail % ready_max];
+        _ready_tail = _ready_tail + 1;
+        if (rd.f < 0)
+            continue;
+        _func(rd.loco_id, rd.f, rd.on, _arg);
+        _sent++;
+    }
+}
+
+
+void FuncSched::print() const
+{
+    printf("funcs: %u sent, most pending %d, latest %u us\n", unsigned(_sent),
+           _event_max, unsigned(_late_max_us));
+}
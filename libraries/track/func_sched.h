@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+// pico
+#include "pico/time.h"
+
+// Timed loco function changes (horn toots, bell cadences), fired by an
+// alarm rather than looked for every loop.
+//
+// Pending changes are in a heap by time, with an alarm set for the
+// earliest. The alarm callback (interrupt context) moves whatever has
+// come due to a ring and sets the alarm for the next one; loop() sends
+// what's in the ring, so the function commands still go out from the
+// app's loop, and between changes loop() only sees the ring is empty.
+//
+// A repeat is one entry that turns the function on, then off on_us later,
+// then on again period_us after it last came on, cnt times or until it's
+// canceled. cancel() drops a function's pending changes (including any
+// in the ring) and turns it off.
+
+class FuncSched
+{
+public:
+
+    static constexpr int event_max = 32;
+    static constexpr int ready_max = 16; // ring; a power of 2
+
+    typedef void(FuncFunc)(int loco_id, int f, bool on, intptr_t arg);
+
+    FuncSched(FuncFunc *func, intptr_t arg = 0);
+
+    // Turn f on or off at time_us; false if there's no room.
+    bool put(uint32_t time_us, int loco_id, int f, bool on);
+
+    // f on for on_us, every period_us from time_us, cnt times (0 forever).
+    bool repeat(uint32_t time_us, int loco_id, int f, uint32_t on_us,
+                uint32_t period_us, int cnt = 0);
+
+    void cancel(int loco_id, int f);
+
+    // Send what's come due.
+    void loop();
+
+    void print() const;
+
+private:
+
+    FuncFunc *_func;
+    intptr_t _arg;
+
+    struct Event {
+        uint32_t time_us;
+        uint32_t on_us;     // repeat: how long it's on
+        uint32_t period_us; // repeat: on to on; 0 if it's not a repeat
+        int16_t left;       // repeat: times left, 0 forever
+        int16_t loco_id;
+        int8_t f;
+        bool on;
+    };
+
+    // heap by time_us; touched by the alarm, so only with interrupts off
+    Event _event[event_max];
+    int _event_cnt;
+    alarm_id_t _alarm; // 0 if none
+
+    // due, filled by the alarm and emptied by loop()
+    struct Ready {
+        int16_t loco_id;
+        int8_t f; // -1 if canceled
+        bool on;
+    };
+    Ready _ready[ready_max];
+    volatile uint32_t _ready_head; // alarm's
+    volatile uint32_t _ready_tail; // loop()'s
+
+    // stats
+    uint32_t _sent;
+    uint32_t _late_max_us; // alarm to due time
+    int _event_max;        // most pending
+
+    static bool before(const Event &a, const Event &b)
+    {
+        return int32_t(a.time_us - b.time_us) < 0;
+    }
+
+    bool push(const Event &e);
+    void pop();
+    void arm();
+    void fire();
+    static int64_t alarm(alarm_id_t id, void *arg);
+};
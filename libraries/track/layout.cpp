@@ -0,0 +1,300 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+// pico
+#include "pico/stdio.h"
+#include "pico/stdlib.h"
+//
+#include "flash_sector.h"
+#include "layout.h"
+
+static_assert(Layout::size_max <= FlashSector::size);
+
+
+static const uint8_t *layout_image()
+{
+    return FlashSector::data(FlashSector::Id::Layout);
+}
+
+
+Layout::Layout() :
+    _node_cnt(0),
+    _node{},
+    _name{},
+    _dist_mm{},
+    _turnouts{},
+    _straight{}
+{
+}
+
+
+bool Layout::check(const uint8_t *image, size_t size)
+{
+    if (size < sizeof(Header) || size > size_max)
+        return false;
+    Header hdr;
+    memcpy(&hdr, image, sizeof(hdr));
+    if (hdr.magic != magic || hdr.version != version || hdr.size != size)
+        return false;
+    if (hdr.node_cnt < 1 || hdr.node_cnt > node_max || hdr.seg_cnt > seg_max)
+        return false;
+    if (size != sizeof(Header) + hdr.node_cnt * sizeof(Node) +
+                    hdr.seg_cnt * sizeof(Seg))
+        return false;
+    if (hdr.crc != crc(image + sizeof(Header), size - sizeof(Header)))
+        return false;
+
+    const Node *node = (const Node *)(image + sizeof(Header));
+    for (int n = 0; n < hdr.node_cnt; n++)
+        if (node[n].turnout >= turnout_max)
+            return false;
+
+    const Seg *seg = (const Seg *)(node + hdr.node_cnt);
+    for (int s = 0; s < hdr.seg_cnt; s++)
+        for (int k = 0; k < 2; k++)
+            if (seg[s].node[k] >= hdr.node_cnt || seg[s].end[k] > end_b ||
+                seg[s].leg[k] > leg_diverging)
+                return false;
+
+    return true;
+}
+
+
+bool Layout::load(const uint8_t *image, size_t size)
+{
+    _node_cnt = 0;
+    if (!check(image, size))
+        return false;
+
+    Header hdr;
+    memcpy(&hdr, image, sizeof(hdr));
+    memcpy(_node, image + sizeof(Header), hdr.node_cnt * sizeof(Node));
+    for (int n = 0; n < hdr.node_cnt; n++) {
+        memcpy(_name[n], _node[n].name, name_max);
+        _name[n][name_max] = '\0';
+    }
+
+    const Seg *seg =
+        (const Seg *)(image + sizeof(Header) + hdr.node_cnt * sizeof(Node));
+    _node_cnt = hdr.node_cnt;
+    routes(seg, hdr.seg_cnt);
+    return true;
+}
+
+
+bool Layout::load()
+{
+    Header hdr;
+    memcpy(&hdr, layout_image(), sizeof(hdr));
+    if (hdr.magic != magic || hdr.size > size_max)
+        return false;
+    return load(layout_image(), hdr.size);
+}
+
+
+// Working space for routes(), static to keep it off the stack. A vertex
+// is a node and the end a train leaves it by, 2 * node + end.
+static constexpr int vert_max = 2 * Layout::node_max;
+static constexpr uint32_t far = UINT32_MAX;
+static uint32_t vert_dist[vert_max][vert_max];
+static int8_t vert_next[vert_max][vert_max]; // first step toward, -1 none
+static int8_t vert_seg[vert_max][vert_max];  // segment between neighbors
+
+
+void Layout::routes(const Seg *seg, int seg_cnt)
+{
+    const int vert_cnt = 2 * _node_cnt;
+
+    for (int u = 0; u < vert_cnt; u++) {
+        for (int w = 0; w < vert_cnt; w++) {
+            vert_dist[u][w] = (u == w) ? 0 : far;
+            vert_next[u][w] = (u == w) ? int8_t(w) : -1;
+            vert_seg[u][w] = -1;
+        }
+    }
+
+    // Leaving node[k] by end[k] gets to the other node, and on out its
+    // other end.
+    for (int s = 0; s < seg_cnt; s++) {
+        for (int k = 0; k < 2; k++) {
+            const int u = 2 * seg[s].node[k] + seg[s].end[k];
+            const int w = 2 * seg[s].node[1 - k] + (1 - seg[s].end[1 - k]);
+            if (seg[s].len_mm < vert_dist[u][w]) {
+                vert_dist[u][w] = seg[s].len_mm;
+                vert_next[u][w] = int8_t(w);
+                vert_seg[u][w] = int8_t(s);
+            }
+        }
+    }
+
+    for (int k = 0; k < vert_cnt; k++) {
+        for (int u = 0; u < vert_cnt; u++) {
+            if (vert_dist[u][k] == far)
+                continue;
+            for (int w = 0; w < vert_cnt; w++) {
+                if (vert_dist[k][w] == far)
+                    continue;
+                const uint32_t d = vert_dist[u][k] + vert_dist[k][w];
+                if (d < vert_dist[u][w]) {
+                    vert_dist[u][w] = d;
+                    vert_next[u][w] = vert_next[u][k];
+                }
+            }
+        }
+    }
+
+    // A node's route to another starts by either end and gets there by
+    // either end; take the shortest, then follow it for the turnouts.
+    for (int a = 0; a < _node_cnt; a++) {
+        for (int b = 0; b < _node_cnt; b++) {
+            int from = -1;
+            int to = -1;
+            for (int i = 0; i < 2; i++)
+                for (int j = 0; j < 2; j++)
+                    if (from < 0 || vert_dist[2 * a + i][2 * b + j] <
+                                        vert_dist[from][to]) {
+                        from = 2 * a + i;
+                        to = 2 * b + j;
+                    }
+
+            _turnouts[a][b] = 0;
+            _straight[a][b] = 0;
+            if (vert_dist[from][to] >= dist_none) {
+                _dist_mm[a][b] = dist_none;
+                continue;
+            }
+            _dist_mm[a][b] = uint16_t(vert_dist[from][to]);
+
+            for (int u = from; u != to; u = vert_next[u][to]) {
+                const Seg &s = seg[vert_seg[u][vert_next[u][to]]];
+                for (int k = 0; k < 2; k++) {
+                    const int t = _node[s.node[k]].turnout;
+                    if (t < 0 || s.end[k] != end_b)
+                        continue;
+                    _turnouts[a][b] |= uint8_t(1u << t);
+                    if (s.leg[k] == leg_straight)
+                        _straight[a][b] |= uint8_t(1u << t);
+                }
+            }
+        }
+    }
+}
+
+
+int Layout::node(const char *name) const
+{
+    for (int n = 0; n < _node_cnt; n++)
+        if (strcmp(_name[n], name) == 0)
+            return n;
+    return -1;
+}
+
+
+bool Layout::save(const uint8_t *image, size_t size)
+{
+    if (!check(image, size))
+        return false;
+
+    uint8_t *sector = FlashSector::buf();
+    if (image != sector)
+        memcpy(sector, image, size);
+    memset(sector + size, 0xff, FlashSector::size - size);
+
+    if (!FlashSector::write(FlashSector::Id::Layout))
+        return false;
+
+    return load();
+}
+
+
+static int hex_val(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+bool Layout::receive(uint32_t timeout_us)
+{
+    size_t size = 0;
+    int hi = -1; // first digit of a byte
+    uint32_t heard_us = time_us_32();
+
+    while (true) {
+        if (int32_t(time_us_32() - heard_us) >= int32_t(timeout_us)) {
+            printf("layout: upload timed out after %u bytes\n",
+                   unsigned(size));
+            return false;
+        }
+        const int c = stdio_getchar_timeout_us(timeout_us);
+        if (c < 0 || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            continue;
+        heard_us = time_us_32();
+        if (c == '.')
+            break;
+        const int v = hex_val(c);
+        if (v < 0 || size >= size_max) {
+            printf("layout: bad upload at byte %u\n", unsigned(size));
+            return false;
+        }
+        if (hi < 0) {
+            hi = v;
+        } else {
+            // straight into the sector image, which save() writes from
+            FlashSector::buf()[size++] = uint8_t((hi << 4) | v);
+            hi = -1;
+        }
+    }
+
+    if (!save(FlashSector::buf(), size)) {
+        printf("layout: upload of %u bytes is not a layout\n", unsigned(size));
+        return false;
+    }
+    printf("layout: saved %u bytes, %d nodes\n", unsigned(size), _node_cnt);
+    return true;
+}
+
+
+void Layout::print() const
+{
+    if (!loaded()) {
+        printf("layout: none\n");
+        return;
+    }
+
+    printf("layout:\n");
+    for (int n = 0; n < _node_cnt; n++) {
+        printf("  %-8s", _name[n]);
+        if (_node[n].sensor >= 0)
+            printf(" sensor %d", _node[n].sensor);
+        if (_node[n].sensor2 >= 0)
+            printf(" sensor2 %d", _node[n].sensor2);
+        if (_node[n].turnout >= 0)
+            printf(" turnout %d", _node[n].turnout);
+        printf("\n");
+    }
+
+    // distances, with a * where the turnouts matter
+    printf("  %-8s", "mm");
+    for (int b = 0; b < _node_cnt; b++)
+        printf(" %7.7s", _name[b]);
+    printf("\n");
+    for (int a = 0; a < _node_cnt; a++) {
+        printf("  %-8s", _name[a]);
+        for (int b = 0; b < _node_cnt; b++) {
+            if (_dist_mm[a][b] == dist_none)
+                printf("       -");
+            else
+                printf(" %6u%c", unsigned(_dist_mm[a][b]),
+                       (_turnouts[a][b] != 0) ? '*' : ' ');
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Layout geometry as data, in the third-from-last sector of flash
+// (FlashSector; RosterAlias and ParamStore have the last two), so changing
+// the layout doesn't need a rebuild.
+//
+// The layout is a graph. Nodes are places that matter: sensors, turnouts,
+// the ends of spurs. Segments are the track between them, with lengths.
+// A node has two ends, a and b, and a train passes through one by going
+// in one end and out the other. A turnout's points are its a end. Both
+// legs are on its b end, and a segment there says which leg it is, so a
+// route can't go from one leg to the other without reversing.
+//
+// load() checks the image and works out, for every pair of nodes, the
+// shortest way from one to the other without reversing (Floyd-Warshall),
+// and how the turnouts have to be set for it. After that, dist_mm() and
+// route() are table lookups.
+//
+// The image is compiled from a text description on the host (see
+// host/layout_tool.cpp) and uploaded over USB: the app calls receive()
+// when it sees 'L', and the tool's output starts with one.
+
+class Layout
+{
+public:
+
+    static constexpr uint32_t magic = 0x5459414c; // "LAYT"
+    static constexpr uint16_t version = 1;
+
+    static constexpr int node_max = 32;
+    static constexpr int seg_max = 64;
+    static constexpr int turnout_max = 8;
+    static constexpr int name_max = 8; // with the nul, if there's room
+
+    // The image: Header, then node_cnt Nodes, then seg_cnt Segs.
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t size; // the whole image
+        uint8_t node_cnt;
+        uint8_t seg_cnt;
+        uint16_t pad;
+        uint32_t crc; // over everything after the header
+    };
+
+    struct Node {
+        char name[name_max];
+        int8_t sensor;  // Sensor index, -1 if none
+        int8_t sensor2; // Sensor2 (distance sensor) index, -1 if none
+        int8_t turnout; // turnout index, -1 if none
+        uint8_t pad;
+    };
+
+    static constexpr uint8_t end_a = 0;
+    static constexpr uint8_t end_b = 1;
+    static constexpr uint8_t leg_straight = 0;
+    static constexpr uint8_t leg_diverging = 1;
+
+    struct Seg {
+        uint8_t node[2];
+        uint8_t end[2]; // end_a or end_b of each node
+        uint8_t leg[2]; // on a turnout's b end, which leg
+        uint16_t len_mm;
+    };
+
+    static constexpr size_t size_max = 4096;
+
+    // FNV-1a
+    static uint32_t crc(const uint8_t *p, size_t len)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++)
+            h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+
+    Layout();
+
+    // Check and precompute; false (and nothing loaded) if image is bad.
+    bool load(const uint8_t *image, size_t size);
+
+    // from flash
+    bool load();
+
+    // Write image to flash (after checking it) and load it.
+    bool save(const uint8_t *image, size_t size);
+
+    // Read an upload (hex, ending with '.') from the console and save it;
+    // false if it's bad or nothing comes for timeout_us.
+    bool receive(uint32_t timeout_us = 2'000'000);
+
+    bool loaded() const
+    {
+        return _node_cnt > 0;
+    }
+
+    int node_cnt() const
+    {
+        return _node_cnt;
+    }
+
+    // -1 if there's no node called name
+    int node(const char *name) const;
+
+    const char *name(int node) const
+    {
+        return _name[node];
+    }
+
+    int sensor(int node) const
+    {
+        return _node[node].sensor;
+    }
+
+    int sensor2(int node) const
+    {
+        return _node[node].sensor2;
+    }
+
+    // Along the shortest way from one to the other without reversing; -1
+    // if there's no way.
+    int dist_mm(int from, int to) const
+    {
+        return (_dist_mm[from][to] == dist_none) ? -1 : _dist_mm[from][to];
+    }
+
+    // The turnouts from's route to to goes through (bit per turnout), and
+    // which of them have to be straight; false if there's no way.
+    bool route(int from, int to, uint8_t &turnouts, uint8_t &straight) const
+    {
+        turnouts = _turnouts[from][to];
+        straight = _straight[from][to];
+        return _dist_mm[from][to] != dist_none;
+    }
+
+    void print() const;
+
+private:
+
+    static constexpr uint16_t dist_none = UINT16_MAX;
+
+    int _node_cnt;
+    Node _node[node_max];
+    char _name[node_max][name_max + 1];
+
+    // per pair of nodes, from the routes
+    uint16_t _dist_mm[node_max][node_max];
+    uint8_t _turnouts[node_max][node_max];
+    uint8_t _straight[node_max][node_max];
+
+    static bool check(const uint8_t *image, size_t size);
+    void routes(const Seg *seg, int seg_cnt);
+};
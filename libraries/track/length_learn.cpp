@@ -0,0 +1,119 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+//
+#include "length_learn.h"
+
+
+LengthLearn::LengthLearn(int slot_cnt) :
+    _slot_cnt(slot_cnt < slot_max ? slot_cnt : slot_max),
+    _slot{}
+{
+}
+
+
+int LengthLearn::mean_mm(const Slot &s) const
+{
+    return (s.sum + s.cnt / 2) / s.cnt;
+}
+
+
+int LengthLearn::sd_mm(const Slot &s) const
+{
+    if (s.cnt < 2)
+        return 0;
+    const int64_t n = s.cnt;
+    const int64_t var = (s.sum2 * n - int64_t(s.sum) * s.sum) / (n * (n - 1));
+    int sd = 0;
+    while (int64_t(sd + 1) * (sd + 1) <= var)
+        sd++;
+    return sd;
+}
+
+
+void LengthLearn::add(int slot, int mm)
+{
+    if (slot < 0 || slot >= _slot_cnt || mm <= 0)
+        return;
+    Slot &s = _slot[slot];
+
+    if (s.samples >= sample_min && abs(mm - mean_mm(s)) > outlier_mm) {
+        s.outliers++;
+        const int lo = (s.run > 0 && s.run_min < mm) ? s.run_min : mm;
+        const int hi = (s.run > 0 && s.run_max > mm) ? s.run_max : mm;
+        if (s.run == 0 || hi - lo > outlier_mm) {
+            // start a new run with this one
+            s.run = 0;
+            s.run_sum = 0;
+            s.run_sum2 = 0;
+            s.run_min = mm;
+            s.run_max = mm;
+        }
+        s.run++;
+        s.run_sum += mm;
+        s.run_sum2 += int64_t(mm) * mm;
+        if (mm < s.run_min)
+            s.run_min = mm;
+        if (mm > s.run_max)
+            s.run_max = mm;
+        if (s.run >= reseed_cnt) {
+            s.cnt = s.run;
+            s.sum = s.run_sum;
+            s.sum2 = s.run_sum2;
+            s.samples += s.run;
+            s.outliers -= s.run;
+            s.reseeds++;
+            s.run = 0;
+        }
+        return;
+    }
+    s.run = 0;
+
+    if (s.cnt >= decay_cnt) {
+        s.sum /= 2;
+        s.sum2 /= 2;
+        s.cnt /= 2;
+    }
+    s.cnt++;
+    s.sum += mm;
+    s.sum2 += int64_t(mm) * mm;
+    s.samples++;
+}
+
+
+bool LengthLearn::settled(int slot) const
+{
+    return slot >= 0 && slot < _slot_cnt && _slot[slot].samples >= sample_min;
+}
+
+
+int LengthLearn::len_mm(int slot, int dflt_mm) const
+{
+    if (!settled(slot))
+        return dflt_mm;
+    return mean_mm(_slot[slot]);
+}
+
+
+int LengthLearn::margin_mm(int slot, int dflt_mm) const
+{
+    if (!settled(slot))
+        return dflt_mm;
+    const int m = 3 * sd_mm(_slot[slot]);
+    return (m > margin_min) ? m : margin_min;
+}
+
+
+void LengthLearn::print(const char *what) const
+{
+    for (int i = 0; i < _slot_cnt; i++) {
+        const Slot &s = _slot[i];
+        if (s.samples == 0)
+            continue;
+        printf("%s %d: %d mm, sd %d mm, %d samples, %d outliers, "
+               "%d reseeds%s\n",
+               what, i, mean_mm(s), sd_mm(s), s.samples, s.outliers,
+               s.reseeds, settled(i) ? "" : " (not settled)");
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+// Lengths (of cars, of a loco) learned from measurements, so moves that
+// have to allow for them can allow less.
+//
+// Each slot keeps a running mean and spread of its samples. Until it has
+// sample_min of them, len_mm() and margin_mm() give what the app would
+// have used anyway; after that, the mean, and a margin of three standard
+// deviations (at least margin_min). A sample more than outlier_mm from a
+// settled mean (a misread sensor, couplers that let go) is counted but
+// not used. The sums are halved every decay_cnt samples, so a slot
+// follows a slow change (e.g. a loco that's getting faster as it wears
+// in) rather than averaging it away. A sudden one (a different car in
+// the slot, a coupler swapped) shows as outliers that agree with each
+// other: reseed_cnt of them in a row, within outlier_mm of each other,
+// replace what the slot had.
+
+class LengthLearn
+{
+public:
+
+    static constexpr int slot_max = 16;
+    static constexpr int sample_min = 3;
+    static constexpr int decay_cnt = 32;
+    static constexpr int margin_min = 10;
+    static constexpr int outlier_mm = 40;
+    static constexpr int reseed_cnt = 3;
+
+    LengthLearn(int slot_cnt);
+
+    void add(int slot, int mm);
+
+    bool settled(int slot) const;
+
+    int len_mm(int slot, int dflt_mm) const;
+
+    // Allowance for how far off len_mm() might be.
+    int margin_mm(int slot, int dflt_mm) const;
+
+    void print(const char *what) const;
+
+private:
+
+    int _slot_cnt;
+
+    struct Slot {
+        int cnt;      // samples in the sums
+        int32_t sum;  // mm
+        int64_t sum2; // mm^2
+        int samples;  // used, ever
+        int outliers; // not used
+        int reseeds;
+        // outliers in a row that agree, to reseed from
+        int run;
+        int32_t run_sum;
+        int64_t run_sum2;
+        int run_min;
+        int run_max;
+    };
+    Slot _slot[slot_max];
+
+    int mean_mm(const Slot &s) const;
+    int sd_mm(const Slot &s) const;
+};
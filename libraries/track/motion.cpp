@@ -0,0 +1,480 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+// pico
+#include "pico/stdlib.h"
+// dcc
+#include "dcc_api.h"
+// railroad
+#include "locos.h"
+#include "sensor.h"
+#include "sensor2.h"
+//
+#include "motion.h"
+#include "speed_table.h"
+
+
+Motion::Motion(LoopFunc *loop, intptr_t loop_arg) :
+    _loop(loop),
+    _loop_arg(loop_arg),
+    _speed_func(nullptr),
+    _speed_arg(0),
+    _send_func(nullptr),
+    _send_arg(0),
+    _loco_id(0),
+    _loco(nullptr),
+    _table(nullptr),
+    _accel_mms2(0),
+    _decel_mms2(0),
+    _ramp_accel_mms2(0),
+    _ramp_decel_mms2(0),
+    _ramp_jerk_mms3(0),
+    _sent_dcc(0),
+    _v0(0),
+    _v1(0),
+    _a(0),
+    _j(0),
+    _t0_us(0),
+    _odo_um(0)
+{
+}
+
+
+void Motion::init(int loco_id, const Loco *loco)
+{
+    _loco_id = loco_id;
+    _loco = loco;
+    _v0 = _v1 = _a = _j = 0;
+    _sent_dcc = 0;
+    _t0_us = time_us_32();
+    _odo_um = 0;
+}
+
+
+void Motion::speed_callback(SpeedFunc *func, intptr_t arg)
+{
+    _speed_func = func;
+    _speed_arg = arg;
+}
+
+
+void Motion::send_callback(SendFunc *func, intptr_t arg)
+{
+    _send_func = func;
+    _send_arg = arg;
+}
+
+
+void Motion::speed_table(const SpeedTable *table)
+{
+    _table = table;
+}
+
+
+// The decoder takes cv * 0.896 sec to ramp over the whole speed range.
+void Motion::momentum(int cv3, int cv4)
+{
+    assert(_loco != nullptr);
+    const int full_mms = to_mms(126);
+    _accel_mms2 = (cv3 > 0) ? (full_mms * 1000) / (cv3 * 896) : 0;
+    _decel_mms2 = (cv4 > 0) ? (full_mms * 1000) / (cv4 * 896) : 0;
+}
+
+
+void Motion::ramp(int accel_mms2, int decel_mms2, int jerk_mms3)
+{
+    _ramp_accel_mms2 = (accel_mms2 > 0) ? accel_mms2 : 0;
+    _ramp_decel_mms2 = (decel_mms2 > 0) ? decel_mms2 : _ramp_accel_mms2;
+    _ramp_jerk_mms3 = (jerk_mms3 > 0) ? jerk_mms3 : 0;
+}
+
+
+// The step for the modeled speed; it only changes when the ramp gets
+// (halfway) to the next one, which is when it's sent.
+void Motion::loop()
+{
+    if (_ramp_accel_mms2 == 0 || _loco == nullptr)
+        return;
+    send(to_dcc(speed_now()));
+}
+
+
+uint32_t Motion::time_us(int dist_mm, int speed_mms)
+{
+    const int64_t s = abs(speed_mms);
+    assert(s > 0);
+    return uint32_t((int64_t(abs(dist_mm)) * 1'000'000 + s / 2) / s);
+}
+
+
+void Motion::speed(int speed_mms)
+{
+    command(speed_mms);
+}
+
+
+void Motion::stop()
+{
+    command(0);
+}
+
+
+int Motion::speed_now() const
+{
+    const int m = speed_at(elapsed_us());
+    const int v = (_v1 != 0) ? _v1 : _v0;
+    return (v < 0) ? -m : m;
+}
+
+
+int Motion::stop_mm() const
+{
+    return stop_mm(speed_at(elapsed_us()));
+}
+
+
+int Motion::odometer_mm() const
+{
+    return int((_odo_um + segment_um()) / 1000);
+}
+
+
+void Motion::move(int dist_mm, int speed_mms, bool stop)
+{
+    assert(speed_mms != 0);
+    command(speed_mms);
+
+    const int64_t dist_um = int64_t(abs(dist_mm)) * 1000;
+    int64_t t_us = travel_us(dist_um);
+
+    if (stop) {
+        // stop short by the stopping distance from the speed it will be
+        // going then, which depends on where that is; twice is close enough
+        int stop_at_mm = stop_mm(abs(_v1));
+        for (int i = 0; i < 2; i++) {
+            const int64_t go_um = dist_um - int64_t(stop_at_mm) * 1000;
+            t_us = (go_um > 0) ? travel_us(go_um) : 0;
+            stop_at_mm = stop_mm(speed_at(t_us));
+        }
+    }
+
+    while (t_us > 0) {
+        const int32_t for_us = int32_t(t_us < INT32_MAX ? t_us : INT32_MAX);
+        _loop(for_us, _loop_arg);
+        t_us -= for_us;
+    }
+
+    if (stop)
+        command(0);
+}
+
+
+bool Motion::move_until(const Sensor &s, bool level, int speed_mms,
+                        int max_mm)
+{
+    command(speed_mms);
+    const int64_t max_um = int64_t(abs(max_mm)) * 1000;
+    while (bool(s) != level) {
+        if (max_um > 0 && travel_um(elapsed_us()) >= max_um)
+            return false;
+        _loop(0, _loop_arg);
+    }
+    return true;
+}
+
+
+int Motion::approach(const Sensor2 &s, int target_mm, int speed_mms,
+                     bool stop)
+{
+    command(speed_mms);
+    int dist_mm;
+    while ((dist_mm = s.dist_mm()) > target_mm + (stop ? stop_mm() : 0))
+        _loop(0, _loop_arg);
+    if (stop)
+        command(0);
+    return dist_mm;
+}
+
+
+// Speed (unsigned) t_us after the last command.
+//
+// An S-curve ramp has three parts: the acceleration goes up at _j for
+// jerk_us(), stays at _a, then comes down at _j for jerk_us() (when the
+// change is too small for it to get to _a, the middle part is empty and
+// the two ends meet). Its speed is symmetric about the middle.
+int Motion::speed_at(int64_t t_us) const
+{
+    const int m0 = abs(_v0);
+    const int m1 = abs(_v1);
+    const int64_t r_us = ramp_us();
+    if (t_us >= r_us)
+        return m1;
+
+    int64_t dv;
+    if (_j == 0) {
+        dv = (int64_t(_a) * t_us) / 1'000'000;
+    } else {
+        const int64_t j_us = jerk_us();
+        if (t_us < j_us) {
+            dv = (_j * t_us * t_us) / 2'000'000'000'000;
+        } else if (t_us < r_us - j_us) {
+            dv = (_j * j_us * j_us) / 2'000'000'000'000 +
+                 (_j * j_us * (t_us - j_us)) / 1'000'000'000'000;
+        } else {
+            const int64_t left_us = r_us - t_us;
+            dv = abs(m1 - m0) - (_j * left_us * left_us) / 2'000'000'000'000;
+        }
+    }
+    return int((m1 > m0) ? m0 + dv : m0 - dv);
+}
+
+
+// Distance to stop from m mm/sec.
+int Motion::stop_mm(int m) const
+{
+    if (_ramp_accel_mms2 > 0) {
+        const int64_t r_us = ramp_us(m, rate(m, 0), _ramp_jerk_mms3);
+        return int((m * r_us + 1'000'000) / 2'000'000);
+    }
+    if (_decel_mms2 == 0)
+        return _loco->stop_mm(m);
+    const int a = rate(m, 0);
+    return (a == 0) ? 0 : (m * m + a) / (2 * a);
+}
+
+
+// A step the calibration has as stopped (a measured table can round step 1
+// to 0 mm/sec) is taken to go at the speed asked for, or move() would wait
+// forever.
+int Motion::quantize(int speed_mms) const
+{
+    const int mms = to_mms(to_dcc(speed_mms));
+    return (mms == 0) ? speed_mms : mms;
+}
+
+
+// A speed that isn't 0 is at least step 1.
+int Motion::to_dcc(int speed_mms) const
+{
+    int dcc;
+    if (_table != nullptr)
+        dcc = _table->dcc(speed_mms);
+    else
+        dcc = _loco->speed_dcc(speed_mms);
+    if (dcc == 0 && speed_mms != 0)
+        dcc = (speed_mms < 0) ? -1 : 1;
+    return dcc;
+}
+
+
+int Motion::to_mms(int speed_dcc) const
+{
+    if (_table != nullptr)
+        return _table->mms(speed_dcc);
+    return _loco->speed_mms(speed_dcc);
+}
+
+
+// Ramp rate from m0 to m1 (mm/sec, unsigned): ours or the decoder's
+// momentum, or the loco's own limit (what stop_mm implies) if that's
+// lower. Zero means a step change.
+int Motion::rate(int m0, int m1) const
+{
+    const int64_t m = (m0 > m1) ? m0 : m1;
+    const int64_t d_mm = (m > 0) ? _loco->stop_mm(int(m)) : 0;
+    const int a_loco = (d_mm > 0) ? int((m * m) / (2 * d_mm)) : 0;
+    int a_dcc = (m1 > m0) ? _accel_mms2 : _decel_mms2;
+    if (_ramp_accel_mms2 > 0)
+        a_dcc = (m1 > m0) ? _ramp_accel_mms2 : _ramp_decel_mms2;
+    if (a_dcc == 0)
+        return a_loco;
+    if (a_loco == 0)
+        return a_dcc;
+    return (a_dcc < a_loco) ? a_dcc : a_loco;
+}
+
+
+// New command: the ramp starts from wherever the model says we are now.
+void Motion::command(int speed_mms)
+{
+    assert(_loco != nullptr);
+
+    const int v1 = quantize(speed_mms);
+    int v0 = speed_now();
+    if (v0 != 0 && v1 != 0 && (v0 < 0) != (v1 < 0))
+        v0 = 0; // reversing; assume it stopped first
+
+    const bool changed = (v1 != _v1);
+
+    _odo_um += segment_um();
+    _v0 = v0;
+    _v1 = v1;
+    _a = rate(abs(v0), abs(v1));
+    _j = (_ramp_accel_mms2 > 0) ? _ramp_jerk_mms3 : 0;
+    _t0_us = time_us_32();
+
+    if (changed && _speed_func != nullptr)
+        _speed_func(speed_mms, _speed_arg);
+
+    if (_ramp_accel_mms2 > 0)
+        loop();
+    else
+        send(to_dcc(speed_mms));
+}
+
+
+void Motion::send(int speed_dcc)
+{
+    if (speed_dcc == _sent_dcc)
+        return;
+    _sent_dcc = speed_dcc;
+    if (_send_func != nullptr)
+        _send_func(speed_dcc, _send_arg);
+    else
+        DccApi::loco_speed_set(_loco_id, speed_dcc);
+}
+
+
+static int64_t isqrt(int64_t n)
+{
+    if (n <= 0)
+        return 0;
+    int64_t x = n;
+    int64_t y = (x + 1) / 2;
+    while (y < x) {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+    return x;
+}
+
+
+// Microseconds to change speed by dv mm/sec at up to a mm/sec^2, the
+// acceleration itself changing at j mm/sec^3 (0 for at once).
+int64_t Motion::ramp_us(int64_t dv, int a, int j)
+{
+    if (a == 0 || dv == 0)
+        return 0;
+    if (j == 0)
+        return (dv * 1'000'000) / a;
+    if (dv * j >= int64_t(a) * a)
+        return (dv * 1'000'000) / a + (int64_t(a) * 1'000'000) / j;
+    return 2 * isqrt((dv * 1'000'000'000'000) / j); // never gets to a
+}
+
+
+int64_t Motion::ramp_us() const
+{
+    return ramp_us(abs(abs(_v1) - abs(_v0)), _a, _j);
+}
+
+
+// Length of each end of an S-curve ramp, where the acceleration changes.
+int64_t Motion::jerk_us() const
+{
+    if (_j == 0)
+        return 0;
+    const int64_t dv = abs(abs(_v1) - abs(_v0));
+    if (dv * _j >= int64_t(_a) * _a)
+        return (int64_t(_a) * 1'000'000) / _j;
+    return ramp_us() / 2;
+}
+
+
+// Distance covered in t_us from a standing start with the acceleration
+// going up at j mm/sec^3: j t^3 / 6. Done in 10s of us so it doesn't
+// overflow.
+static int64_t jerk_um(int j, int64_t t_us)
+{
+    const int64_t t = t_us / 10;
+    const int64_t v_umps = (j * t * t) / 20'000'000; // j t^2 / 2
+    return (v_umps * t) / 300'000;
+}
+
+
+// Microseconds from the last command to go dist_um.
+int64_t Motion::travel_us(int64_t dist_um) const
+{
+    const int64_t m0 = abs(_v0);
+    const int64_t m1 = abs(_v1);
+    const int64_t r_us = ramp_us();
+    const int64_t r_um = ((m0 + m1) * r_us) / 2000;
+
+    if (dist_um >= r_um) {
+        if (m1 == 0)
+            return INT64_MAX; // stopping short of it
+        return r_us + ((dist_um - r_um) * 1000 + m1 / 2) / m1;
+    }
+
+    if (_j != 0) {
+        // no handy inverse; travel_um only goes up, so bisect it
+        int64_t lo_us = 0;
+        int64_t hi_us = r_us;
+        while (hi_us - lo_us > 100) {
+            const int64_t mid_us = (lo_us + hi_us) / 2;
+            if (travel_um(mid_us) < dist_um)
+                lo_us = mid_us;
+            else
+                hi_us = mid_us;
+        }
+        return hi_us;
+    }
+
+    // within the ramp: v0 t + a t^2 / 2 = d, in um/sec and um
+    const int64_t v0 = m0 * 1000;
+    const int64_t a = int64_t(_a) * 1000 * ((m1 > m0) ? 1 : -1);
+    const int64_t root = isqrt(v0 * v0 + 2 * a * dist_um);
+    return ((root - v0) * 1'000'000) / a;
+}
+
+
+// Distance covered t_us after the last command.
+int64_t Motion::travel_um(int64_t t_us) const
+{
+    const int64_t m0 = abs(_v0);
+    const int64_t m1 = abs(_v1);
+    const int64_t r_us = ramp_us();
+
+    if (t_us >= r_us)
+        return ((m0 + m1) * r_us) / 2000 + (m1 * (t_us - r_us)) / 1000;
+
+    if (_j != 0) {
+        const int64_t sign = (m1 > m0) ? 1 : -1;
+        const int64_t j_us = jerk_us();
+        if (t_us < j_us)
+            return (m0 * t_us) / 1000 + sign * jerk_um(_j, t_us);
+        if (t_us >= r_us - j_us) {
+            // the end mirrors the start, back from the end of the ramp
+            const int64_t left_us = r_us - t_us;
+            return ((m0 + m1) * r_us) / 2000 - (m1 * left_us) / 1000 +
+                   sign * jerk_um(_j, left_us);
+        }
+        // steady acceleration from the end of the first part
+        const int64_t mid_us = t_us - j_us;
+        const int64_t v_umps =
+            m0 * 1000 + sign * (_j * j_us * j_us) / 2'000'000'000;
+        const int64_t a_mms2 = (_j * j_us) / 1'000'000;
+        return (m0 * j_us) / 1000 + sign * jerk_um(_j, j_us) +
+               (v_umps * mid_us) / 1'000'000 +
+               sign * (a_mms2 * mid_us * mid_us) / 2'000'000'000;
+    }
+
+    const int64_t a = int64_t(_a) * ((m1 > m0) ? 1 : -1);
+    return (m0 * t_us) / 1000 + (a * t_us * t_us) / 2'000'000'000;
+}
+
+
+// Signed distance since the last command.
+int64_t Motion::segment_um() const
+{
+    const int64_t um = travel_um(elapsed_us());
+    const int v = (_v1 != 0) ? _v1 : _v0;
+    return (v < 0) ? -um : um;
+}
+
+
+uint32_t Motion::elapsed_us() const
+{
+    return time_us_32() - _t0_us;
+}
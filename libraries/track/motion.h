@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+// railroad
+#include "locos.h"
+#include "sensor.h"
+#include "sensor2.h"
+
+class SpeedTable;
+
+// Moving a loco by distance, or until a sensor says it's there.
+//
+// Apps used to set a speed and then wait dist_mm * 1'000'000 / speed_mms
+// microseconds, in 32-bit int, which overflows past ~2.1 m and ignores the
+// decoder's momentum. Motion keeps a model of the loco's actual speed
+// since the last command (ramping at the cv3/cv4 rates, or braking as
+// Loco::stop_mm says when cv4 is 0), so a move that starts from a stop or
+// from another speed waits for the distance really covered. Time math is
+// 64-bit micrometers and microseconds.
+//
+// Speeds are signed mm/sec, as the app's roster calibration has them; a
+// speed is quantized to the dcc step it will be sent as before it's used
+// for timing (never to step 0 unless it is 0). Reversing is assumed to
+// start from a stop (the apps always stop first).
+//
+// With ramp(), Motion does the momentum itself instead of the decoder
+// (cv3 and cv4 should be 0): a command starts a trapezoid ramp, or an
+// S-curve one if there's a jerk limit, from the modeled speed to the new
+// one, and loop() sends a speed step each time the ramp gets to the next
+// one, so it takes one packet per step and the model is what was sent.
+// Stopping is on the ramp too, so where a loco stops no longer depends
+// on its decoder.
+//
+// The app supplies its loop (so sensors, sound, logging etc. keep running
+// while Motion waits), and calls loop() from it. It can have a callback
+// for each new command (e.g. to profile it) and its own way of sending a
+// speed step (e.g. to trace it); otherwise Motion sends it with DccApi.
+
+class Motion
+{
+public:
+
+    typedef void(LoopFunc)(int32_t for_us, intptr_t arg);
+    typedef void(SpeedFunc)(int speed_mms, intptr_t arg);
+    typedef void(SendFunc)(int speed_dcc, intptr_t arg);
+
+    Motion(LoopFunc *loop, intptr_t loop_arg = 0);
+
+    void init(int loco_id, const Loco *loco);
+
+    // Called with each new commanded speed.
+    void speed_callback(SpeedFunc *func, intptr_t arg);
+
+    // Called to send each speed step.
+    void send_callback(SendFunc *func, intptr_t arg);
+
+    // Convert speeds with table rather than the loco's own functions (it
+    // has to outlive the Motion). Set it before commanding any speeds.
+    void speed_table(const SpeedTable *table);
+
+    // The momentum cvs as the decoder has them.
+    void momentum(int cv3, int cv4);
+
+    // Ramp speeds here, at accel_mms2 speeding up and decel_mms2 slowing
+    // down, limited to jerk_mms3 if that's not 0. An accel_mms2 of 0 goes
+    // back to sending commanded speeds as they are.
+    void ramp(int accel_mms2, int decel_mms2, int jerk_mms3 = 0);
+
+    // Sends the ramp's next speed step when it's time; call it from the
+    // app's loop.
+    void loop();
+
+    // Microseconds to go dist_mm at a steady speed_mms.
+    static uint32_t time_us(int dist_mm, int speed_mms);
+
+    // Set a speed and return at once.
+    void speed(int speed_mms);
+
+    // Set speed 0 and return at once (the loco may still be rolling).
+    void stop();
+
+    // Modeled speed right now.
+    int speed_now() const;
+
+    // Distance it would take to stop from the modeled speed.
+    int stop_mm() const;
+
+    // Signed distance the model has gone since init(). It's off by as
+    // much as the speed calibration is, but a length measured with it is
+    // off the same way as a move, so it can be used in one.
+    int odometer_mm() const;
+
+    // Go dist_mm at speed_mms. With stop, stop so as to come to rest
+    // dist_mm from here (or as near as the stopping distance allows).
+    void move(int dist_mm, int speed_mms, bool stop = false);
+
+    // Go at speed_mms until s reads level. With max_mm > 0, give up after
+    // that far and return false (still moving).
+    bool move_until(const Sensor &s, bool level, int speed_mms,
+                    int max_mm = 0);
+
+    // Go at speed_mms until s reads target_mm or less. With stop, stop
+    // early enough to come to rest at target_mm. Returns the last reading.
+    int approach(const Sensor2 &s, int target_mm, int speed_mms,
+                 bool stop = false);
+
+private:
+
+    LoopFunc *_loop;
+    intptr_t _loop_arg;
+    SpeedFunc *_speed_func;
+    intptr_t _speed_arg;
+    SendFunc *_send_func;
+    intptr_t _send_arg;
+
+    int _loco_id;
+    const Loco *_loco;
+    const SpeedTable *_table;
+
+    int _accel_mms2; // 0 means no momentum
+    int _decel_mms2; // 0 means braking (Loco::stop_mm)
+
+    // ramping here; 0 means the decoder does it
+    int _ramp_accel_mms2;
+    int _ramp_decel_mms2;
+    int _ramp_jerk_mms3; // 0 means a trapezoid ramp
+
+    int _sent_dcc; // speed step last sent
+
+    // The model: speed went from _v0 toward _v1 (both signed mm/sec) at
+    // _a (mm/sec^2, 0 for a step change), with the acceleration ramping
+    // at _j (mm/sec^3, 0 for none), starting at _t0_us.
+    int _v0;
+    int _v1;
+    int _a;
+    int _j;
+    uint32_t _t0_us;
+
+    int64_t _odo_um; // to _t0_us
+
+    int speed_at(int64_t t_us) const;
+    int stop_mm(int m) const;
+    int quantize(int speed_mms) const;
+    int to_dcc(int speed_mms) const;
+    int to_mms(int speed_dcc) const;
+    int rate(int v0, int v1) const;
+    void command(int speed_mms);
+    void send(int speed_dcc);
+    static int64_t ramp_us(int64_t dv, int a, int j);
+    int64_t ramp_us() const;
+    int64_t jerk_us() const;
+    int64_t travel_us(int64_t dist_um) const;
+    int64_t travel_um(int64_t t_us) const;
+    int64_t segment_um() const;
+    uint32_t elapsed_us() const;
+};
@@ -0,0 +1,102 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+//
+#include "flash_sector.h"
+#include "param_store.h"
+
+static constexpr uint32_t slot_magic = 0x50534c54; // "PSLT"
+
+static const uint8_t *store()
+{
+    return FlashSector::data(FlashSector::Id::Params);
+}
+
+
+// FNV-1a over everything before the crc
+uint32_t ParamStore::crc(const Slot &slot)
+{
+    const uint8_t *p = (const uint8_t *)&slot;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(Slot, crc); i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+
+bool ParamStore::valid(const Slot &slot)
+{
+    return slot.magic == slot_magic && slot.cnt <= val_max &&
+           slot.crc == crc(slot);
+}
+
+
+const ParamStore::Slot *ParamStore::find(uint32_t sn)
+{
+    const Slot *slot = (const Slot *)store();
+    for (int i = 0; i < slot_max; i++)
+        if (valid(slot[i]) && slot[i].sn == sn)
+            return &slot[i];
+    return nullptr;
+}
+
+
+bool ParamStore::load(uint32_t sn, uint32_t version, int16_t *val, int cnt)
+{
+    const Slot *slot = find(sn);
+    if (slot == nullptr || slot->version != version || slot->cnt != cnt)
+        return false;
+    memcpy(val, slot->val, cnt * sizeof(val[0]));
+    return true;
+}
+
+
+bool ParamStore::save(uint32_t sn, uint32_t version, const int16_t *val,
+                      int cnt)
+{
+    static_assert(sizeof(Slot) * slot_max <= FlashSector::size);
+
+    if (cnt < 0 || cnt > val_max)
+        return false;
+
+    uint8_t *sector = FlashSector::buf();
+    memcpy(sector, store(), FlashSector::size);
+    Slot *slot = (Slot *)sector;
+
+    // sn's slot, else a free one, else the oldest
+    int use = -1;
+    uint32_t seq = 0;
+    for (int i = 0; i < slot_max; i++) {
+        if (valid(slot[i]) && slot[i].seq >= seq)
+            seq = slot[i].seq + 1;
+    }
+    for (int i = 0; i < slot_max && use < 0; i++)
+        if (valid(slot[i]) && slot[i].sn == sn)
+            use = i;
+    for (int i = 0; i < slot_max && use < 0; i++)
+        if (!valid(slot[i]))
+            use = i;
+    if (use < 0) {
+        use = 0;
+        for (int i = 1; i < slot_max; i++)
+            if (slot[i].seq < slot[use].seq)
+                use = i;
+    }
+
+    Slot &s = slot[use];
+    memset(&s, 0, sizeof(s));
+    s.magic = slot_magic;
+    s.sn = sn;
+    s.version = version;
+    s.seq = seq;
+    s.cnt = cnt;
+    memcpy(s.val, val, cnt * sizeof(val[0]));
+    s.crc = crc(s);
+
+    // erasing leaves 0xff, which is never a valid slot
+    if (!FlashSector::write(FlashSector::Id::Params))
+        return false;
+
+    return find(sn) != nullptr;
+}
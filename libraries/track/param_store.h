@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// Per-loco parameter sets in the last sector of flash (FlashSector).
+//
+// The sector holds up to slot_max sets, each keyed by the loco's serial
+// number and a version the app bumps whenever the meaning or number of
+// its parameters changes (so old sets are ignored, not misread). Saving
+// rewrites the whole sector, so it's for settings that change rarely
+// (e.g. when a tuning pass finds something better), not for logging.
+
+class ParamStore
+{
+public:
+
+    static constexpr int val_max = 24;
+    static constexpr int slot_max = 16;
+
+    // false if there's no set for sn with that version and count
+    static bool load(uint32_t sn, uint32_t version, int16_t *val, int cnt);
+
+    // Replaces sn's set, or the oldest set if the sector is full.
+    static bool save(uint32_t sn, uint32_t version, const int16_t *val,
+                     int cnt);
+
+private:
+
+    struct Slot {
+        uint32_t magic;
+        uint32_t sn;
+        uint32_t version;
+        uint32_t seq; // higher is newer
+        uint16_t cnt;
+        int16_t val[val_max];
+        uint16_t pad;
+        uint32_t crc;
+    };
+
+    static const Slot *find(uint32_t sn);
+    static uint32_t crc(const Slot &slot);
+    static bool valid(const Slot &slot);
+};
@@ -0,0 +1,197 @@
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "pico/stdlib.h"
+//
+#include "profile.h"
+
+
+Profile::Profile() :
+    _stat{},
+    _stat_cnt(0),
+    _dropped(0),
+    _cycles(0),
+    _cycle_us(0),
+    _phase(nullptr),
+    _phase_us(0),
+    _seg(0),
+    _seg_open(false),
+    _seg_mms(0),
+    _seg_us(0),
+    _dwell(0)
+{
+}
+
+
+void Profile::phase(const char *name)
+{
+    if (_phase != nullptr)
+        phase_end();
+
+    _phase = name;
+    _phase_us = time_us_32();
+    _seg = 0;
+    _seg_open = false;
+    _dwell = 0;
+}
+
+
+void Profile::phase_end()
+{
+    if (_phase == nullptr)
+        return;
+
+    const uint32_t now_us = time_us_32();
+    segment_end(now_us);
+    add(_phase, Kind::Phase, 0, 0, now_us - _phase_us);
+    _phase = nullptr;
+}
+
+
+void Profile::segment(int mms)
+{
+    if (_phase == nullptr)
+        return;
+
+    const uint32_t now_us = time_us_32();
+    segment_end(now_us);
+    _seg++;
+    _seg_open = true;
+    _seg_mms = mms;
+    _seg_us = now_us;
+}
+
+
+void Profile::segment_end(uint32_t now_us)
+{
+    if (!_seg_open)
+        return;
+    add(_phase, Kind::Segment, _seg, _seg_mms, now_us - _seg_us);
+    _seg_open = false;
+}
+
+
+void Profile::dwell(uint32_t want_us, uint32_t got_us)
+{
+    if (_phase == nullptr)
+        return;
+
+    _dwell++;
+    add(_phase, Kind::Dwell, _dwell, want_us, got_us);
+}
+
+
+void Profile::retries(const char *name, int count)
+{
+    add(name, Kind::Retries, 0, 0, count);
+}
+
+
+void Profile::cycle()
+{
+    const uint32_t now_us = time_us_32();
+    if (_cycles > 0)
+        add("cycle", Kind::Cycle, 0, 0, now_us - _cycle_us);
+    _cycles++;
+    _cycle_us = now_us;
+}
+
+
+void Profile::add(const char *name, Kind kind, int idx, int32_t arg,
+                  uint32_t val)
+{
+    int i;
+    for (i = 0; i < _stat_cnt; i++) {
+        const Stat &s = _stat[i];
+        if (s.name == name && s.kind == kind && s.idx == idx && s.arg == arg)
+            break;
+    }
+
+    if (i == _stat_cnt) {
+        if (_stat_cnt >= stat_max) {
+            _dropped++;
+            return;
+        }
+        _stat[i] = Stat{};
+        _stat[i].name = name;
+        _stat[i].kind = kind;
+        _stat[i].idx = idx;
+        _stat[i].arg = arg;
+        _stat_cnt++;
+    }
+
+    Stat &s = _stat[i];
+    s.win[s.cnt % win_max] = val;
+    s.cnt++;
+    if (val > s.max)
+        s.max = val;
+}
+
+
+void Profile::print() const
+{
+    printf("profile: %u cycles", unsigned(_cycles > 0 ? _cycles - 1 : 0));
+    if (_dropped > 0)
+        printf(", %u samples dropped (no room)", unsigned(_dropped));
+    printf("\n");
+    printf("%-28s %6s %9s %9s %9s\n", "(ms)", "n", "mean", "p95", "max");
+
+    // cycle first, then each phase followed by its segments and dwells
+    for (int i = 0; i < _stat_cnt; i++)
+        if (_stat[i].kind == Kind::Cycle)
+            print(_stat[i]);
+    for (int i = 0; i < _stat_cnt; i++) {
+        if (_stat[i].kind != Kind::Phase)
+            continue;
+        print(_stat[i]);
+        for (int j = 0; j < _stat_cnt; j++)
+            if (_stat[j].name == _stat[i].name &&
+                (_stat[j].kind == Kind::Segment ||
+                 _stat[j].kind == Kind::Dwell))
+                print(_stat[j]);
+    }
+    for (int i = 0; i < _stat_cnt; i++)
+        if (_stat[i].kind == Kind::Retries)
+            print(_stat[i]);
+}
+
+
+// Times in msec, retries as counts.
+void Profile::print(const Stat &s)
+{
+    const int n = std::min(int(s.cnt), win_max);
+    uint32_t v[win_max];
+    std::copy(s.win, s.win + n, v);
+    std::sort(v, v + n);
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += v[i];
+    const uint32_t p95 = v[(n * 95 + 99) / 100 - 1];
+
+    char label[40];
+    switch (s.kind) {
+    case Kind::Segment:
+        snprintf(label, sizeof(label), "  seg %d, %d mm/s", s.idx,
+                 int(s.arg));
+        break;
+    case Kind::Dwell:
+        snprintf(label, sizeof(label), "  dwell %d, %d ms", s.idx,
+                 int(s.arg / 1000));
+        break;
+    case Kind::Retries:
+        snprintf(label, sizeof(label), "%s retries", s.name);
+        break;
+    default:
+        snprintf(label, sizeof(label), "%s", s.name);
+        break;
+    }
+
+    if (s.kind == Kind::Retries)
+        printf("%-28s %6u %9.2f %9u %9u\n", label, unsigned(s.cnt),
+               double(sum) / n, unsigned(p95), unsigned(s.max));
+    else
+        printf("%-28s %6u %9.1f %9.1f %9.1f\n", label, unsigned(s.cnt),
+               sum / 1000.0 / n, p95 / 1000.0, s.max / 1000.0);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+// Where the time goes in a repeating choreography.
+//
+// An app marks its phases (fetch, uncouple, ...), each speed change within
+// a phase (the start of a segment, which lasts until the next speed change
+// or the end of the phase), each timed wait (dwell), and how many times it
+// had to retry something in a cycle. Each distinct phase, segment, dwell
+// and retry count gets its own statistics: mean and p95 of the last
+// win_max samples, and the max ever.
+//
+// Segments and dwells are numbered in order within their phase and keyed
+// by that number and their speed or length, so a run that takes another
+// path (a retry, a different spur) shows up as separate lines.
+//
+// Names must be string literals (or otherwise outlive the Profile); they're
+// compared by address.
+
+class Profile
+{
+public:
+
+    Profile();
+
+    // Start a phase, ending the current one.
+    void phase(const char *name);
+
+    void phase_end();
+
+    // Speed changed to mms.
+    void segment(int mms);
+
+    // A wait for want_us ended after got_us.
+    void dwell(uint32_t want_us, uint32_t got_us);
+
+    // Count of retries of name in this cycle.
+    void retries(const char *name, int count);
+
+    // End of a whole cycle (and start of the next).
+    void cycle();
+
+    void print() const;
+
+private:
+
+    // 96 is enough for circuits with retries on all three spurs (~14K)
+    static constexpr int stat_max = 96;
+    static constexpr int win_max = 32;
+
+    enum class Kind : uint8_t {
+        Cycle,
+        Phase,
+        Segment,
+        Dwell,
+        Retries,
+    };
+
+    struct Stat {
+        const char *name;
+        Kind kind;
+        int16_t idx;
+        int32_t arg; // mms or want_us
+        uint32_t cnt;
+        uint32_t max;
+        uint32_t win[win_max]; // last win_max values, cnt % win_max next
+    };
+
+    Stat _stat[stat_max];
+    int _stat_cnt;
+    uint32_t _dropped; // samples with no room for their stat
+
+    uint32_t _cycles;
+    uint32_t _cycle_us;
+
+    const char *_phase; // nullptr between phases
+    uint32_t _phase_us;
+    int _seg; // segments so far in the phase
+    bool _seg_open;
+    int _seg_mms;
+    uint32_t _seg_us;
+    int _dwell; // dwells so far in the phase
+
+    void segment_end(uint32_t now_us);
+
+    void add(const char *name, Kind kind, int idx, int32_t arg,
+             uint32_t val);
+
+    static void print(const Stat &s);
+};
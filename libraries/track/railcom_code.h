@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+
+// RailCom 4-of-8 line code and datagram framing (RCN-217).
+//
+// Every byte a decoder sends in the cutout has exactly four bits set. 64 of
+// the 70 such bytes carry six data bits; four more are the ACK, NACK and
+// BUSY responses, and two are reserved. Decoding is one lookup in a
+// 256-entry table built at compile time.
+//
+// Datagrams are a 4-bit id followed by data, six bits per byte. Channel 1
+// (the first two bytes of the cutout) holds one 12-bit datagram, broadcast
+// by any decoder; channel 2 holds up to six bytes of datagrams from the
+// decoder the packet was addressed to, or ACKs.
+//
+// Nothing here touches hardware, so it builds for the host too.
+
+class RailComCode
+{
+public:
+
+    // decode() results that are not data
+    static constexpr int invalid = -1;
+    static constexpr int ack = -2;
+    static constexpr int nack = -3;
+    static constexpr int busy = -4;
+
+    static constexpr uint8_t code_ack = 0xf0;
+    static constexpr uint8_t code_ack2 = 0x0f;
+    static constexpr uint8_t code_nack = 0x3c;
+    static constexpr uint8_t code_busy = 0xe1;
+
+    static constexpr int ch1_bytes = 2;
+    static constexpr int ch2_bytes = 6;
+
+    // datagram ids
+    static constexpr int id_pom = 0;
+    static constexpr int id_adr_high = 1;
+    static constexpr int id_adr_low = 2;
+    static constexpr int id_ext = 3;
+    static constexpr int id_dyn = 7;
+    static constexpr int id_xpom = 8; // 8..11
+
+    // dyn subindexes
+    static constexpr int dyn_speed_1 = 0; // 0..255 km/h
+    static constexpr int dyn_speed_2 = 1; // 256..511 km/h
+    static constexpr int dyn_qos = 7;
+
+    struct Datagram {
+        int id;
+        uint32_t data; // bits after the id, right-aligned
+    };
+
+    // 6-bit value to line code
+    static constexpr uint8_t encode(int val)
+    {
+        return _code[val & 0x3f];
+    }
+
+    // line code to 6-bit value, or one of the negative results above
+    static constexpr int decode(uint8_t code)
+    {
+        return _decode.val[code];
+    }
+
+    // Bytes in a datagram with the given id, or 0 if unknown.
+    static constexpr int dgram_bytes(int id)
+    {
+        if (id == id_pom || id == id_adr_high || id == id_adr_low)
+            return 2; // 12 bits
+        if (id == id_ext || id == id_dyn)
+            return 3; // 18 bits
+        if (id >= id_xpom && id < id_xpom + 4)
+            return 6; // 36 bits
+        return 0;
+    }
+
+    // Channel 1: exactly two data bytes.
+    static constexpr bool ch1(const uint8_t *code, int cnt, Datagram &dg)
+    {
+        if (cnt != ch1_bytes)
+            return false;
+        const int hi = decode(code[0]);
+        const int lo = decode(code[1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        dg.id = hi >> 2;
+        dg.data = ((hi & 3) << 6) | lo;
+        return true;
+    }
+
+    // Channel 2 result
+    struct Ch2 {
+        int dgrams;  // datagrams stored
+        int acks;    // ACK bytes
+        int nacks;   // NACK or BUSY bytes
+        int invalid; // bytes that aren't 4-of-8, or cut-off datagrams
+    };
+
+    // Channel 2: datagrams and ACKs, in any order.
+    static constexpr Ch2 ch2(const uint8_t *code, int cnt, Datagram *dg,
+                             int dg_max)
+    {
+        Ch2 r = {0, 0, 0, 0};
+        int i = 0;
+        while (i < cnt) {
+            const int v = decode(code[i]);
+            if (v == ack) {
+                r.acks++;
+                i++;
+                continue;
+            }
+            if (v == nack || v == busy) {
+                r.nacks++;
+                i++;
+                continue;
+            }
+            if (v < 0) {
+                r.invalid++;
+                i++;
+                continue;
+            }
+            const int id = v >> 2;
+            const int len = dgram_bytes(id);
+            if (len == 0 || i + len > cnt) {
+                // unknown id or truncated; nothing after it can be framed
+                r.invalid++;
+                break;
+            }
+            uint32_t data = v & 3;
+            bool ok = true;
+            for (int j = 1; j < len; j++) {
+                const int w = decode(code[i + j]);
+                if (w < 0)
+                    ok = false;
+                data = (data << 6) | (w & 0x3f);
+            }
+            if (!ok) {
+                r.invalid++;
+                break;
+            }
+            if (r.dgrams < dg_max) {
+                dg[r.dgrams].id = id;
+                dg[r.dgrams].data = data;
+                r.dgrams++;
+            }
+            i += len;
+        }
+        return r;
+    }
+
+private:
+
+    static constexpr uint8_t _code[64] = {
+        0xac, 0xaa, 0xa9, 0xa5, 0xa3, 0xa6, 0x9c, 0x9a, // 0x00
+        0x99, 0x95, 0x93, 0x96, 0x8e, 0x8d, 0x8b, 0xb1, // 0x08
+        0xb2, 0xb4, 0xb8, 0x74, 0x72, 0x6c, 0x6a, 0x69, // 0x10
+        0x65, 0x63, 0x66, 0x5c, 0x5a, 0x59, 0x55, 0x53, // 0x18
+        0x56, 0x4e, 0x4d, 0x4b, 0x47, 0x71, 0xe8, 0xe4, // 0x20
+        0xe2, 0xd1, 0xc9, 0xc5, 0xd8, 0xd4, 0xd2, 0xca, // 0x28
+        0xc6, 0xcc, 0x78, 0x17, 0x1b, 0x1d, 0x1e, 0x2e, // 0x30
+        0x36, 0x3a, 0x27, 0x2b, 0x2d, 0x35, 0x39, 0x33, // 0x38
+    };
+
+    struct Table {
+        int8_t val[256];
+    };
+
+    static constexpr Table _decode = []() {
+        Table t = {};
+        for (int c = 0; c < 256; c++)
+            t.val[c] = invalid;
+        for (int v = 0; v < 64; v++)
+            t.val[_code[v]] = v;
+        t.val[code_ack] = ack;
+        t.val[code_ack2] = ack;
+        t.val[code_nack] = nack;
+        t.val[code_busy] = busy;
+        return t;
+    }();
+};
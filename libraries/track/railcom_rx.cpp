@@ -0,0 +1,249 @@
+
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+//
+#include "dcc_tx_pkt.h"
+#include "railcom_code.h"
+#include "railcom_rx.h"
+
+
+RailComRx::RailComRx(uart_inst_t *uart, int rx_gpio) :
+    _uart(uart),
+    _rx_gpio(rx_gpio),
+    _dma(-1),
+    _cutout{},
+    _head(0),
+    _tail(0),
+    _active(false),
+    _alarm(0),
+    _stats{},
+    _stats_cnt(0),
+    _ch1_address(-1),
+    _ch1_adr_high(-1),
+    _ch1_invalid(0),
+    _overruns(0)
+{
+}
+
+
+void RailComRx::init()
+{
+    uart_init(_uart, baud);
+    gpio_set_function(_rx_gpio, GPIO_FUNC_UART);
+
+    // dma: uart rx -> cutout buffer, one byte per dreq
+    _dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, uart_get_dreq_num(_uart, false));
+    dma_channel_configure(_dma, &c, nullptr, &uart_get_hw(_uart)->dr, 0,
+                          false);
+}
+
+
+void RailComRx::end_callback(const DccTxPkt &pkt, intptr_t arg)
+{
+    RailComRx *rx = (RailComRx *)arg;
+    rx->cutout(pkt);
+}
+
+
+// Interrupt context, at the start of pkt's end bit. The previous cutout
+// finished a whole packet ago.
+void RailComRx::cutout(const DccTxPkt &pkt)
+{
+    if (_active) {
+        Cutout &c = _cutout[_head % cutout_max];
+        c.cnt = rx_cnt();
+        dma_channel_abort(_dma);
+        if (_alarm != 0) {
+            cancel_alarm(_alarm);
+            _alarm = 0;
+        }
+        _head = _head + 1;
+        _active = false;
+    }
+
+    if (!pkt.cutout())
+        return;
+
+    if ((_head - _tail) >= cutout_max) {
+        _overruns++;
+        return;
+    }
+
+    // anything in the fifo is line noise from outside a cutout
+    while (uart_is_readable(_uart))
+        (void)uart_getc(_uart);
+
+    Cutout &c = _cutout[_head % cutout_max];
+    c.address = pkt.address();
+    c.cnt = 0;
+    c.ch1_cnt = -1;
+    dma_channel_transfer_to_buffer_now(_dma, c.code, byte_max);
+    _alarm = add_alarm_in_us(ch2_us, ch2_alarm, this, true);
+    _active = true;
+}
+
+
+// bytes received so far in the current cutout
+int RailComRx::rx_cnt() const
+{
+    // upper bits are the count mode on rp2350
+    const uint32_t left =
+        dma_channel_hw_addr(_dma)->transfer_count & 0x0fffffff;
+    return byte_max - int(left);
+}
+
+
+int64_t RailComRx::ch2_alarm(alarm_id_t, void *arg)
+{
+    RailComRx *rx = (RailComRx *)arg;
+    rx->_cutout[rx->_head % cutout_max].ch1_cnt = rx->rx_cnt();
+    rx->_alarm = 0;
+    return 0; // don't reschedule
+}
+
+
+void RailComRx::loop()
+{
+    while (_tail != _head) {
+        decode(_cutout[_tail % cutout_max]);
+        _tail = _tail + 1;
+    }
+}
+
+
+void RailComRx::decode(const Cutout &c)
+{
+    if (c.ch1_cnt < 0)
+        return; // alarm didn't run; can't tell the channels apart
+
+    // channel 1: address broadcast (adr_high then adr_low, alternating)
+    if (c.ch1_cnt > 0) {
+        RailComCode::Datagram dg;
+        if (!RailComCode::ch1(c.code, c.ch1_cnt, dg)) {
+            _ch1_invalid++;
+        } else if (dg.id == RailComCode::id_adr_high) {
+            _ch1_adr_high = dg.data;
+        } else if (dg.id == RailComCode::id_adr_low && _ch1_adr_high >= 0) {
+            if (_ch1_adr_high & 0x80)
+                _ch1_address = ((_ch1_adr_high & 0x3f) << 8) | dg.data;
+            else
+                _ch1_address = dg.data;
+        }
+    }
+
+    // channel 2: reply from the addressed loco
+    if (c.address <= 0)
+        return;
+
+    Stats *s = stats_get(c.address);
+    if (s == nullptr)
+        return;
+
+    s->cutouts++;
+
+    const int ch2_cnt = c.cnt - c.ch1_cnt;
+    if (ch2_cnt <= 0) {
+        s->ch2_missing++;
+        return;
+    }
+
+    static constexpr int dg_max = RailComCode::ch2_bytes / 2;
+    RailComCode::Datagram dg[dg_max];
+    RailComCode::Ch2 r =
+        RailComCode::ch2(c.code + c.ch1_cnt, ch2_cnt, dg, dg_max);
+
+    s->acks += r.acks;
+    s->nacks += r.nacks;
+    s->dgrams += r.dgrams;
+
+    if (r.invalid > 0)
+        s->ch2_invalid++;
+    else if (r.dgrams > 0 || r.acks > 0)
+        s->ch2_ok++;
+
+    for (int i = 0; i < r.dgrams; i++) {
+        if (dg[i].id == RailComCode::id_pom) {
+            s->pom_val = dg[i].data & 0xff;
+        } else if (dg[i].id == RailComCode::id_dyn) {
+            const int val = (dg[i].data >> 6) & 0xff;
+            const int sub = dg[i].data & 0x3f;
+            if (sub == RailComCode::dyn_speed_1) {
+                s->speed_kmh = val;
+                s->speed_us = time_us_32();
+            } else if (sub == RailComCode::dyn_speed_2) {
+                s->speed_kmh = val + 256;
+                s->speed_us = time_us_32();
+            } else if (sub == RailComCode::dyn_qos) {
+                s->qos = val;
+            }
+        }
+    }
+}
+
+
+RailComRx::Stats *RailComRx::stats_get(int address)
+{
+    for (int i = 0; i < _stats_cnt; i++)
+        if (_stats[i].address == address)
+            return &_stats[i];
+
+    if (_stats_cnt >= loco_max)
+        return nullptr;
+
+    Stats *s = &_stats[_stats_cnt++];
+    *s = Stats{};
+    s->address = address;
+    s->speed_kmh = -1;
+    s->pom_val = -1;
+    s->qos = -1;
+    return s;
+}
+
+
+const RailComRx::Stats *RailComRx::stats(int address) const
+{
+    for (int i = 0; i < _stats_cnt; i++)
+        if (_stats[i].address == address)
+            return &_stats[i];
+    return nullptr;
+}
+
+
+int RailComRx::quality(int address) const
+{
+    const Stats *s = stats(address);
+    if (s == nullptr || s->cutouts == 0)
+        return -1;
+    return int((uint64_t(s->ch2_ok) * 100) / s->cutouts);
+}
+
+
+void RailComRx::print_stats() const
+{
+    printf("railcom: ch1 address %d, ch1 invalid %lu, overruns %lu\n",
+           _ch1_address, _ch1_invalid, _overruns);
+
+    for (int i = 0; i < _stats_cnt; i++) {
+        const Stats &s = _stats[i];
+        printf("loco %d: cutouts=%lu ok=%lu missing=%lu invalid=%lu "
+               "acks=%lu nacks=%lu dgrams=%lu quality=%d%%",
+               s.address, s.cutouts, s.ch2_ok, s.ch2_missing, s.ch2_invalid,
+               s.acks, s.nacks, s.dgrams, quality(s.address));
+        if (s.speed_kmh >= 0)
+            printf(" speed=%d", s.speed_kmh);
+        if (s.qos >= 0)
+            printf(" qos=%d", s.qos);
+        printf("\n");
+    }
+}
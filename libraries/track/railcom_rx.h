@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+// pico
+#include "hardware/uart.h"
+#include "pico/time.h"
+//
+#include "dcc_tx_pkt.h"
+#include "railcom_code.h"
+
+// RailCom receiver.
+//
+// The detector's UART output is read by DMA into a buffer per cutout, so
+// nothing runs per byte. DccTx's end callback closes the previous cutout
+// and arms the DMA for the next one; an alarm part way through the cutout
+// notes how many bytes were in channel 1. Decoding (RailComCode) happens
+// later, in loop(), off the bit-timing path.
+//
+// Channel 2 bytes belong to whatever multi-function decoder the packet was
+// addressed to. Per-loco counts of good and bad cutouts say how far
+// RailCom data from that loco can be trusted, e.g. before using its speed
+// feedback in a control loop.
+//
+// Hook up:
+//   tx.end_callback(RailComRx::end_callback, intptr_t(&railcom));
+
+class RailComRx
+{
+public:
+
+    RailComRx(uart_inst_t *uart, int rx_gpio);
+
+    void init();
+
+    // DccTx::EndFunc; arg is the RailComRx
+    static void end_callback(const DccTxPkt &pkt, intptr_t arg);
+
+    // Decode any finished cutouts.
+    void loop();
+
+    struct Stats {
+        int address;
+        uint32_t cutouts;     // packets addressed to this loco
+        uint32_t ch2_ok;      // at least one good datagram or ACK, no errors
+        uint32_t ch2_missing; // nothing at all in channel 2
+        uint32_t ch2_invalid; // cutouts with invalid codes or framing
+        uint32_t acks;
+        uint32_t nacks;
+        uint32_t dgrams;
+        int speed_kmh; // last dyn speed, -1 if none yet
+        uint32_t speed_us;
+        int pom_val; // last pom value, -1 if none yet
+        int qos;     // last decoder-reported qos, -1 if none yet
+    };
+
+    // nullptr if nothing has been addressed to that loco
+    const Stats *stats(int address) const;
+
+    // Percentage of cutouts to a loco that had a clean channel 2, or -1 if
+    // there have been none.
+    int quality(int address) const;
+
+    // Last address seen in channel 1, or -1.
+    int ch1_address() const
+    {
+        return _ch1_address;
+    }
+
+    uint32_t ch1_invalid() const
+    {
+        return _ch1_invalid;
+    }
+
+    // cutouts lost because loop() didn't keep up
+    uint32_t overruns() const
+    {
+        return _overruns;
+    }
+
+    void print_stats() const;
+
+    static constexpr int baud = 250'000;
+    static constexpr int loco_max = 8;
+
+    // Alarm delay from the end callback (start of the end bit) to between
+    // channel 1 and channel 2: end bit 116 us, channel 2 starts 193 us
+    // after that.
+    static constexpr uint32_t ch2_us = 116 + 185;
+
+private:
+
+    uart_inst_t *_uart;
+    int _rx_gpio;
+    int _dma;
+
+    static constexpr int byte_max =
+        RailComCode::ch1_bytes + RailComCode::ch2_bytes;
+
+    struct Cutout {
+        int address; // from the packet, -1 if not a loco
+        int cnt;     // bytes received
+        int ch1_cnt; // how many of those were in channel 1, -1 if unknown
+        uint8_t code[byte_max];
+    };
+
+    // cutouts waiting for loop(), plus the one being received
+    static constexpr int cutout_max = 8; // power of 2
+    Cutout _cutout[cutout_max];
+    volatile uint32_t _head; // cutout being received
+    volatile uint32_t _tail; // next one for loop()
+    bool _active;
+    alarm_id_t _alarm;
+
+    Stats _stats[loco_max];
+    int _stats_cnt;
+
+    int _ch1_address;
+    int _ch1_adr_high;
+    uint32_t _ch1_invalid;
+    uint32_t _overruns;
+
+    void cutout(const DccTxPkt &pkt);
+    int rx_cnt() const;
+
+    static int64_t ch2_alarm(alarm_id_t id, void *arg);
+
+    Stats *stats_get(int address);
+    void decode(const Cutout &c);
+};
@@ -0,0 +1,103 @@
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/sync.h"
+// railroad
+#include "sensor2.h"
+//
+#include "recouple_monitor.h"
+
+// counts from here up are nothing in range
+static constexpr uint16_t count_none = 1990;
+
+
+RecoupleMonitor::RecoupleMonitor() :
+    _sensor(nullptr),
+    _base{},
+    _base_cnt(0),
+    _base_mm(-1),
+    _fired(false),
+    _car_mm(0),
+    _watches(0),
+    _fires(0)
+{
+}
+
+
+void RecoupleMonitor::attach(Sensor2 &s)
+{
+    detach();
+    _base_cnt = 0;
+    _base_mm = -1;
+    _fired = false;
+    _car_mm = 0;
+    _sensor = &s;
+    s.set_callback(count, intptr_t(this));
+}
+
+
+void RecoupleMonitor::watch()
+{
+    const uint32_t irq = save_and_disable_interrupts();
+    const int n = (_base_cnt < base_cnt) ? _base_cnt : base_cnt;
+    int sum = 0;
+    int in = 0;
+    for (int i = 0; i < n; i++) {
+        if (_base[i] >= 0) {
+            sum += _base[i];
+            in++;
+        }
+    }
+    _base_mm = (in > 0) ? (sum + in / 2) / in : -1;
+    restore_interrupts(irq);
+    if (_base_mm < 0 && _sensor != nullptr) {
+        // no samples yet; go by the reading
+        const int mm = _sensor->dist_mm();
+        if (mm != INT_MAX)
+            _base_mm = mm;
+    }
+    _watches++;
+}
+
+
+void RecoupleMonitor::detach()
+{
+    if (_sensor != nullptr)
+        _sensor->set_callback(nullptr, 0);
+    _sensor = nullptr;
+}
+
+
+// The car moving away from the end of the spur is the one thing that
+// can't happen if it was left.
+void RecoupleMonitor::sample(int mm)
+{
+    if (_base_mm < 0) {
+        _base[_base_cnt % base_cnt] = int16_t(mm);
+        _base_cnt = _base_cnt + 1;
+        return;
+    }
+    if (_fired || mm < 0)
+        return;
+    if (mm - _base_mm >= moved_mm) {
+        _car_mm = mm - _base_mm;
+        _fired = true;
+        _fires++;
+    }
+}
+
+
+void RecoupleMonitor::count(uint16_t count, intptr_t arg)
+{
+    RecoupleMonitor *m = (RecoupleMonitor *)arg;
+    const int mm = (count < count_none) ? ((count - 1000) * 3 + 2) / 4 : -1;
+    m->sample(mm);
+}
+
+
+void RecoupleMonitor::print() const
+{
+    printf("recouple: %d watched, %d came along\n", _watches, _fires);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+// railroad
+#include "sensor2.h"
+
+// Watches a spur's distance sensor for a car that moves when it should
+// be standing still.
+//
+// When spot() pulls away from a car it has left, a car that recoupled on
+// the way in comes along with the loco. The check runs on every sample
+// (the sensor's callback), so it fires within one sample of the car
+// moving more than the noise (moved_mm), a few mm into the pull, rather
+// than after a set distance and a second reading. fetch() uses it the
+// other way round: a car it has just coupled should come along.
+//
+// attach() starts taking samples; where the car is standing is the mean
+// of the last base_cnt. watch() fixes that and starts checking; detach()
+// stops it all.
+
+class RecoupleMonitor
+{
+public:
+
+    static constexpr int moved_mm = 8; // 5 sd of the sensor's noise
+    static constexpr int base_cnt = 16;
+
+    RecoupleMonitor();
+
+    void attach(Sensor2 &s);
+    void watch();
+    void detach();
+
+    bool fired() const
+    {
+        return _fired;
+    }
+
+    // How far the car had moved when it fired.
+    int car_mm() const
+    {
+        return _car_mm;
+    }
+
+    void print() const;
+
+private:
+
+    Sensor2 *_sensor;
+
+    // last samples, mm (-1 for none in range)
+    volatile int16_t _base[base_cnt];
+    volatile int _base_cnt;
+    volatile int _base_mm; // -1 until watch()
+
+    volatile bool _fired;
+    volatile int _car_mm;
+
+    // stats
+    int _watches;
+    int _fires;
+
+    void sample(int mm);
+    static void count(uint16_t count, intptr_t arg);
+};
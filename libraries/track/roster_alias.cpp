@@ -0,0 +1,106 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+//
+#include "flash_sector.h"
+#include "roster_alias.h"
+
+static constexpr uint32_t entry_magic = 0x524c4153; // "RLAS"
+
+static const uint8_t *alias()
+{
+    return FlashSector::data(FlashSector::Id::Alias);
+}
+
+
+// FNV-1a over everything before the crc
+uint32_t RosterAlias::crc(const Entry &entry)
+{
+    const uint8_t *p = (const uint8_t *)&entry;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(Entry, crc); i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+
+bool RosterAlias::valid(const Entry &entry)
+{
+    return entry.magic == entry_magic && entry.crc == crc(entry);
+}
+
+
+const RosterAlias::Entry *RosterAlias::find(uint32_t sn)
+{
+    const Entry *entry = (const Entry *)alias();
+    for (int i = 0; i < entry_max; i++)
+        if (valid(entry[i]) && entry[i].sn == sn)
+            return &entry[i];
+    return nullptr;
+}
+
+
+bool RosterAlias::find(uint32_t sn, uint32_t &roster_sn)
+{
+    const Entry *entry = find(sn);
+    if (entry == nullptr)
+        return false;
+    roster_sn = entry->roster_sn;
+    return true;
+}
+
+
+bool RosterAlias::add(uint32_t sn, uint32_t roster_sn)
+{
+    static_assert(sizeof(Entry) * entry_max <= FlashSector::size);
+
+    uint8_t *sector = FlashSector::buf();
+    memcpy(sector, alias(), FlashSector::size);
+    Entry *entry = (Entry *)sector;
+
+    // sn's entry, else a free one, else the oldest
+    int use = -1;
+    uint32_t seq = 0;
+    for (int i = 0; i < entry_max; i++) {
+        if (valid(entry[i]) && entry[i].seq >= seq)
+            seq = entry[i].seq + 1;
+    }
+    for (int i = 0; i < entry_max && use < 0; i++)
+        if (valid(entry[i]) && entry[i].sn == sn)
+            use = i;
+    for (int i = 0; i < entry_max && use < 0; i++)
+        if (!valid(entry[i]))
+            use = i;
+    if (use < 0) {
+        use = 0;
+        for (int i = 1; i < entry_max; i++)
+            if (entry[i].seq < entry[use].seq)
+                use = i;
+    }
+
+    Entry &e = entry[use];
+    e.magic = entry_magic;
+    e.sn = sn;
+    e.roster_sn = roster_sn;
+    e.seq = seq;
+    e.crc = crc(e);
+
+    // erasing leaves 0xff, which is never a valid entry
+    if (!FlashSector::write(FlashSector::Id::Alias))
+        return false;
+
+    return find(sn) != nullptr;
+}
+
+
+void RosterAlias::print()
+{
+    const Entry *entry = (const Entry *)alias();
+    printf("roster aliases:\n");
+    for (int i = 0; i < entry_max; i++)
+        if (valid(entry[i]))
+            printf("  0x%08x -> 0x%08x\n", unsigned(entry[i].sn),
+                   unsigned(entry[i].roster_sn));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// Decoders added to the roster at run time, in the next-to-last sector of
+// flash (FlashSector; ParamStore has the last).
+//
+// An alias maps a serial number that's not in the roster (a new or
+// replaced decoder) to the serial number of the roster entry whose
+// calibration it's to use, e.g. after checking it with speeds. The roster
+// itself is built in; RosterIndex looks here when a serial number isn't
+// in it. Adding rewrites the whole sector, like ParamStore.
+
+class RosterAlias
+{
+public:
+
+    static constexpr int entry_max = 32;
+
+    static bool find(uint32_t sn, uint32_t &roster_sn);
+
+    // Replaces sn's alias, or the oldest one if the sector is full.
+    static bool add(uint32_t sn, uint32_t roster_sn);
+
+    static void print();
+
+private:
+
+    struct Entry {
+        uint32_t magic;
+        uint32_t sn;
+        uint32_t roster_sn;
+        uint32_t seq; // higher is newer
+        uint32_t crc;
+    };
+
+    static const Entry *find(uint32_t sn);
+    static uint32_t crc(const Entry &entry);
+    static bool valid(const Entry &entry);
+};
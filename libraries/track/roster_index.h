@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "roster_alias.h"
+
+// Constant-time lookup of roster entries by serial number and by name.
+//
+// The index is built at compile time from a constexpr roster (any array
+// of T with a uint32_t sn and a const char *name): each key set gets a
+// perfect hash, a seed for which every entry lands in its own bucket of
+// a table at least twice the roster's size, found by trying seeds until
+// one works. A lookup is then one hash and one compare. The index is
+// constexpr, so it's in flash and there's nothing to set up at startup;
+// ok() says whether a seed was found (static_assert it).
+//
+// A roster defined in another file (the railroad library's Loco::roster,
+// an array of unknown size here) can't be indexed at compile time. For
+// that, N is the most entries the index can take, and it's built by a
+// static constructor from the roster's pointer and size; check ok() at
+// startup.
+//
+// A serial number that's not in the roster is looked up in RosterAlias,
+// which maps decoders added at run time to the roster entry they're to
+// be treated as.
+
+// buckets for n keys: a power of 2, at least 2 * n
+constexpr int roster_index_buckets(int n)
+{
+    int b = 1;
+    while (b < 2 * n)
+        b *= 2;
+    return b;
+}
+
+template <typename T, int N>
+class RosterIndex
+{
+public:
+
+    constexpr RosterIndex(const T (&roster)[N]) :
+        RosterIndex(roster, N)
+    {
+    }
+
+    // roster_cnt <= N
+    constexpr RosterIndex(const T *roster, int roster_cnt) :
+        _roster(roster),
+        _cnt(roster_cnt),
+        _sn_seed(0),
+        _name_seed(0),
+        _sn_idx{},
+        _name_idx{},
+        _ok(false)
+    {
+        if (_cnt < 0 || _cnt > N)
+            return;
+        uint32_t key[N] = {};
+        for (int i = 0; i < _cnt; i++)
+            key[i] = roster[i].sn;
+        const bool sn_ok = build(key, _sn_seed, _sn_idx);
+        for (int i = 0; i < _cnt; i++)
+            key[i] = hash(roster[i].name);
+        const bool name_ok = build(key, _name_seed, _name_idx);
+        _ok = sn_ok && name_ok;
+    }
+
+    constexpr bool ok() const
+    {
+        return _ok;
+    }
+
+    // nullptr if neither sn nor an alias for it is in the roster
+    const T *find(uint32_t sn) const
+    {
+        const T *t = find_sn(sn);
+        uint32_t roster_sn;
+        if (t == nullptr && RosterAlias::find(sn, roster_sn))
+            t = find_sn(roster_sn);
+        return t;
+    }
+
+    constexpr const T *find(const char *name) const
+    {
+        const int i = _name_idx[bucket(hash(name), _name_seed)];
+        if (!_ok || i < 0 || !equal(_roster[i].name, name))
+            return nullptr;
+        return &_roster[i];
+    }
+
+private:
+
+    static constexpr int bucket_max = roster_index_buckets(N);
+    static constexpr uint32_t seed_max = 4096;
+
+    const T *_roster;
+    int _cnt;
+    uint32_t _sn_seed;
+    uint32_t _name_seed;
+    int8_t _sn_idx[bucket_max]; // roster index, -1 for none
+    int8_t _name_idx[bucket_max];
+    bool _ok;
+
+    static_assert(N < 128, "roster index is int8_t");
+
+    // FNV-1a
+    static constexpr uint32_t hash(const char *s)
+    {
+        uint32_t h = 2166136261u;
+        while (*s != '\0')
+            h = (h ^ uint8_t(*s++)) * 16777619u;
+        return h;
+    }
+
+    static constexpr int bucket(uint32_t key, uint32_t seed)
+    {
+        uint32_t h = (key ^ seed) * 0x9e3779b1u;
+        h ^= h >> 15;
+        return int(h & (bucket_max - 1));
+    }
+
+    static constexpr bool equal(const char *a, const char *b)
+    {
+        while (*a != '\0' && *a == *b) {
+            a++;
+            b++;
+        }
+        return *a == *b;
+    }
+
+    // Find a seed putting every key in its own bucket.
+    constexpr bool build(const uint32_t (&key)[N], uint32_t &seed,
+                         int8_t (&idx)[bucket_max]) const
+    {
+        for (seed = 0; seed < seed_max; seed++) {
+            for (int b = 0; b < bucket_max; b++)
+                idx[b] = -1;
+            int i = 0;
+            while (i < _cnt && idx[bucket(key[i], seed)] < 0) {
+                idx[bucket(key[i], seed)] = int8_t(i);
+                i++;
+            }
+            if (i == _cnt)
+                return true;
+        }
+        return false;
+    }
+
+    constexpr const T *find_sn(uint32_t sn) const
+    {
+        const int i = _sn_idx[bucket(sn, _sn_seed)];
+        if (!_ok || i < 0 || _roster[i].sn != sn)
+            return nullptr;
+        return &_roster[i];
+    }
+};
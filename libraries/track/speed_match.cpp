@@ -0,0 +1,21 @@
+
+#include <cstdint>
+#include <cstdio>
+//
+#include "speed_match.h"
+#include "speed_table.h"
+
+
+void SpeedMatch::print(const SpeedTable &target, const SpeedTable &ref) const
+{
+    printf("speed match: cv2=%d cv6=%d cv5=%d\n", vstart(), vmid(), vhigh());
+    printf("   cv  step  want  value  was\n");
+    for (int i = 0; i < entry_max; i++) {
+        const int s = entry_step(i);
+        printf("  %3d  %4d  %4d  %5d  %3d\n", cv_table + i, s, ref.mms(s),
+               entry(i), target.mms(s));
+    }
+    if (_short > 0)
+        printf("speed match: %d steps are faster than the target can go\n",
+               _short);
+}
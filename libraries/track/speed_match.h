@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "speed_table.h"
+
+// A user speed table (CV67-94) that makes one loco run like another.
+//
+// The target's curve is measured with its decoder's table out of the way
+// (factory settings: CV29 bit 4 off, CV2/5/6 at 0, so the motor gets
+// step/126 of full voltage). Each of the 28 table entries stands for a
+// step (entry_step()); the entry is the voltage, out of 255, at which the
+// target measured the speed the reference has at that step. Entries go up
+// with the step and are at least 1.
+//
+// CV2/CV6/CV5 (start, mid, high) get the table's first, middle and last
+// entries, the same curve in three points, for a decoder that doesn't do
+// the user table.
+
+class SpeedMatch
+{
+public:
+
+    static constexpr int entry_max = 28;
+    static constexpr int cv_table = 67; // ...94
+
+    constexpr SpeedMatch(const SpeedTable &target, const SpeedTable &ref) :
+        _entry{},
+        _short(0)
+    {
+        const int full_q8 = SpeedTable::step_max * 256;
+        const int top_mms = target.mms(SpeedTable::step_max);
+        int last = 1;
+        for (int i = 0; i < entry_max; i++) {
+            const int want = ref.mms(entry_step(i));
+            if (want > top_mms)
+                _short++;
+            int v = (target.dcc_q8(want) * 255 + full_q8 / 2) / full_q8;
+            if (v < last)
+                v = last;
+            if (v > 255)
+                v = 255;
+            _entry[i] = uint8_t(v);
+            last = v;
+        }
+    }
+
+    // 128-step speed an entry is at: the first at step 1, the last at 126
+    static constexpr int entry_step(int i)
+    {
+        return 1 + (i * (SpeedTable::step_max - 1) + (entry_max - 1) / 2) /
+                       (entry_max - 1);
+    }
+
+    // CV67 + i
+    constexpr int entry(int i) const
+    {
+        return _entry[i];
+    }
+
+    constexpr int vstart() const // cv2
+    {
+        return _entry[0];
+    }
+
+    constexpr int vmid() const // cv6
+    {
+        return _entry[entry_max / 2 - 1];
+    }
+
+    constexpr int vhigh() const // cv5
+    {
+        return _entry[entry_max - 1];
+    }
+
+    // Entries the target can't get to, even at full voltage.
+    constexpr int too_fast() const
+    {
+        return _short;
+    }
+
+    void print(const SpeedTable &target, const SpeedTable &ref) const;
+
+private:
+
+    uint8_t _entry[entry_max];
+    int _short;
+};
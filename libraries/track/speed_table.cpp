@@ -0,0 +1,62 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+// railroad
+#include "locos.h"
+//
+#include "speed_table.h"
+
+
+SpeedTable::SpeedTable(const Loco *loco) :
+    SpeedTable()
+{
+    for (int s = 1; s <= step_max; s++)
+        _mms_q4[s] = uint16_t(loco->speed_mms(s) * 16);
+    build();
+}
+
+
+void SpeedTable::print(const Point *pt, int pt_cnt) const
+{
+    printf("speed table: %d points, top speed %d mm/s\n", pt_cnt, _mms_max);
+    printf("  step   mm/s  table  err   step back\n");
+    int err_max = 0;
+    int back_bad = 0;
+    for (int i = 0; i < pt_cnt; i++) {
+        const int m = mms(pt[i].dcc);
+        const int err = m - pt[i].mms;
+        const int back = dcc(pt[i].mms);
+        printf("  %4d  %5d  %5d  %+3d  %4d%s\n", pt[i].dcc, pt[i].mms, m, err,
+               back, (back != pt[i].dcc) ? "  <-" : "");
+        if (abs(err) > err_max)
+            err_max = abs(err);
+        if (back != pt[i].dcc)
+            back_bad++;
+    }
+    printf("speed table: max error %d mm/s, %d of %d steps don't come back\n",
+           err_max, back_bad, pt_cnt);
+}
+
+
+// Only the steps that are off are listed; there are a lot of them.
+void SpeedTable::print(const Loco *loco) const
+{
+    printf("speed table: %s, top speed %d mm/s\n", loco->name, _mms_max);
+    int err_max = 0;
+    int back_bad = 0;
+    for (int s = 1; s <= step_max; s++) {
+        const int want = loco->speed_mms(s);
+        const int err = mms(s) - want;
+        const int back = dcc(want);
+        if (err != 0 || back != s)
+            printf("  step %d: %d mm/s, table %d, back to step %d\n", s, want,
+                   mms(s), back);
+        if (abs(err) > err_max)
+            err_max = abs(err);
+        if (back != s)
+            back_bad++;
+    }
+    printf("speed table: max error %d mm/s, %d of %d steps don't come back\n",
+           err_max, back_bad, step_max);
+}
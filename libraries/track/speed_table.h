@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+
+struct Loco;
+
+// A loco's speed curve as two tables, so converting between dcc steps and
+// mm/sec is a table read rather than a search of the calibration.
+//
+// The forward table has mm/sec (in 1/16ths) at each step, straight lines
+// between the calibrated points. The inverse table has the step (in
+// 1/256ths) at 128 evenly spaced speeds from 0 to the top speed; a speed
+// in between is interpolated in fixed point and rounded to the nearest
+// step, as Loco::speed_dcc does. Speeds and steps are signed, and any
+// speed other than 0 is at least step 1.
+//
+// Built from calibrated points (e.g. what speeds' dcc_measure printed),
+// a table is constexpr, so it's made at build time and goes in flash. It
+// can also be made at run time from a Loco's own conversion, for locos
+// whose calibration is only in the roster.
+//
+// print() shows how far the table is off at each calibrated point (or
+// each step, for a Loco), both ways, so a bad point or a curve that the
+// inverse table can't follow shows up.
+
+class SpeedTable
+{
+public:
+
+    struct Point {
+        int dcc; // 1..126
+        int mms; // measured at that step
+    };
+
+    static constexpr int step_max = 126;
+    static constexpr int inv_max = 128;
+
+    constexpr SpeedTable() :
+        _mms_q4{},
+        _dcc_q8{},
+        _mms_max(0),
+        _inv_q16(0)
+    {
+    }
+
+    // Points must be in step order; the curve is flat past the last one,
+    // and goes straight from step 0 to the first one.
+    constexpr SpeedTable(const Point *pt, int pt_cnt) :
+        SpeedTable()
+    {
+        int p = 0;
+        for (int s = 1; s <= step_max; s++) {
+            while (p < pt_cnt && pt[p].dcc < s)
+                p++;
+            int mms_q4 = 0;
+            if (p >= pt_cnt) {
+                mms_q4 = (pt_cnt > 0) ? pt[pt_cnt - 1].mms * 16 : 0;
+            } else if (pt[p].dcc == s || p == 0) {
+                // at a point, or before the first one: straight from 0
+                mms_q4 = (pt[p].mms * 16 * s) / pt[p].dcc;
+            } else {
+                const Point &a = pt[p - 1];
+                const Point &b = pt[p];
+                mms_q4 = a.mms * 16 +
+                         ((b.mms - a.mms) * 16 * (s - a.dcc)) / (b.dcc - a.dcc);
+            }
+            _mms_q4[s] = uint16_t(mms_q4);
+        }
+        build();
+    }
+
+    // From a roster loco's own conversion.
+    explicit SpeedTable(const Loco *loco);
+
+    // Step to mm/sec.
+    constexpr int mms(int dcc) const
+    {
+        const int s = (dcc < 0) ? -dcc : dcc;
+        const int m = (_mms_q4[(s < step_max) ? s : step_max] + 8) / 16;
+        return (dcc < 0) ? -m : m;
+    }
+
+    // mm/sec to step, in 1/256ths (unsigned).
+    constexpr int dcc_q8(int mms) const
+    {
+        const uint32_t m = uint32_t((mms < 0) ? -mms : mms);
+        if (m >= uint32_t(_mms_max))
+            return _dcc_q8[inv_max - 1];
+        const uint32_t x_q16 = m * _inv_q16;
+        const int i = int(x_q16 >> 16);
+        const int f = int(x_q16 & 0xffff);
+        const int d = _dcc_q8[i + 1] - _dcc_q8[i];
+        return _dcc_q8[i] + ((d * f) >> 16);
+    }
+
+    // mm/sec to the nearest step.
+    constexpr int dcc(int mms) const
+    {
+        if (mms == 0)
+            return 0;
+        int s = (dcc_q8(mms) + 128) >> 8;
+        if (s < 1)
+            s = 1;
+        return (mms < 0) ? -s : s;
+    }
+
+    // Residual error at each point.
+    void print(const Point *pt, int pt_cnt) const;
+
+    // Residual error against the loco's own conversion, at each step.
+    void print(const Loco *loco) const;
+
+private:
+
+    uint16_t _mms_q4[step_max + 1]; // mm/sec * 16, at each step
+    uint16_t _dcc_q8[inv_max];      // step * 256, at i * _mms_max / 127
+    int _mms_max;
+    uint32_t _inv_q16; // (inv_max - 1) / _mms_max, * 65536
+
+    // The inverse table from the forward one. Speeds have to go up with
+    // the step for the inverse to make sense; a step slower than the one
+    // below it is taken as no faster.
+    constexpr void build()
+    {
+        for (int s = 1; s <= step_max; s++)
+            if (_mms_q4[s] < _mms_q4[s - 1])
+                _mms_q4[s] = _mms_q4[s - 1];
+
+        _mms_max = (_mms_q4[step_max] + 8) / 16;
+        if (_mms_max <= 0)
+            return;
+        _inv_q16 = ((inv_max - 1) << 16) / uint32_t(_mms_max);
+
+        int s = 0;
+        for (int i = 0; i < inv_max; i++) {
+            const int m_q4 = (i * _mms_max * 16) / (inv_max - 1);
+            while (s < step_max && _mms_q4[s + 1] <= m_q4)
+                s++;
+            int q8 = s * 256;
+            if (s < step_max) {
+                const int span = _mms_q4[s + 1] - _mms_q4[s];
+                q8 += ((m_q4 - _mms_q4[s]) * 256) / span;
+            }
+            _dcc_q8[i] = uint16_t(q8);
+        }
+    }
+};
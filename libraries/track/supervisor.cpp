@@ -0,0 +1,202 @@
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+// pico
+#include "pico/stdlib.h"
+//
+#include "motion.h"
+#include "supervisor.h"
+
+
+Supervisor::Supervisor(const Motion &motion, EventFunc *func, intptr_t arg) :
+    _motion(motion),
+    _func(func),
+    _arg(arg),
+    _stall_ma(0),
+    _lost_ma(0),
+    _open(false),
+    _start_mm(0),
+    _expect_mm(0),
+    _moving_us(0),
+    _moving(false),
+    _rc(false),
+    _rc_us(0),
+    _rc_kmh(0),
+    _rc_zero_us(0),
+    _ma(false),
+    _ma_us(0),
+    _high(false),
+    _high_us(0),
+    _low(false),
+    _low_us(0),
+    _event(Event::None),
+    _windows(0),
+    _late_max_mm(INT_MIN),
+    _events{}
+{
+}
+
+
+void Supervisor::current_limits(int stall_ma, int lost_ma)
+{
+    _stall_ma = stall_ma;
+    _lost_ma = lost_ma;
+}
+
+
+void Supervisor::expect(int dist_mm)
+{
+    _open = true;
+    _start_mm = _motion.odometer_mm();
+    _expect_mm = (dist_mm > 0) ? dist_mm : 0;
+    _windows++;
+}
+
+
+void Supervisor::arrived()
+{
+    if (!_open)
+        return;
+    _open = false;
+    const int late_mm = used_mm() - _expect_mm;
+    if (late_mm > _late_max_mm)
+        _late_max_mm = late_mm;
+}
+
+
+int Supervisor::used_mm() const
+{
+    return abs(_motion.odometer_mm() - _start_mm);
+}
+
+
+void Supervisor::railcom(int speed_kmh)
+{
+    const uint32_t now_us = time_us_32();
+    if (speed_kmh == 0 && (!_rc || _rc_kmh != 0))
+        _rc_zero_us = now_us;
+    _rc = true;
+    _rc_us = now_us;
+    _rc_kmh = speed_kmh;
+}
+
+
+void Supervisor::current(int ma)
+{
+    const uint32_t now_us = time_us_32();
+    const bool high = _stall_ma > 0 && ma >= _stall_ma;
+    const bool low = _lost_ma > 0 && ma <= _lost_ma;
+    if (high && !_high)
+        _high_us = now_us;
+    if (low && !_low)
+        _low_us = now_us;
+    _high = high;
+    _low = low;
+    _ma = true;
+    _ma_us = now_us;
+}
+
+
+// cond has been true since since_us, and the loco commanded to move for
+// stall_us after both
+bool Supervisor::held(bool cond, uint32_t since_us, uint32_t now_us) const
+{
+    if (!cond || !_moving)
+        return false;
+    const uint32_t from_us =
+        (int32_t(since_us - _moving_us) > 0) ? since_us : _moving_us;
+    return now_us - from_us >= stall_us;
+}
+
+
+// What an overdue window was most likely to be.
+Supervisor::Event Supervisor::overdue(uint32_t now_us) const
+{
+    const bool rc = _rc && now_us - _rc_us < report_us;
+    const bool ma = _ma && now_us - _ma_us < report_us;
+    if (rc && _rc_kmh > 0)
+        return Event::Slip;
+    if (ma && _low)
+        return Event::Derail;
+    if ((rc && _rc_kmh == 0) || (ma && _high))
+        return Event::Stall;
+    return Event::Overdue;
+}
+
+
+void Supervisor::loop()
+{
+    if (!_open || _event != Event::None)
+        return;
+
+    const uint32_t now_us = time_us_32();
+
+    const bool moving = abs(_motion.speed_now()) >= moving_mms;
+    if (moving && !_moving)
+        _moving_us = now_us;
+    _moving = moving;
+
+    const bool rc = _rc && now_us - _rc_us < report_us;
+    const bool ma = _ma && now_us - _ma_us < report_us;
+    if (held(rc && _rc_kmh == 0, _rc_zero_us, now_us) ||
+        held(ma && _high, _high_us, now_us)) {
+        raise(Event::Stall);
+        return;
+    }
+    if (held(ma && _low, _low_us, now_us)) {
+        raise(Event::Derail);
+        return;
+    }
+
+    if (used_mm() > (_expect_mm * (100 + slip_pct)) / 100 + slack_mm)
+        raise(overdue(now_us));
+}
+
+
+void Supervisor::raise(Event e)
+{
+    _event = e;
+    _events[int(e)]++;
+    if (_func != nullptr)
+        _func(e, _arg);
+}
+
+
+void Supervisor::resume()
+{
+    _event = Event::None;
+    _start_mm = _motion.odometer_mm();
+    _moving = false;
+}
+
+
+const char *Supervisor::name(Event e)
+{
+    switch (e) {
+    case Event::None:
+        return "none";
+    case Event::Overdue:
+        return "overdue";
+    case Event::Stall:
+        return "stall";
+    case Event::Slip:
+        return "slip";
+    case Event::Derail:
+        return "derail";
+    }
+    return "?";
+}
+
+
+void Supervisor::print() const
+{
+    printf("supervisor: %u windows", unsigned(_windows));
+    if (_late_max_mm != INT_MIN)
+        printf(", latest arrival %d mm past expected", _late_max_mm);
+    printf(";");
+    for (int e = 1; e < event_cnt; e++)
+        printf(" %s %u", name(Event(e)), unsigned(_events[e]));
+    printf("\n");
+}
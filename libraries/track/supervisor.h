@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+
+class Motion;
+
+// Notices a loco that isn't going where it's told: stalled, slipping, or
+// off the track.
+//
+// Waiting for a sensor is where a stopped loco turns into a hang, so the
+// app opens a window when it starts to wait (expect(), with how far the
+// loco should go before the sensor changes) and closes it when the sensor
+// does (arrived()). If Motion's odometer gets slip_pct plus slack_mm past
+// that without the sensor, it's overdue, which takes at most that far at
+// the commanded speed to find out.
+//
+// Other evidence makes it quicker, or says what went wrong, when the app
+// has it: RailCom speed reports from the decoder (railcom()) and the
+// motor current (current(), with limits from current_limits()). With a
+// window open and the loco commanded to move, reports of speed 0 or a
+// current over the stall limit for stall_us is a stall; current under the
+// lost limit that long is a derail (no pickup). An overdue window is a
+// slip if the decoder says it's moving, a stall or derail if the other
+// evidence says so, and otherwise just overdue.
+//
+// An event is raised once, to the callback (from loop()), and nothing
+// more is checked until resume(). Between windows nothing is checked: a
+// move by distance ends by itself, and a loco stopped in one is overdue at
+// the next sensor.
+
+class Supervisor
+{
+public:
+
+    enum class Event {
+        None,
+        Overdue, // sensor didn't change in time; no other evidence
+        Stall,   // commanded to move, but not
+        Slip,    // wheels turning, but not getting there
+        Derail,  // lost the track current
+    };
+    static constexpr int event_cnt = 5;
+
+    typedef void(EventFunc)(Event e, intptr_t arg);
+
+    static constexpr int slip_pct = 25;
+    static constexpr int slack_mm = 50;
+    static constexpr int moving_mms = 10; // commanded slower is stopped
+    static constexpr uint32_t stall_us = 1'500'000;
+    static constexpr uint32_t report_us = 500'000; // RailCom is stale after
+
+    Supervisor(const Motion &motion, EventFunc *func, intptr_t arg = 0);
+
+    // Motor current limits, mA; 0 doesn't check that one.
+    void current_limits(int stall_ma, int lost_ma);
+
+    // The sensor being waited for should change within dist_mm.
+    void expect(int dist_mm);
+
+    // It did.
+    void arrived();
+
+    // Evidence as it comes in.
+    void railcom(int speed_kmh);
+    void current(int ma);
+
+    void loop();
+
+    Event event() const
+    {
+        return _event;
+    }
+
+    bool tripped() const
+    {
+        return _event != Event::None;
+    }
+
+    // The open (or last) window: how far the loco was expected to go, and
+    // how far it has gone.
+    int expect_mm() const
+    {
+        return _expect_mm;
+    }
+    int used_mm() const;
+
+    // Check again: an open window starts over from here, as long as it
+    // was, since the odometer's count so far can't be trusted.
+    void resume();
+
+    static const char *name(Event e);
+
+    void print() const;
+
+private:
+
+    const Motion &_motion;
+    EventFunc *_func;
+    intptr_t _arg;
+
+    int _stall_ma; // 0 if not checked
+    int _lost_ma;  // 0 if not checked
+
+    // window
+    bool _open;
+    int _start_mm; // odometer
+    int _expect_mm;
+
+    uint32_t _moving_us; // when the commanded speed got to moving_mms
+    bool _moving;
+
+    // RailCom: last report, and since when it's been 0
+    bool _rc;
+    uint32_t _rc_us;
+    int _rc_kmh;
+    uint32_t _rc_zero_us;
+
+    // current: since when it's been over the stall limit or under the lost
+    bool _ma;
+    uint32_t _ma_us;
+    bool _high;
+    uint32_t _high_us;
+    bool _low;
+    uint32_t _low_us;
+
+    Event _event;
+
+    // stats
+    uint32_t _windows;
+    int _late_max_mm; // arrival past expected (INT_MIN if none yet)
+    uint32_t _events[event_cnt];
+
+    bool held(bool cond, uint32_t since_us, uint32_t now_us) const;
+    Event overdue(uint32_t now_us) const;
+    void raise(Event e);
+};
@@ -0,0 +1,214 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+// pico
+#include "pico/stdlib.h"
+//
+#include "trace.h"
+
+
+Trace::Trace() :
+    _buf{},
+    _on(false),
+    _head(0),
+    _tail(0),
+    _last_us(0),
+    _lost(0),
+    _lost_total(0)
+{
+    for (int i = 0; i < sensor_max; i++) {
+        _level[i] = -1;
+        _dist[i] = -1;
+    }
+}
+
+
+void Trace::init()
+{
+    _head = 0;
+    _tail = 0;
+    _lost = 0;
+    _lost_total = 0;
+    for (int i = 0; i < sensor_max; i++) {
+        _level[i] = -1;
+        _dist[i] = -1;
+    }
+    _on = true;
+    put(TraceRec::Kind::Start);
+}
+
+
+void Trace::speed(int loco, int speed)
+{
+    put(TraceRec::Kind::Speed, loco, speed);
+}
+
+
+void Trace::func(int loco, int f, bool on)
+{
+    put(TraceRec::Kind::Func, loco, f, on ? 1 : 0);
+}
+
+
+void Trace::cv_set(int cv, int val, int status)
+{
+    put(TraceRec::Kind::CvSet, cv, val, status);
+}
+
+
+void Trace::cv_get(int cv, int val, int status)
+{
+    put(TraceRec::Kind::CvGet, cv, val, status);
+}
+
+
+void Trace::cv_bit(int cv, int bit, int val, int status)
+{
+    put(TraceRec::Kind::CvBit, cv, bit, val, status);
+}
+
+
+void Trace::wake()
+{
+    put(TraceRec::Kind::Wake);
+}
+
+
+void Trace::sensor(int idx, bool level)
+{
+    if (idx < 0 || idx >= sensor_max || _level[idx] == (level ? 1 : 0))
+        return;
+    _level[idx] = level ? 1 : 0;
+    put(TraceRec::Kind::Sensor, idx, level ? 1 : 0);
+}
+
+
+void Trace::sensor2(int idx, int dist_mm)
+{
+    if (idx < 0 || idx >= sensor_max)
+        return;
+
+    if (dist_mm < 0)
+        dist_mm = 0;
+    else if (dist_mm > TraceRec::dist_none)
+        dist_mm = TraceRec::dist_none;
+
+    const int32_t last_mm = _dist[idx];
+    if (last_mm >= 0) {
+        if (dist_mm == last_mm)
+            return;
+        // in and out of range always count
+        const bool none = (dist_mm == TraceRec::dist_none);
+        const bool last_none = (last_mm == TraceRec::dist_none);
+        if (none == last_none && abs(dist_mm - last_mm) <= dist_tol_mm)
+            return;
+    }
+
+    _dist[idx] = dist_mm;
+    put(TraceRec::Kind::Sensor2, idx, dist_mm);
+}
+
+
+// Worst case record: kind, five-byte time, four five-byte fields.
+static constexpr int rec_max = 1 + 5 + 4 * 5;
+
+
+static int put_uvar(uint8_t *p, uint32_t v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+        p[n++] = uint8_t(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = uint8_t(v);
+    return n;
+}
+
+
+static int put_svar(uint8_t *p, int32_t v)
+{
+    return put_uvar(p, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
+}
+
+
+void Trace::put(TraceRec::Kind kind, int32_t a, int32_t b, int32_t c,
+                int32_t d)
+{
+    if (!_on)
+        return;
+
+    const uint32_t now_us = time_us_32();
+
+    // a Lost record goes first if there's room for both
+    const int need = (_lost > 0) ? 2 * rec_max : rec_max;
+    if (buf_max - int(_head - _tail) < need) {
+        _lost++;
+        _lost_total++;
+        return;
+    }
+
+    if (_lost > 0) {
+        const uint32_t lost = _lost;
+        _lost = 0;
+        put(TraceRec::Kind::Lost, int32_t(lost));
+    }
+
+    uint8_t rec[rec_max];
+    int n = 0;
+    rec[n++] = uint8_t(kind);
+    if (kind == TraceRec::Kind::Start)
+        n += put_uvar(rec + n, now_us);
+    else
+        n += put_uvar(rec + n, now_us - _last_us);
+    const int32_t field[] = {a, b, c, d};
+    for (int i = 0; i < TraceReader::fields(kind); i++)
+        n += put_svar(rec + n, field[i]);
+    _last_us = now_us;
+
+    for (int i = 0; i < n; i++)
+        _buf[(_head + i) % buf_max] = rec[i];
+    _head += n;
+}
+
+
+// Write up to max bytes as one line, return how many.
+int Trace::out(int max)
+{
+    int n = int(_head - _tail);
+    if (n > max)
+        n = max;
+    if (n <= 0)
+        return 0;
+
+    char line[1 + 2 * 64 + 2];
+    static const char hex[] = "0123456789abcdef";
+    int len = 0;
+    line[len++] = '@';
+    for (int i = 0; i < n; i++) {
+        const uint8_t b = _buf[(_tail + i) % buf_max];
+        line[len++] = hex[b >> 4];
+        line[len++] = hex[b & 0xf];
+    }
+    line[len++] = '\n';
+    line[len] = '\0';
+    fputs(line, stdout);
+    _tail += n;
+    return n;
+}
+
+
+void Trace::loop()
+{
+    // A full line at a time once there's enough, so records mostly don't
+    // straddle lines (the reader doesn't care if they do).
+    if (int(_head - _tail) >= 32)
+        out(64);
+}
+
+
+void Trace::flush()
+{
+    while (out(64) > 0)
+        ;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+
+// Session trace: everything an app did to the layout and everything it saw
+// of it, compact enough to stream over USB while the app runs.
+//
+// Each record is a kind byte, the microseconds since the previous record
+// (varint), then the kind's fields (varints; signed ones zigzagged).
+// Sensors are recorded when they change, so a quiet layout costs little.
+//
+// Nothing is recorded until init(), so an app that doesn't want the trace
+// just doesn't call it. The recorder keeps the encoded bytes in a ring;
+// loop() writes what's there to stdout as "@<hex>" lines, which can be
+// mixed with the app's own printfs. On the host, TraceReader decodes the "@" lines of a captured log
+// (see host/sim, --replay).
+
+struct TraceRec {
+
+    enum class Kind : uint8_t {
+        Start,   // time is the recorder's time_us_32 at init
+        Speed,   // a = loco, b = dcc speed (signed)
+        Func,    // a = loco, b = function, c = on
+        CvSet,   // a = cv, b = value, c = status
+        CvGet,   // a = cv, b = value read, c = status
+        CvBit,   // a = cv, b = bit, c = value, d = status
+        Sensor,  // a = sensor, b = level
+        Sensor2, // a = sensor, b = mm (dist_none if nothing in range)
+        Wake,    // a timed wait ended
+        Lost,    // a = records dropped because the ring was full
+        Max
+    };
+
+    static constexpr int dist_none = 0xffff;
+
+    Kind kind;
+    uint32_t time_us; // absolute, decoded from the deltas
+    int32_t a, b, c, d;
+};
+
+
+class Trace
+{
+public:
+
+    static constexpr int sensor_max = 8;
+
+    // Distance changes this small aren't recorded. Replaying reproduces
+    // the app's decisions only with every change (0): a reading that's off
+    // by a mm or two moves a threshold, and noise makes that seconds late.
+    static constexpr int dist_tol_mm = 0;
+
+    Trace();
+
+    // Start record, then whatever is set up later is recorded on change.
+    void init();
+
+    bool on() const
+    {
+        return _on;
+    }
+
+    void speed(int loco, int speed);
+    void func(int loco, int f, bool on);
+    void cv_set(int cv, int val, int status);
+    void cv_get(int cv, int val, int status);
+    void cv_bit(int cv, int bit, int val, int status);
+    void wake();
+
+    // recorded only if changed
+    void sensor(int idx, bool level);
+    void sensor2(int idx, int dist_mm);
+
+    // Write out some of what's buffered; call from the app's loop.
+    void loop();
+
+    // Write out everything buffered.
+    void flush();
+
+    uint32_t lost() const
+    {
+        return _lost_total;
+    }
+
+private:
+
+    // Several seconds of the busiest sensor traffic (under 1K/sec), as long
+    // as loop() keeps streaming it out
+    static constexpr int buf_max = 4096;
+    uint8_t _buf[buf_max];
+    bool _on; // init() called
+    uint32_t _head; // free-running; written
+    uint32_t _tail; // free-running; streamed
+
+    uint32_t _last_us;
+    uint32_t _lost; // since the last Lost record
+    uint32_t _lost_total;
+
+    int8_t _level[sensor_max]; // -1 = not recorded yet
+    int32_t _dist[sensor_max]; // -1 = not recorded yet
+
+    void put(TraceRec::Kind kind, int32_t a = 0, int32_t b = 0,
+             int32_t c = 0, int32_t d = 0);
+
+    int out(int max);
+};
+
+
+// Decodes a byte stream from Trace.
+class TraceReader
+{
+public:
+
+    TraceReader(const uint8_t *buf, int len) :
+        _buf(buf),
+        _len(len),
+        _pos(0),
+        _time_us(0)
+    {
+    }
+
+    // false at the end or on a malformed record
+    bool next(TraceRec &rec)
+    {
+        if (_pos >= _len || _buf[_pos] >= uint8_t(TraceRec::Kind::Max))
+            return false;
+        const int pos = _pos;
+        rec = TraceRec{};
+        rec.kind = TraceRec::Kind(_buf[_pos++]);
+        uint32_t dt;
+        if (!uvar(dt))
+            return fail(pos);
+        _time_us = (rec.kind == TraceRec::Kind::Start) ? dt : _time_us + dt;
+        rec.time_us = _time_us;
+        int32_t *f[] = {&rec.a, &rec.b, &rec.c, &rec.d};
+        for (int i = 0; i < fields(rec.kind); i++)
+            if (!svar(*f[i]))
+                return fail(pos);
+        return true;
+    }
+
+    // number of fields after the time
+    static constexpr int fields(TraceRec::Kind kind)
+    {
+        switch (kind) {
+        case TraceRec::Kind::Speed:
+        case TraceRec::Kind::Sensor:
+        case TraceRec::Kind::Sensor2:
+            return 2;
+        case TraceRec::Kind::Func:
+        case TraceRec::Kind::CvSet:
+        case TraceRec::Kind::CvGet:
+            return 3;
+        case TraceRec::Kind::CvBit:
+            return 4;
+        case TraceRec::Kind::Lost:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    static const char *name(TraceRec::Kind kind)
+    {
+        static const char *const names[] = {
+            "start",  "speed",  "func",    "cv_set", "cv_get",
+            "cv_bit", "sensor", "sensor2", "wake",   "lost",
+        };
+        const int k = int(kind);
+        return (k < int(TraceRec::Kind::Max)) ? names[k] : "?";
+    }
+
+    int pos() const
+    {
+        return _pos;
+    }
+
+private:
+
+    const uint8_t *_buf;
+    int _len;
+    int _pos;
+    uint32_t _time_us;
+
+    bool fail(int pos)
+    {
+        _pos = pos;
+        return false;
+    }
+
+    bool uvar(uint32_t &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (_pos >= _len)
+                return false;
+            const uint8_t b = _buf[_pos++];
+            v |= uint32_t(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool svar(int32_t &v)
+    {
+        uint32_t u;
+        if (!uvar(u))
+            return false;
+        v = int32_t(u >> 1) ^ -int32_t(u & 1);
+        return true;
+    }
+};
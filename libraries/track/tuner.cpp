@@ -0,0 +1,190 @@
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+//
+#include "tuner.h"
+
+
+Tuner::Tuner(Param *param, int param_cnt, int trial_cycles, OkFunc *ok,
+             intptr_t ok_arg) :
+    _param(param),
+    _param_cnt(param_cnt < param_max ? param_cnt : param_max),
+    _trial_cycles(trial_cycles > 0 ? trial_cycles : 1),
+    _ok(ok),
+    _ok_arg(ok_arg),
+    _tuning(false),
+    _done(false),
+    _step{},
+    _dir{},
+    _tried{},
+    _cur(-1),
+    _cur_old(0),
+    _cycles(0),
+    _sum_us(0),
+    _best_us(0),
+    _best_val{},
+    _trials(0),
+    _kept(0),
+    _failed(0)
+{
+}
+
+
+void Tuner::start()
+{
+    for (int i = 0; i < _param_cnt; i++) {
+        _step[i] = abs(_param[i].step);
+        _dir[i] = (_param[i].step < 0) ? -1 : 1;
+        _tried[i] = 0;
+        _best_val[i] = *_param[i].val;
+    }
+    _tuning = true;
+    _done = false;
+    _cur = -1; // baseline
+    _cycles = 0;
+    _sum_us = 0;
+    _best_us = 0;
+    _trials = 1;
+    _kept = 0;
+    _failed = 0;
+}
+
+
+void Tuner::stop()
+{
+    if (_tuning && _cur >= 0)
+        *_param[_cur].val = _cur_old;
+    _tuning = false;
+}
+
+
+bool Tuner::cycle(uint32_t cycle_us, int failures)
+{
+    if (!_tuning)
+        return false;
+
+    if (failures > 0) {
+        if (_cur < 0) {
+            // baseline again; failures here are just what the layout does
+            _cycles = 0;
+            _sum_us = 0;
+            return false;
+        }
+        *_param[_cur].val = _cur_old;
+        _failed++;
+        miss(_cur);
+        next();
+        return false;
+    }
+
+    _sum_us += cycle_us;
+    if (++_cycles < _trial_cycles)
+        return false;
+
+    const uint32_t mean_us = uint32_t(_sum_us / _cycles);
+
+    if (_cur < 0) {
+        _best_us = mean_us;
+        next();
+        return false;
+    }
+
+    if (uint64_t(mean_us) * 100 < uint64_t(_best_us) * (100 - gain_pct)) {
+        // keep it, and go on the same way
+        _best_us = mean_us;
+        _best_val[_cur] = *_param[_cur].val;
+        _kept++;
+        _tried[_cur] = 0;
+        if (move(_cur))
+            trial(_cur);
+        else
+            next();
+        return true;
+    }
+
+    *_param[_cur].val = _cur_old;
+    miss(_cur);
+    next();
+    return false;
+}
+
+
+// Moving param i in its current direction didn't help: try the other way,
+// and when both ways have failed, a smaller step.
+void Tuner::miss(int i)
+{
+    _dir[i] = -_dir[i];
+    _tried[i]++;
+    if (_tried[i] >= 2 && _step[i] > _param[i].step_min) {
+        _step[i] /= 2;
+        if (_step[i] < _param[i].step_min)
+            _step[i] = _param[i].step_min;
+        _tried[i] = 0;
+    }
+}
+
+
+bool Tuner::stuck(int i) const
+{
+    return _step[i] <= _param[i].step_min && _tried[i] >= 2;
+}
+
+
+// Move param i one step, if there's any way it can go.
+bool Tuner::move(int i)
+{
+    Param &p = _param[i];
+    while (!stuck(i)) {
+        const int old = *p.val;
+        const int val = old + _dir[i] * _step[i];
+        if (val >= p.min && val <= p.max) {
+            *p.val = val;
+            if (_ok == nullptr || _ok(_ok_arg)) {
+                _cur_old = old;
+                return true;
+            }
+            *p.val = old;
+        }
+        miss(i);
+    }
+    return false;
+}
+
+
+void Tuner::trial(int i)
+{
+    _cur = i;
+    _cycles = 0;
+    _sum_us = 0;
+    _trials++;
+}
+
+
+// Next parameter after the current one that can still move.
+void Tuner::next()
+{
+    for (int k = 1; k <= _param_cnt; k++) {
+        const int i = (_cur + k + _param_cnt) % _param_cnt;
+        if (move(i)) {
+            trial(i);
+            return;
+        }
+    }
+    _done = true;
+    _tuning = false;
+}
+
+
+void Tuner::print() const
+{
+    printf("tuner: %s, best cycle %u ms, trials %u (kept %u, failed %u)\n",
+           _done ? "done" : (_tuning ? "tuning" : "stopped"),
+           unsigned(_best_us / 1000), unsigned(_trials), unsigned(_kept),
+           unsigned(_failed));
+    for (int i = 0; i < _param_cnt; i++) {
+        const Param &p = _param[i];
+        printf("  %-16s %6d  [%d..%d] step %d%s\n", p.name, *p.val, p.min,
+               p.max, _step[i], (_tuning && i == _cur) ? "  <- trial" : "");
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+
+// Tunes an app's integer parameters for the shortest cycle without
+// failures, one cycle at a time, on the layout.
+//
+// Each trial runs trial_cycles cycles with one parameter moved one step.
+// A trial with any failure (whatever the app counts as one: a retry, a
+// recoupling, a sensor reading out of range) is abandoned at once and the
+// parameter goes back. A trial with no failures that is faster than the
+// best so far by more than the noise (gain_pct) is kept, and that
+// parameter is tried again in the same direction. Otherwise the other
+// direction is tried next, and once both have failed the parameter's
+// step is halved. Tuning is done when every step is at its minimum and a
+// whole pass over the parameters found nothing better.
+//
+// Trials should cover whatever the cycle repeats over (e.g. the three
+// spur rotations in circuits), so trial_cycles is the app's choice.
+//
+// Parameters the app can't run with together (e.g. speeds out of order)
+// are rejected by the ok callback before they're tried.
+
+class Tuner
+{
+public:
+
+    struct Param {
+        const char *name;
+        int *val;
+        int min;
+        int max;
+        int step;     // initial step; its sign is the way to try first
+        int step_min; // done when the step gets here
+    };
+
+    typedef bool(OkFunc)(intptr_t arg);
+
+    static constexpr int param_max = 16;
+    static constexpr int gain_pct = 1;
+
+    Tuner(Param *param, int param_cnt, int trial_cycles,
+          OkFunc *ok = nullptr, intptr_t ok_arg = 0);
+
+    // Start tuning from the current values.
+    void start();
+
+    bool tuning() const
+    {
+        return _tuning;
+    }
+
+    bool done() const
+    {
+        return _done;
+    }
+
+    // A cycle ended; may change a parameter for the next one. Returns
+    // true when a better setting was just found (time to save it).
+    bool cycle(uint32_t cycle_us, int failures);
+
+    // Stop, putting back a parameter that's on trial.
+    void stop();
+
+    uint32_t best_us() const
+    {
+        return _best_us;
+    }
+
+    // value of parameter i in the best setting so far (when cycle() says
+    // there's a better one, the next trial has already moved a parameter)
+    int best(int i) const
+    {
+        return _best_val[i];
+    }
+
+    void print() const;
+
+private:
+
+    Param *_param;
+    int _param_cnt;
+    int _trial_cycles;
+    OkFunc *_ok;
+    intptr_t _ok_arg;
+
+    bool _tuning;
+    bool _done;
+
+    int _step[param_max];
+    int _dir[param_max];   // +1 or -1, the direction to try next
+    int _tried[param_max]; // directions tried at this step without a gain
+
+    int _cur;     // parameter being moved, -1 for the baseline trial
+    int _cur_old; // its value before the move
+    int _cycles;  // in this trial
+    uint64_t _sum_us;
+
+    uint32_t _best_us; // mean cycle of the kept setting
+    int _best_val[param_max];
+    uint32_t _trials;
+    uint32_t _kept;
+    uint32_t _failed;
+
+    void miss(int i);
+    bool stuck(int i) const;
+    bool move(int i);
+    void trial(int i);
+    void next();
+};
@@ -0,0 +1,150 @@
+
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "pico/stdlib.h"
+//
+#include "turnout_sched.h"
+
+
+TurnoutSched::TurnoutSched(int turnout_cnt, uint32_t recharge_us,
+                           ThrowFunc *throw_func, intptr_t throw_arg) :
+    _turnout_cnt(turnout_cnt < turnout_max ? turnout_cnt : turnout_max),
+    _recharge_us(recharge_us),
+    _throw_func(throw_func),
+    _throw_arg(throw_arg),
+    _pos{},
+    _thrown_us{},
+    _queue{},
+    _queue_cnt(0),
+    _fired(false),
+    _fired_us(0),
+    _throws(0),
+    _skips(0),
+    _waits(0),
+    _wait_max_us(0)
+{
+    for (int t = 0; t < turnout_max; t++)
+        _pos[t] = -1;
+}
+
+
+// When the CDU can next throw. The elapsed time is unsigned, so however
+// long it's been idle it's never held off for more than one recharge
+// (only that, after a multiple of the 71.6 minutes the clock takes to
+// wrap).
+uint32_t TurnoutSched::ready_us(uint32_t now_us) const
+{
+    if (!_fired || now_us - _fired_us >= _recharge_us)
+        return now_us;
+    return _fired_us + _recharge_us;
+}
+
+
+uint32_t TurnoutSched::line(uint8_t turnouts, uint8_t straight)
+{
+    const uint32_t now_us = time_us_32();
+
+    for (int t = 0; t < _turnout_cnt; t++) {
+        if ((turnouts & (1u << t)) == 0)
+            continue;
+        const bool s = (straight & (1u << t)) != 0;
+
+        int q = 0;
+        while (q < _queue_cnt && _queue[q].turnout != t)
+            q++;
+        if (_pos[t] == int8_t(s)) {
+            // already there, and if it was going to be thrown, not now
+            _skips++;
+            if (q < _queue_cnt) {
+                for (; q + 1 < _queue_cnt; q++)
+                    _queue[q] = _queue[q + 1];
+                _queue_cnt--;
+            }
+        } else if (q < _queue_cnt) {
+            _queue[q].straight = s;
+        } else {
+            _queue[_queue_cnt++] = {int8_t(t), s, now_us};
+        }
+    }
+
+    // the route's last throw
+    int last = -1;
+    for (int q = 0; q < _queue_cnt; q++)
+        if ((turnouts & (1u << _queue[q].turnout)) != 0)
+            last = q;
+
+    if (last < 0)
+        return now_us;
+    return ready_us(now_us) + uint32_t(last) * _recharge_us;
+}
+
+
+bool TurnoutSched::lined(uint8_t turnouts, uint8_t straight) const
+{
+    for (int t = 0; t < _turnout_cnt; t++) {
+        if ((turnouts & (1u << t)) == 0)
+            continue;
+        if (_pos[t] != int8_t((straight & (1u << t)) != 0))
+            return false;
+        for (int q = 0; q < _queue_cnt; q++)
+            if (_queue[q].turnout == t)
+                return false;
+    }
+    return true;
+}
+
+
+uint32_t TurnoutSched::lined_us(uint8_t turnouts) const
+{
+    uint32_t us = 0;
+    bool any = false;
+    for (int t = 0; t < _turnout_cnt; t++) {
+        if ((turnouts & (1u << t)) == 0 || _pos[t] < 0)
+            continue;
+        if (!any || int32_t(_thrown_us[t] - us) > 0)
+            us = _thrown_us[t];
+        any = true;
+    }
+    return us;
+}
+
+
+void TurnoutSched::loop()
+{
+    if (_queue_cnt == 0)
+        return;
+
+    const uint32_t now_us = time_us_32();
+    if (ready_us(now_us) != now_us)
+        return;
+
+    const Throw th = _queue[0];
+    for (int q = 1; q < _queue_cnt; q++)
+        _queue[q - 1] = _queue[q];
+    _queue_cnt--;
+
+    _throw_func(th.turnout, th.straight, _throw_arg);
+    _pos[th.turnout] = int8_t(th.straight);
+    _thrown_us[th.turnout] = now_us;
+    _fired = true;
+    _fired_us = now_us;
+
+    _throws++;
+    // a loop() or two late doesn't count as waiting
+    const uint32_t wait_us = now_us - th.queued_us;
+    if (wait_us > 10'000) {
+        _waits++;
+        if (wait_us > _wait_max_us)
+            _wait_max_us = wait_us;
+    }
+}
+
+
+void TurnoutSched::print() const
+{
+    printf("turnouts: %u throws, %u not needed, %u waited for the CDU "
+           "(longest %u ms)\n",
+           unsigned(_throws), unsigned(_skips), unsigned(_waits),
+           unsigned((_wait_max_us + 500) / 1000));
+}
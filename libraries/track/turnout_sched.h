@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+// Throws turnouts as soon as the capacitive discharge unit allows.
+//
+// All the turnouts are fired from one CDU, which needs recharge_us after
+// a throw before it can throw another. The app asks for a route (the
+// turnouts it goes through, and which way each) as soon as it's safe to
+// throw them, e.g. at the start of a move, and line() queues the throws
+// and says when the last of them will have happened; loop() fires them,
+// oldest first, each as soon as the CDU has recharged. The app only
+// waits (lined()) at the last moment, just before the train gets to the
+// points, so throwing overlaps with whatever it does in between.
+//
+// The scheduler remembers where it put each turnout, and doesn't throw
+// one that's already where it's wanted (which would use up a charge for
+// nothing). Nothing else may throw them.
+
+class TurnoutSched
+{
+public:
+
+    static constexpr int turnout_max = 8;
+
+    typedef void(ThrowFunc)(int turnout, bool straight, intptr_t arg);
+
+    TurnoutSched(int turnout_cnt, uint32_t recharge_us, ThrowFunc *throw_func,
+                 intptr_t throw_arg = 0);
+
+    // Queue throws for a route (bit per turnout, and which of them are to
+    // be straight); returns the time_us_32() it should be lined by.
+    uint32_t line(uint8_t turnouts, uint8_t straight);
+
+    // Every turnout in the route has been thrown that way.
+    bool lined(uint8_t turnouts, uint8_t straight) const;
+
+    // When the last throw for the route happened (once it's lined).
+    uint32_t lined_us(uint8_t turnouts) const;
+
+    void loop();
+
+    void print() const;
+
+private:
+
+    int _turnout_cnt;
+    uint32_t _recharge_us;
+    ThrowFunc *_throw_func;
+    intptr_t _throw_arg;
+
+    int8_t _pos[turnout_max]; // 1 straight, 0 diverging, -1 not known
+    uint32_t _thrown_us[turnout_max];
+
+    // pending throws, oldest first, at most one per turnout
+    struct Throw {
+        int8_t turnout;
+        bool straight;
+        uint32_t queued_us; // asked for
+    };
+    Throw _queue[turnout_max];
+    int _queue_cnt;
+
+    bool _fired; // the CDU has been used (so _fired_us means something)
+    uint32_t _fired_us;
+
+    // stats
+    uint32_t _throws;
+    uint32_t _skips;       // already there
+    uint32_t _waits;       // throws that waited for the CDU
+    uint32_t _wait_max_us; // longest, from being asked for to thrown
+
+    uint32_t ready_us(uint32_t now_us) const;
+};
@@ -0,0 +1,156 @@
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+//
+#include "uncouple_learn.h"
+
+// The first is how circuits always did it, and what a retry falls back to.
+static constexpr UncoupleLearn::Arm arms[UncoupleLearn::arm_cnt] = {
+    {50, 500}, {35, 500}, {20, 500}, {50, 300}, {35, 300}, {20, 300},
+};
+
+
+UncoupleLearn::UncoupleLearn() :
+    _pair{},
+    _used(0)
+{
+    for (int p = 0; p < pair_max; p++)
+        _pair[p].car = -1;
+}
+
+
+const UncoupleLearn::Arm &UncoupleLearn::arm(int a)
+{
+    return arms[a];
+}
+
+
+UncoupleLearn::Pair &UncoupleLearn::pair(uint32_t loco_sn, int car)
+{
+    int lru = 0;
+    for (int p = 0; p < pair_max; p++) {
+        Pair &pr = _pair[p];
+        if (pr.car == car && pr.loco_sn == loco_sn) {
+            pr.used = ++_used;
+            return pr;
+        }
+        if (_pair[lru].car >= 0 && (pr.car < 0 || pr.used < _pair[lru].used))
+            lru = p;
+    }
+    Pair &pr = _pair[lru];
+    pr = {};
+    pr.loco_sn = loco_sn;
+    pr.car = car;
+    pr.used = ++_used;
+    return pr;
+}
+
+
+int UncoupleLearn::choose(uint32_t loco_sn, int car)
+{
+    const Pair &pr = pair(loco_sn, car);
+
+    int n_all = 0;
+    uint32_t ms_all = 0;
+    for (int a = 0; a < arm_cnt; a++) {
+        if (pr.arm[a].n == 0)
+            return a;
+        n_all += pr.arm[a].n;
+        ms_all += pr.arm[a].sum_ms;
+    }
+
+    // the allowance is in proportion to the mean over all arms
+    const float mean_all = float(ms_all) / n_all;
+    const float log_n = logf(float(n_all));
+    int best = 0;
+    float best_score = 0;
+    bool any = false;
+    for (int a = 0; a < arm_cnt; a++) {
+        const ArmStat &st = pr.arm[a];
+        if (st.n >= 2 && st.firsts == 0)
+            continue;
+        const float mean = float(st.sum_ms) / st.n;
+        const float score = mean - mean_all * sqrtf(log_n / (2.0f * st.n));
+        if (!any || score < best_score) {
+            best = a;
+            best_score = score;
+            any = true;
+        }
+    }
+    return best;
+}
+
+
+void UncoupleLearn::attempt(uint32_t loco_sn, int car, int offset_mm, bool ok)
+{
+    Pair &pr = pair(loco_sn, car);
+    pr.tries++;
+    if (ok)
+        pr.oks++;
+    pr.offset_sum += offset_mm;
+    pr.offset2_sum += offset_mm * offset_mm;
+}
+
+
+void UncoupleLearn::done(uint32_t loco_sn, int car, int a, uint32_t us,
+                         int tries)
+{
+    Pair &pr = pair(loco_sn, car);
+    pr.uncouples++;
+    pr.arm[a].n++;
+    if (tries == 1)
+        pr.arm[a].firsts++;
+    pr.arm[a].sum_ms += (us + 500) / 1000;
+}
+
+
+int UncoupleLearn::success_pct() const
+{
+    int tries = 0;
+    int oks = 0;
+    for (const Pair &pr : _pair) {
+        tries += pr.tries;
+        oks += pr.oks;
+    }
+    return (tries > 0) ? (oks * 100 + tries / 2) / tries : 0;
+}
+
+
+int UncoupleLearn::tries_x100() const
+{
+    int tries = 0;
+    int uncouples = 0;
+    for (const Pair &pr : _pair) {
+        tries += pr.tries;
+        uncouples += pr.uncouples;
+    }
+    return (uncouples > 0) ? (tries * 100 + uncouples / 2) / uncouples : 0;
+}
+
+
+void UncoupleLearn::print() const
+{
+    const int t = tries_x100();
+    printf("uncouple: %d%% of tries work, %d.%02d tries each\n", success_pct(),
+           t / 100, t % 100);
+    for (const Pair &pr : _pair) {
+        if (pr.car < 0 || pr.tries == 0)
+            continue;
+        const int mean = pr.offset_sum / pr.tries;
+        const int var = pr.offset2_sum / pr.tries - mean * mean;
+        printf("  loco %08x car %d: %d of %d tries, stopped %d mm past "
+               "(sd %d)\n",
+               unsigned(pr.loco_sn), pr.car, pr.oks, pr.tries, mean,
+               int(sqrtf(float(var > 0 ? var : 0)) + 0.5f));
+        for (int a = 0; a < arm_cnt; a++) {
+            const ArmStat &st = pr.arm[a];
+            if (st.n == 0)
+                continue;
+            printf("    clear %2d mm, wait %3d ms: %d (%d first try), "
+                   "mean %u ms\n",
+                   arms[a].clear_mm, arms[a].dwell_ms, st.n, st.firsts,
+                   unsigned(st.sum_ms / st.n));
+        }
+    }
+}
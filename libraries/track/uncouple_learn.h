@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+// Learns, for each loco and car, the quickest way to uncouple them.
+//
+// Uncoupling pulls the couplers clear of the magnet, backs until the gap
+// is over it, waits there with the slack out, then pulls away to see if
+// the car stayed. How far to pull clear and how long to wait are a
+// guess; too little fails (and a retry costs seconds), too much wastes
+// time every time. Each way of doing it (an Arm) is tried, and from then
+// on choose() picks the one with the shortest mean time to uncouple,
+// retries included, less an allowance for arms that have been tried
+// less (UCB1, at half the usual weight: a bad arm costs a retry), so one
+// that was unlucky early gets tried again. An arm whose first try has
+// failed every time, twice or more, isn't chosen again. A retry always
+// goes back to the first arm, the way it was always done, so an arm that
+// never works can't stall the layout.
+//
+// attempt() records each try: where it stopped, past the sensor edge,
+// and whether it came apart. Those give the success rate and mean tries
+// for print(), and the offsets show whether stopping is consistent.
+
+class UncoupleLearn
+{
+public:
+
+    struct Arm {
+        int16_t clear_mm; // pull this far clear of the magnet first
+        int16_t dwell_ms; // wait over the magnet
+    };
+
+    static constexpr int arm_cnt = 6;
+    static constexpr int pair_max = 8;
+
+    UncoupleLearn();
+
+    static const Arm &arm(int a);
+
+    // How to do the next uncouple of this loco and car.
+    int choose(uint32_t loco_sn, int car);
+
+    // A try with arm a stopped offset_mm past the sensor edge.
+    void attempt(uint32_t loco_sn, int car, int offset_mm, bool ok);
+
+    // The car came off with arm a, us after it started, after tries.
+    void done(uint32_t loco_sn, int car, int a, uint32_t us, int tries);
+
+    // Over every pair: tries that came apart (percent), and tries per
+    // uncouple (x100).
+    int success_pct() const;
+    int tries_x100() const;
+
+    void print() const;
+
+private:
+
+    struct ArmStat {
+        int n;          // uncouples
+        int firsts;     // ... that took one try
+        uint32_t sum_ms;
+    };
+
+    struct Pair {
+        uint32_t loco_sn;
+        int car; // -1 if the entry is free
+        uint32_t used; // for replacing the least recently used
+        ArmStat arm[arm_cnt];
+        int uncouples;
+        int tries;
+        int oks;
+        int32_t offset_sum;
+        int32_t offset2_sum;
+    };
+    Pair _pair[pair_max];
+    uint32_t _used;
+
+    Pair &pair(uint32_t loco_sn, int car);
+};
@@ -0,0 +1,327 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+//
+#include "yard_planner.h"
+
+
+YardPlanner::YardPlanner(int spur_cnt, const int *cap, int train_max,
+                         CostFunc *cost, intptr_t cost_arg) :
+    _spur_cnt(spur_cnt < spur_max ? spur_cnt : spur_max),
+    _cap{},
+    _base{},
+    _train_max(train_max > 0 ? train_max : 1),
+    _cost(cost),
+    _cost_arg(cost_arg),
+    _cost_min(0),
+    _node_cnt(0),
+    _heap_cnt(0),
+    _cache_cnt(0),
+    _use(0),
+    _plans(0),
+    _hits(0),
+    _searches(0),
+    _nodes_max(0)
+{
+    int place = 0;
+    for (int s = 0; s < _spur_cnt; s++) {
+        _base[s] = place;
+        _cap[s] = cap[s];
+        if (place + _cap[s] > place_max)
+            _cap[s] = place_max - place;
+        place += _cap[s];
+    }
+}
+
+
+bool YardPlanner::push(State &s, int spur, int car) const
+{
+    assert(car >= 0 && car < car_max);
+    const int n = count(s, spur);
+    if (n >= _cap[spur])
+        return false;
+    s |= State(car + 1) << (4 * (_base[spur] + n));
+    return true;
+}
+
+
+int YardPlanner::count(State s, int spur) const
+{
+    int n = 0;
+    while (n < _cap[spur] && nibble(s, _base[spur] + n) != 0)
+        n++;
+    return n;
+}
+
+
+int YardPlanner::car(State s, int spur, int i) const
+{
+    if (i < 0 || i >= _cap[spur])
+        return -1;
+    return nibble(s, _base[spur] + i) - 1;
+}
+
+
+int YardPlanner::find(State s, int c) const
+{
+    for (int spur = 0; spur < _spur_cnt; spur++)
+        for (int i = 0; i < _cap[spur]; i++)
+            if (car(s, spur, i) == c)
+                return spur;
+    return -1;
+}
+
+
+bool YardPlanner::legal(State s, const Move &m) const
+{
+    if (m.from < 0 || m.from >= _spur_cnt || m.to < 0 ||
+        m.to >= _spur_cnt || m.from == m.to)
+        return false;
+    if (m.cars < 1 || m.cars > _train_max)
+        return false;
+    return m.cars <= count(s, m.from) &&
+           count(s, m.to) + m.cars <= _cap[m.to];
+}
+
+
+YardPlanner::State YardPlanner::apply(State s, const Move &m) const
+{
+    const int n_from = count(s, m.from);
+    const int n_to = count(s, m.to);
+    for (int i = 0; i < m.cars; i++) {
+        const int p_from = _base[m.from] + n_from - m.cars + i;
+        const int p_to = _base[m.to] + n_to + i;
+        s |= State(nibble(s, p_from)) << (4 * p_to);
+        s &= ~(State(0xf) << (4 * p_from));
+    }
+    return s;
+}
+
+
+void YardPlanner::print(State s) const
+{
+    for (int spur = 0; spur < _spur_cnt; spur++) {
+        printf("%s%d:[", (spur == 0) ? "" : " ", spur);
+        for (int i = 0; i < count(s, spur); i++)
+            printf("%s%d", (i == 0) ? "" : " ", car(s, spur, i));
+        printf("]");
+    }
+    printf("\n");
+}
+
+
+void YardPlanner::print_stats() const
+{
+    printf("yard: %u plans, %u from cache, %u searches, most nodes %u\n",
+           unsigned(_plans), unsigned(_hits), unsigned(_searches),
+           unsigned(_nodes_max));
+}
+
+
+int YardPlanner::plan(State from, State to, const Move *&moves)
+{
+    _plans++;
+    _use++;
+
+    for (int i = 0; i < _cache_cnt; i++) {
+        Plan &p = _cache[i];
+        if (p.from == from && p.to == to) {
+            _hits++;
+            p.used = _use;
+            moves = p.move;
+            return p.cnt;
+        }
+    }
+
+    // a free entry, else the least recently used
+    int use = _cache_cnt;
+    if (_cache_cnt < cache_max) {
+        _cache_cnt++;
+    } else {
+        use = 0;
+        for (int i = 1; i < cache_max; i++)
+            if (_cache[i].used < _cache[use].used)
+                use = i;
+    }
+
+    Plan &p = _cache[use];
+    p.from = from;
+    p.to = to;
+    p.used = _use;
+    p.cnt = search(from, to, p.move);
+    moves = p.move;
+    return p.cnt;
+}
+
+
+void YardPlanner::costs_changed()
+{
+    _cache_cnt = 0;
+    _cost_min = 0;
+}
+
+
+// Cars that are where they're going, with everything under them, don't
+// have to move again; each move can put at most _train_max of the others
+// where they're going.
+uint32_t YardPlanner::estimate(State s, State to) const
+{
+    int unsettled = 0;
+    for (int spur = 0; spur < _spur_cnt; spur++) {
+        const int n = count(s, spur);
+        int i = 0;
+        while (i < n && car(s, spur, i) == car(to, spur, i))
+            i++;
+        unsettled += n - i;
+    }
+    const int moves = (unsettled + _train_max - 1) / _train_max;
+    return uint32_t(moves) * _cost_min;
+}
+
+
+// s's node, added if it's new; -1 if the tables are full
+int YardPlanner::node(State s, bool &added)
+{
+    added = false;
+    uint32_t h = uint32_t(s ^ (s >> 29)) * 0x9e3779b1u;
+    for (int k = 0; k < hash_max; k++) {
+        const int slot = int((h + k) % hash_max);
+        const int n = _hash[slot];
+        if (n >= 0 && _node[n].s == s)
+            return n;
+        if (n < 0) {
+            if (_node_cnt >= node_max)
+                return -1;
+            _hash[slot] = int16_t(_node_cnt);
+            _node[_node_cnt].s = s;
+            added = true;
+            return _node_cnt++;
+        }
+    }
+    return -1;
+}
+
+
+void YardPlanner::heap_push(int n)
+{
+    int i = _heap_cnt++;
+    while (i > 0) {
+        const int up = (i - 1) / 2;
+        if (_node[_heap[up]].f <= _node[n].f)
+            break;
+        _heap[i] = _heap[up];
+        i = up;
+    }
+    _heap[i] = int16_t(n);
+}
+
+
+int YardPlanner::heap_pop()
+{
+    const int top = _heap[0];
+    const int last = _heap[--_heap_cnt];
+    int i = 0;
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= _heap_cnt)
+            break;
+        if (child + 1 < _heap_cnt &&
+            _node[_heap[child + 1]].f < _node[_heap[child]].f)
+            child++;
+        if (_node[last].f <= _node[_heap[child]].f)
+            break;
+        _heap[i] = _heap[child];
+        i = child;
+    }
+    if (_heap_cnt > 0)
+        _heap[i] = int16_t(last);
+    return top;
+}
+
+
+// Every arrangement one move from node n's; false if there's no room.
+bool YardPlanner::expand(int n, State to)
+{
+    const State s = _node[n].s;
+    for (int a = 0; a < _spur_cnt; a++) {
+        for (int b = 0; b < _spur_cnt; b++) {
+            for (int c = 1; c <= _train_max; c++) {
+                const Move m = {int8_t(a), int8_t(b), int8_t(c)};
+                if (!legal(s, m))
+                    continue;
+                const State t = apply(s, m);
+                const uint32_t g = _node[n].g + _cost(a, b, c, _cost_arg);
+                bool added;
+                const int k = node(t, added);
+                if (k < 0 || _heap_cnt >= hash_max)
+                    return false;
+                if (!added && _node[k].g <= g)
+                    continue;
+                _node[k].g = g;
+                _node[k].f = g + estimate(t, to);
+                _node[k].parent = int16_t(n);
+                _node[k].move = m;
+                heap_push(k);
+            }
+        }
+    }
+    return true;
+}
+
+
+int YardPlanner::search(State from, State to, Move *move)
+{
+    _searches++;
+
+    if (_cost_min == 0) {
+        // the cheapest move, for the estimate
+        _cost_min = UINT32_MAX;
+        for (int a = 0; a < _spur_cnt; a++)
+            for (int b = 0; b < _spur_cnt; b++)
+                if (a != b && _cost(a, b, 1, _cost_arg) < _cost_min)
+                    _cost_min = _cost(a, b, 1, _cost_arg);
+    }
+
+    for (int i = 0; i < hash_max; i++)
+        _hash[i] = -1;
+    _node_cnt = 0;
+    _heap_cnt = 0;
+
+    bool added;
+    int n = node(from, added);
+    _node[n].g = 0;
+    _node[n].f = estimate(from, to);
+    _node[n].parent = -1;
+    heap_push(n);
+
+    int found = -1;
+    bool full = false;
+    while (_heap_cnt > 0 && !full) {
+        n = heap_pop();
+        if (_node[n].s == to) {
+            found = n;
+            break;
+        }
+        full = !expand(n, to);
+    }
+
+    if (uint32_t(_node_cnt) > _nodes_max)
+        _nodes_max = _node_cnt;
+
+    if (full)
+        printf("yard: search ran out of room\n");
+
+    if (found < 0)
+        return -1;
+
+    int cnt = 0;
+    for (int k = found; _node[k].parent >= 0; k = _node[k].parent)
+        cnt++;
+    if (cnt > move_max)
+        return -1;
+    int i = cnt;
+    for (int k = found; _node[k].parent >= 0; k = _node[k].parent)
+        move[--i] = _node[k].move;
+    return cnt;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+
+// Plans the moves that get cars on a set of spurs from one arrangement to
+// another, in the least time.
+//
+// Spurs are stubs with room for so many cars each (their capacity). Cars
+// are numbered, and a spur's cars are in order from the end of the spur;
+// only the ones nearest the throat can be reached. A move is the loco
+// taking the nearest few cars (up to train_max) off one spur and leaving
+// them, uncoupled, on another, so cars keep their order. The app says how
+// long a move takes (cost), which is what's minimized.
+//
+// An arrangement (State) packs every spur's cars into 64 bits, a nibble
+// per place, so the spurs' capacities can't add up to more than 16.
+//
+// plan() is A*: the estimate for what's left is the number of cars not yet
+// where they're going (with everything under them) over train_max, times
+// the cheapest move. Plans are cached by from and to, so an app going
+// through the same arrangements over and over searches only the first
+// time around; when the costs change, costs_changed() drops them. The
+// search has fixed-size tables; if it runs out of room, there's no plan.
+
+class YardPlanner
+{
+public:
+
+    typedef uint64_t State;
+
+    struct Move {
+        int8_t from; // spur
+        int8_t to;   // spur
+        int8_t cars; // how many, from the throat end of from
+    };
+
+    // Milliseconds (or any consistent unit) for a move.
+    typedef uint32_t(CostFunc)(int from, int to, int cars, intptr_t arg);
+
+    static constexpr int spur_max = 8;
+    static constexpr int place_max = 16; // all spurs' capacities together
+    static constexpr int car_max = 15;
+    static constexpr int move_max = 16;   // longest plan
+    static constexpr int node_max = 1024; // arrangements in a search
+    static constexpr int hash_max = 2 * node_max;
+    static constexpr int cache_max = 8;
+
+    YardPlanner(int spur_cnt, const int *cap, int train_max, CostFunc *cost,
+                intptr_t cost_arg = 0);
+
+    // Number of moves from from to to (0 if they're the same) and the
+    // moves themselves, good until the next plan(); -1 if there's no way.
+    int plan(State from, State to, const Move *&moves);
+
+    // The cost function's answers have changed; plan afresh. Moves from
+    // the last plan() stay good until the next one.
+    void costs_changed();
+
+    static constexpr State empty = 0;
+
+    // Add car on the throat end of spur; false if it's full.
+    bool push(State &s, int spur, int car) const;
+
+    int count(State s, int spur) const;
+
+    // ith car from the end of spur, -1 if none
+    int car(State s, int spur, int i) const;
+
+    // Which spur car is on, -1 if none.
+    int find(State s, int car) const;
+
+    bool legal(State s, const Move &m) const;
+
+    State apply(State s, const Move &m) const;
+
+    void print(State s) const;
+
+    void print_stats() const;
+
+private:
+
+    int _spur_cnt;
+    int _cap[spur_max];
+    int _base[spur_max]; // first place of each spur
+    int _train_max;
+    CostFunc *_cost;
+    intptr_t _cost_arg;
+    uint32_t _cost_min; // cheapest move
+
+    struct Node {
+        State s;
+        uint32_t g; // cost to get here
+        uint32_t f; // g plus the estimate for the rest
+        int16_t parent;
+        Move move; // from parent
+    };
+
+    Node _node[node_max];
+    int16_t _hash[hash_max]; // node index, -1 for none
+    int16_t _heap[hash_max]; // open nodes by f (a node can be in twice)
+    int _node_cnt;
+    int _heap_cnt;
+
+    struct Plan {
+        State from;
+        State to;
+        int cnt; // -1 if there's no way
+        Move move[move_max];
+        uint32_t used;
+    };
+
+    Plan _cache[cache_max];
+    int _cache_cnt;
+    uint32_t _use;
+
+    // stats
+    uint32_t _plans;
+    uint32_t _hits;
+    uint32_t _searches;
+    uint32_t _nodes_max;
+
+    static int nibble(State s, int place)
+    {
+        return int((s >> (4 * place)) & 0xf);
+    }
+
+    int search(State from, State to, Move *move);
+    bool expand(int n, State to);
+    uint32_t estimate(State s, State to) const;
+    int node(State s, bool &added);
+    void heap_push(int n);
+    int heap_pop();
+};
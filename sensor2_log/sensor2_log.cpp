@@ -20,6 +20,8 @@ using Status = DccApi::Status;
 //
 #include "config.h"
 #include "locos.h"
+// track
+#include "motion.h"
 
 // Test for Sensor2, which measures distance from then sensor rather than just
 // detect/not-detect.
@@ -116,8 +118,8 @@ int main()
 
 static void loop(int32_t for_us)
 {
-    int32_t end_us = int32_t(time_us_32()) + for_us;
-    while (end_us - int32_t(time_us_32()) >= 0)
+    const uint32_t end_us = time_us_32() + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0)
         SysLed::loop();
 }
 
@@ -256,7 +258,7 @@ static void mode_raw()
     // drive about fwd_mm forward
     constexpr int fwd_mm = 500;
     DccApi::loco_speed_set(loco_id, loco->speed_dcc(speed_mms));
-    loop(fwd_mm * 1'000'000 / speed_mms);
+    loop(Motion::time_us(fwd_mm, speed_mms));
     DccApi::loco_speed_set(loco_id, 0);
     loop(1'000'000);
 
@@ -305,9 +307,9 @@ static void mode_spot()
     // drive about fwd_mm forward
     constexpr int fwd_mm = 500;
     DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
-    loop(slow_mm * 1'000'000 / slow_mms);
+    loop(Motion::time_us(slow_mm, slow_mms));
     DccApi::loco_speed_set(loco_id, loco->speed_dcc(fast_mms));
-    loop((fwd_mm - slow_mm) * 1'000'000 / fast_mms);
+    loop(Motion::time_us(fwd_mm - slow_mm, fast_mms));
     DccApi::loco_speed_set(loco_id, 0);
     loop(1'000'000);
 }
@@ -340,9 +342,9 @@ static void mode_fetch()
     constexpr int slow_mm = 100;
     constexpr int fast_mm = 400;
     DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
-    loop(slow_mm * 1'000'000 / slow_mms);
+    loop(Motion::time_us(slow_mm, slow_mms));
     DccApi::loco_speed_set(loco_id, loco->speed_dcc(fast_mms));
-    loop(fast_mm * 1'000'000 / fast_mms);
+    loop(Motion::time_us(fast_mm, fast_mms));
     DccApi::loco_speed_set(loco_id, 0);
     loop(1'000'000);
 }
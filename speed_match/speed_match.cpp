@@ -0,0 +1,337 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+// pico
+#include "pico/stdio.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+// misc
+#include "sys_led.h"
+// dcc
+#include "dcc_api.h"
+using Status = DccApi::Status;
+// railroad
+#include "desktop_layout.h"
+#include "sensor.h"
+#include "sensor2.h"
+#include "turnout.h"
+//
+#include "config.h"
+#include "locos.h"
+// track
+#include "consist.h"
+#include "cv_batch.h"
+#include "speed_match.h"
+#include "speed_table.h"
+
+// Make the loco on the track run like a roster loco (speed_match.h).
+//
+// The loco's curve is measured with its decoder reset (so its own table is
+// out of the way), a speed table is made from it that follows the named
+// roster loco's, written, and the loco measured again to see how close it
+// came. The loco itself needn't be in the roster; a new decoder is what
+// this is for.
+//
+// Speeds are measured on spur 1 with its distance sensor: from just out of
+// the sensor's reach, the loco runs in at the step being measured and is
+// timed from meas_far_mm to meas_near_mm.
+//
+// The loco starts alone in front of the uncoupler sensor. Type the roster
+// name of the loco to match to, then return; again after each match.
+
+static constexpr int loco_id = 3;
+
+static constexpr int consist_address = 10;
+
+static constexpr int spur_num = 1;
+
+static constexpr int meas_far_mm = 600;
+static constexpr int meas_near_mm = 200;
+
+static constexpr int reach_mm = 720;      // the sensor sees it from here in
+static constexpr int find_dcc = 40;       // to get into reach
+static constexpr int back_dcc = 15;       // and back out of it
+static constexpr int back_us = 1'000'000; // past the edge of its reach
+
+static void init();
+static void loop(int32_t for_us = 0);
+static bool check_setup();
+static const Loco *ask_ref();
+static int dcc_measure(int speed_dcc);
+static void speed_match(const Loco *ref_loco);
+
+// in the roster, or nullptr (it's only for printing then)
+static const Loco *loco = nullptr;
+static uint32_t loco_sn = 0;
+
+
+int main()
+{
+    stdio_init_all();
+    SysLed::init();
+
+    SysLed::pattern(50, 950);
+
+#if 1
+    while (!stdio_usb_connected()) {
+        SysLed::loop();
+        tight_loop_contents();
+    }
+    sleep_ms(10); // small delay needed or we lose the first prints
+#endif
+
+    SysLed::off();
+
+    printf("\n");
+    printf("speed_match\n");
+    printf("\n");
+
+    init();
+
+    while (!check_setup()) {
+        // flash led waiting for correct setup
+        SysLed::on();
+        loop(500'000);
+        SysLed::off();
+        loop(500'000);
+    }
+
+    while (true)
+        speed_match(ask_ref());
+
+    return 0;
+
+} // main()
+
+
+static void init()
+{
+    for (int i = 0; i < sensor_max; i++)
+        sensor[i].init();
+
+    for (int i = 0; i < sensor2_max; i++)
+        sensor2[i].init();
+
+    Turnout::init(tp_gpio);
+
+    line_turnout_0(spur_num);
+    line_turnout_1(spur_num);
+
+    DccApi::init(dcc_sig_gpio, dcc_pwr_gpio, dcc_adc_gpio, dcc_rcom_gpio,
+                 dcc_rcom_uart);
+
+    printf("reset loco ... ");
+    Status s;
+    while ((s = DccApi::cv_val_set(8, 8)) != Status::Ok) {
+        printf("%s.", DccApi::status(s));
+        loop(500'000);
+    }
+    printf("ok\n");
+
+    loop(1'000'000);
+
+    printf("create loco ... ");
+    assert(DccApi::loco_create(loco_id) == Status::Ok);
+    printf("ok\n");
+
+    printf("track on ... ");
+    assert(DccApi::track_set(true) == Status::Ok);
+    printf("ok\n");
+
+    loop(1'000'000); // wait for loco to boot up
+
+    printf("read sn ... ");
+    while ((s = Loco::read_sn(loco_id, loco_sn)) != Status::Ok) {
+        printf("%s ... ", DccApi::status(s));
+        loop(1'000'000);
+    }
+    printf("%lu\n", loco_sn);
+
+    loco = Loco::find_loco(loco_sn);
+    printf("loco: %s\n", (loco != nullptr) ? loco->name : "not in roster");
+
+} // init
+
+
+static void loop(int32_t for_us)
+{
+    const uint32_t end_us = time_us_32() + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0)
+        SysLed::loop();
+}
+
+
+// Loco should be in front of the uncoupler sensor, and spur 1 empty.
+static bool check_setup()
+{
+    bool ok = true;
+
+    if (!sensor_unc()) {
+        printf("ERROR: loco should be in front of the uncoupler sensor\n");
+        ok = false;
+    }
+
+    if (sensor_spur(spur_num).dist_mm() < reach_mm) {
+        printf("ERROR: spur %d should be empty\n", spur_num);
+        ok = false;
+    }
+
+    return ok;
+}
+
+
+static const Loco *ask_ref()
+{
+    const Loco *ref = nullptr;
+    while (ref == nullptr) {
+        printf("match to: ");
+        char name[16];
+        int len = 0;
+        while (true) {
+            const int c = stdio_getchar_timeout_us(100'000);
+            if (c < 0)
+                continue;
+            if (c == '\r' || c == '\n')
+                break;
+            if (len < int(sizeof(name)) - 1) {
+                name[len++] = char(c);
+                putchar(c);
+            }
+        }
+        name[len] = '\0';
+        printf("\n");
+        if (len == 0)
+            continue;
+        ref = Loco::find_loco(name);
+        if (ref == nullptr)
+            printf("no %s in roster\n", name);
+    }
+    return ref;
+}
+
+
+// Step to mm/sec, measured on the spur (toward its end is reverse).
+static int dcc_measure(int speed_dcc)
+{
+    printf("dcc_measure(%d) ... ", speed_dcc);
+
+    Sensor2 &s = sensor_spur(spur_num);
+
+    // into the sensor's reach (it's past the turnouts on the first run),
+    // then just back out of it
+    if (s.dist_mm() >= reach_mm) {
+        DccApi::loco_speed_set(loco_id, -find_dcc);
+        while (s.dist_mm() >= reach_mm)
+            loop();
+        DccApi::loco_speed_set(loco_id, 0);
+        loop(1'000'000);
+    }
+    DccApi::loco_speed_set(loco_id, back_dcc);
+    while (s.dist_mm() < reach_mm)
+        loop();
+    loop(back_us);
+    DccApi::loco_speed_set(loco_id, 0);
+    loop(2'000'000);
+
+    DccApi::loco_speed_set(loco_id, -speed_dcc);
+    int far_mm;
+    while ((far_mm = s.dist_mm()) > meas_far_mm)
+        loop();
+    const uint32_t start_us = time_us_32();
+    int near_mm;
+    while ((near_mm = s.dist_mm()) > meas_near_mm)
+        loop();
+    const uint32_t elapsed_us = time_us_32() - start_us;
+
+    DccApi::loco_speed_set(loco_id, 0);
+
+    const int speed_mms =
+        int((int64_t(far_mm - near_mm) * 1'000'000 + elapsed_us / 2) /
+            elapsed_us);
+
+    printf("%lu ms; measured %d mm/s\n", (elapsed_us + 500) / 1000,
+           speed_mms);
+
+    return speed_mms;
+}
+
+
+// Measure the loco's curve, make a speed table from it that follows
+// ref_loco's, write it, and measure again to see how close it came.
+static void speed_match(const Loco *ref_loco)
+{
+    printf("matching %lu to %s\n", loco_sn, ref_loco->name);
+
+    // How far apart they'd run as a consist on their roster curves, for
+    // comparing with the table's result below. Nothing is sent, so the
+    // consist address and ref_loco's id don't matter.
+    if (loco != nullptr) {
+        Consist pair(consist_address);
+        pair.add(loco_id, loco);
+        pair.add(loco_id + 1, ref_loco);
+        pair.print();
+    }
+
+    // factory curve (a match before this one may have set a table)
+    CvBatch reset(loco_id);
+    reset.add(29, 0x06); // 128 steps, no table
+    reset.add(2, 0);
+    reset.add(5, 0);
+    reset.add(6, 0);
+    if (reset.write() > 0) {
+        reset.print();
+        printf("speed match: can't reset the curve\n");
+        return;
+    }
+
+    SpeedTable::Point measured[25];
+    int measured_cnt = 0;
+    for (int dcc = 5; dcc <= 125; dcc += 5) {
+        measured[measured_cnt++] = {dcc, dcc_measure(dcc)};
+        loop(2'000'000);
+    }
+    const SpeedTable target(measured, measured_cnt);
+    const SpeedTable ref(ref_loco);
+    const SpeedMatch match(target, ref);
+    match.print(target, ref);
+
+    int cv29 = -1;
+    Status s;
+    while ((s = DccApi::loco_cv_val_get(loco_id, 29, cv29)) != Status::Ok) {
+        printf("read cv29: %s.", DccApi::status(s));
+        loop(1'000'000);
+    }
+
+    CvBatch batch(loco_id);
+    batch.add(2, match.vstart());
+    batch.add(5, match.vhigh());
+    batch.add(6, match.vmid());
+    for (int i = 0; i < SpeedMatch::entry_max; i++)
+        batch.add(SpeedMatch::cv_table + i, match.entry(i));
+    batch.add(29, cv29 | 0x10); // use the table
+    const int left = batch.write();
+    batch.print();
+    if (left > 0) {
+        printf("speed match: not all cvs took; not measuring\n");
+        return;
+    }
+
+    int err_max = 0;
+    int err_sum = 0;
+    int cnt = 0;
+    for (int dcc = 15; dcc <= 120; dcc += 15) {
+        const int want = ref.mms(dcc);
+        const int got = dcc_measure(dcc);
+        const int err = got - want;
+        printf("  step %d: want %d mm/s, %+d\n", dcc, want, err);
+        if (abs(err) > err_max)
+            err_max = abs(err);
+        err_sum += abs(err);
+        cnt++;
+        loop(2'000'000);
+    }
+    printf("speed match: %lu is within %d mm/s of %s (mean %d)\n", loco_sn,
+           err_max, ref_loco->name, (err_sum + cnt / 2) / cnt);
+}
@@ -17,6 +17,10 @@ using Status = DccApi::Status;
 //
 #include "config.h"
 #include "locos.h"
+// track
+#include "layout.h"
+#include "motion.h"
+#include "speed_table.h"
 
 ///// Turnouts ///////////////////////////////////////////////////////////////
 
@@ -42,18 +46,18 @@ static constexpr int loco_id = 3;
 
 static const Loco *loco = Loco::find_loco("ML560");
 
+// From clearing sensor3 to clearing sensor1, from the layout in flash if
+// it has nodes s3 and s1 (layout.h); otherwise the desktop layout's.
+static Layout layout;
+static uint32_t dist_um = 831'500;
+
 static void loop(int32_t for_us = 0);
 static void ops_cv_set(int cv_num, int cv_val, const char *name);
 static void init();
 static bool check_setup();
-[[maybe_unused]] static void dcc_measure(int speed_dcc);
+[[maybe_unused]] static int dcc_measure(int speed_dcc);
 [[maybe_unused]] static void mms_measure(int speed_mms);
 
-static uint32_t mm_to_us(int dist_mm, int speed_dcc)
-{
-    return (dist_mm * 285714) / speed_dcc;
-}
-
 
 int main()
 {
@@ -89,13 +93,17 @@ int main()
     while (true) {
 
 #if 1
+        // how far the roster's curve is from each measurement
+        SpeedTable::Point measured[25];
+        int measured_cnt = 0;
         for (int dcc = 5; dcc <= 125; dcc += 5) {
             //if (dcc == 5)
                 //dcc_measure(7);
             //else
-                dcc_measure(dcc);
+                measured[measured_cnt++] = {dcc, dcc_measure(dcc)};
             loop(2'000'000);
         }
+        SpeedTable(loco).print(measured, measured_cnt);
 #else
         for (int mms = 10; mms <= 300; mms += 10) {
             mms_measure(mms);
@@ -113,8 +121,8 @@ int main()
 
 static void loop(int32_t for_us)
 {
-    int32_t end_us = int32_t(time_us_32()) + for_us;
-    while (end_us - int32_t(time_us_32()) >= 0) {
+    const uint32_t end_us = time_us_32() + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0) {
         SysLed::loop();
         BufLog::loop();
     }
@@ -136,6 +144,14 @@ static void ops_cv_set(int cv_num, int cv_val, const char *name)
 
 static void init()
 {
+    if (layout.load()) {
+        const int s3 = layout.node("s3");
+        const int s1 = layout.node("s1");
+        if (s3 >= 0 && s1 >= 0 && layout.dist_mm(s3, s1) > 0)
+            dist_um = layout.dist_mm(s3, s1) * 1000;
+    }
+    printf("measuring over %lu um\n", dist_um);
+
     Turnout::init(tp_gpio);
 
     turnout[0].set(true); // straight
@@ -203,11 +219,12 @@ static bool check_setup()
 // Forward at specified speed.
 // Report elapsed time from clearing sensor3 to clearing sensor1.
 // On the desktop layout, the distance is 174 + 227 + 246 + 123 + 123/2 = 831.5mm
+// (dist_um, unless the layout in flash has it).
 
 
 // Run at various DCC speed settings, measuring actual speed in mm/s.
 // Results used to fill in speeds table in locos.cpp.
-static void dcc_measure(int speed_dcc)
+static int dcc_measure(int speed_dcc)
 {
     printf("dcc_measure(%d) ... ", speed_dcc);
 
@@ -218,7 +235,7 @@ static void dcc_measure(int speed_dcc)
     while (!sensor[2])
         loop();
     // another inch, then stop
-    loop(mm_to_us(25, 5));
+    loop(Motion::time_us(25, loco->speed_mms(5)));
     DccApi::loco_speed_set(loco_id, 0);
     loop(2'000'000);
 
@@ -237,11 +254,12 @@ static void dcc_measure(int speed_dcc)
 
     DccApi::loco_speed_set(loco_id, 0);
 
-    static constexpr uint32_t dist_um = 831'500;
     uint32_t elapsed_ms = (elapsed_us + 500) / 1000;
     uint32_t speed_mms = dist_um / elapsed_ms;
 
     printf("%lu ms; measured %lu mm/s\n", elapsed_ms, speed_mms);
+
+    return int(speed_mms);
 }
 
 
@@ -256,7 +274,7 @@ static void mms_measure(int speed_mms)
     while (!sensor[2])
         loop();
     // another inch, then stop
-    loop(mm_to_us(25, 5));
+    loop(Motion::time_us(25, loco->speed_mms(5)));
     DccApi::loco_speed_set(loco_id, 0);
     loop(2'000'000);
 
@@ -278,7 +296,6 @@ static void mms_measure(int speed_mms)
 
     DccApi::loco_speed_set(loco_id, 0);
 
-    static constexpr uint32_t dist_um = 831'500;
     uint32_t elapsed_ms = (elapsed_us + 500) / 1000;
     uint32_t measured_mms = dist_um / elapsed_ms;
 
@@ -138,8 +138,8 @@ static void init()
 
 static void loop(int32_t for_us)
 {
-    int32_t end_us = int32_t(time_us_32()) + for_us;
-    while (end_us - int32_t(time_us_32()) >= 0)
+    const uint32_t end_us = time_us_32() + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0)
         SysLed::loop();
 }
 
@@ -24,6 +24,9 @@
 #include "gui.h"
 // dcc
 #include "dcc.h"
+// track
+#include "dcc_adc_capture.h"
+#include "dcc_fast_trip.h"
 //
 #include "dcc_gpio_cfg.h"
 #include "fb_gpio_cfg.h"
@@ -59,13 +62,32 @@ static Gt911 ts(i2c_dev, ts_i2c_addr, ts_rst_gpio, ts_int_gpio);
 ///// DCC ////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
 
-static DccAdc adc(dcc_adc_gpio);
-
-static DccCommand command(dcc_sig_gpio, dcc_pwr_gpio, -1, &adc, dcc_rcom_uart,
-                          dcc_rcom_gpio);
+// The ADC belongs to the capture below, so DccCommand gets no DccAdc: the
+// fast trip does the overcurrent check, and the throttle only uses ops
+// mode (service-mode acks would need a DccAdc, with the capture stopped).
+static DccCommand command(dcc_sig_gpio, dcc_pwr_gpio, -1, nullptr,
+                          dcc_rcom_uart, dcc_rcom_gpio);
 
 static DccLoco *loco = nullptr;
 
+// Track current capture. Send 'c' over usb to export a window; 't' arms a
+// rising-edge trigger at capture_level and 'c' then exports what it caught.
+// DccCommand has no per-packet hook, so there are no packet marks here
+// (dcc_tx_test has them, from DccTx).
+static DccAdcCapture capture(dcc_adc_gpio, 250'000);
+
+static constexpr uint16_t capture_level = 2048; // raw adc counts
+
+// Short circuit cutoff, checked on every capture block. 'l' prints the trip
+// log, 'x' exports the last trip's trace, 'r' clears a latched trip.
+static constexpr uint16_t trip_level = 3000;  // raw adc counts
+static constexpr uint16_t inrush_level = 3800; // during blanking
+static constexpr uint32_t inrush_us = 20'000;
+
+static DccFastTrip trip(capture, dcc_pwr_gpio, trip_level);
+
+static void capture_loop();
+
 //////////////////////////////////////////////////////////////////////////////
 // GUI ///////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////
@@ -1126,10 +1148,18 @@ int main()
 
     loco = command.create_loco(); // default address 3
 
+    trip.blanking(inrush_us, inrush_level);
+    trip.retry(5, 100'000, 2'000'000);
+    trip.init();
+    capture.start();
+
     command.set_mode_ops(); // track power on
+    trip.power_on();
 
     while (true) {
 
+        capture_loop();
+
         Event event(ts.get_event());
         if (event.type != Event::Type::none) {
             // anyone have focus?
@@ -1158,3 +1188,23 @@ int main()
     return 0;
 
 } // int main()
+
+
+static void capture_loop()
+{
+    capture.loop();
+
+    int c = stdio_getchar_timeout_us(0);
+    if (c == 'c') {
+        capture.export_window();
+    } else if (c == 't') {
+        capture.trigger(DccAdcCapture::Trigger::Rising, capture_level);
+        printf("capture armed\n");
+    } else if (c == 'l') {
+        trip.print_log();
+    } else if (c == 'x') {
+        trip.export_trace();
+    } else if (c == 'r') {
+        trip.reset();
+    }
+}
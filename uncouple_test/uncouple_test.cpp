@@ -17,6 +17,8 @@ using Status = DccApi::Status;
 #include "locos.h"
 #include "sensor.h"
 #include "turnout.h"
+// track
+#include "motion.h"
 
 ///// Locos //////////////////////////////////////////////////////////////////
 
@@ -28,20 +30,19 @@ static const int fast_mms = 150;
 static const int medium_mms = 100;
 static const int slow_mms = 75;
 static const int creep_mms = 25;
-static const int stop = 0;
-
-// How many microseconds to go dist_mm at speed_mms
-static uint32_t mm_to_us(int dist_mm, int speed_mms)
-{
-    const uint32_t t_us = (dist_mm * 1'000'000 + speed_mms / 2) / speed_mms;
-    return t_us;
-}
 
 static int car_len_mm = 150; // boxcar and tanker
 
 static void init();
 static void loop(int32_t for_us = 0);
 
+static void motion_loop(int32_t for_us, intptr_t)
+{
+    loop(for_us);
+}
+
+static Motion motion(motion_loop);
+
 static void fetch();
 static void uncouple();
 static void spot();
@@ -95,8 +96,8 @@ int main()
 
 static void loop(int32_t for_us)
 {
-    int32_t end_us = int32_t(time_us_32()) + for_us;
-    while (end_us - int32_t(time_us_32()) >= 0) {
+    const uint32_t end_us = time_us_32() + for_us;
+    while (int32_t(end_us - time_us_32()) >= 0) {
         SysLed::loop();
     }
 } // loop
@@ -115,16 +116,12 @@ static void fetch()
         printf("uncoupler sensor active is unexpected\n");
 
     // slow to uncoupler
-    DccApi::loco_speed_set(loco_id, -loco->speed_dcc(slow_mms));
-    while (!sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), true, -slow_mms);
     // rear of loco is at uncoupler
-    DccApi::loco_speed_set(loco_id, -loco->speed_dcc(creep_mms));
-    while (sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), false, -creep_mms);
     // front of loco has cleared uncoupler
-    loop(mm_to_us(10, creep_mms));
-    DccApi::loco_speed_set(loco_id, stop);
+    motion.move(10, -creep_mms);
+    motion.stop();
     loop(1'000'000);
 
     if (sensor_unc())
@@ -145,20 +142,13 @@ static void uncouple()
         printf("uncoupler sensor active is unexpected\n");
 
     // forward until nose of loco is at uncoupler (might already be there)
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
-    while (!sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), true, slow_mms);
 
     // creep forward until rear of loco (gap) is at uncoupler
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
-    while (sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), false, creep_mms);
 
     // a bit more to get couplers clear of magnet (~50 mm)
-    int more_mm = 50 - loco->stop_mm(creep_mms);
-    if (more_mm > 0)
-        loop(mm_to_us(more_mm, creep_mms));
-    DccApi::loco_speed_set(loco_id, stop);
+    motion.move(50, creep_mms, true);
     loop(1'000'000);
 
     // couplers should be clear of magnet now
@@ -166,18 +156,15 @@ static void uncouple()
     do {
 
         // creep back until couplers are over magnet
-        DccApi::loco_speed_set(loco_id, -loco->speed_dcc(creep_mms));
-        while (sensor_unc())
-            loop();
-        DccApi::loco_speed_set(loco_id, stop);
+        motion.move_until(sensor_unc(), false, -creep_mms);
+        motion.stop();
         loop(500'000);
 
         // couplers should be over magnet now
 
         // pull forward to uncouple (should leave car behind)
-        DccApi::loco_speed_set(loco_id, loco->speed_dcc(creep_mms));
-        loop(mm_to_us(car_len_mm / 2, creep_mms));
-        DccApi::loco_speed_set(loco_id, stop);
+        motion.move(car_len_mm / 2, creep_mms);
+        motion.stop();
         loop(500'000);
 
         // retry if necessary
@@ -204,15 +191,12 @@ static void spot()
         printf("uncoupler sensor active is unexpected\n");
 
     // creep back until rear of loco gets to sensor
-    DccApi::loco_speed_set(loco_id, -loco->speed_dcc(creep_mms));
-    while (!sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), true, -creep_mms);
 
     // continue until loco clears uncoupler
-    while (sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), false, -creep_mms);
 
-    DccApi::loco_speed_set(loco_id, stop);
+    motion.stop();
     loop(1'000'000);
 
     if (sensor_unc())
@@ -228,17 +212,10 @@ static void spot()
 static void home()
 {
     printf("home\n");
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(medium_mms));
-    while (!sensor_unc())
-        loop();
-    DccApi::loco_speed_set(loco_id, loco->speed_dcc(slow_mms));
-    while (sensor_unc())
-        loop();
+    motion.move_until(sensor_unc(), true, medium_mms);
+    motion.move_until(sensor_unc(), false, slow_mms);
     // go another 60 mm and stop
-    int more_mm = 60 - loco->stop_mm(slow_mms);
-    if (more_mm > 0)
-        loop(mm_to_us(more_mm, slow_mms));
-    DccApi::loco_speed_set(loco_id, stop);
+    motion.move(60, slow_mms, true);
     loop(1'000'000);
 }
 
@@ -290,6 +267,8 @@ static void init()
 
     DccApi::loco_cv_val_set(loco_id, 3, 0);
     DccApi::loco_cv_val_set(loco_id, 4, 0);
+    motion.init(loco_id, loco);
+    motion.momentum(0, 0);
     DccApi::loco_cv_val_set(loco_id, 63, loco->v_master);
     DccApi::loco_cv_bit_set(loco_id, 29, 2, 0);  // disable DC
     DccApi::loco_cv_bit_set(loco_id, 124, 2, 0); // disable startup delay